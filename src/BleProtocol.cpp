@@ -0,0 +1,209 @@
+#include "BleProtocol.h"
+#include <math.h>
+
+namespace BleProtocol
+{
+
+namespace {
+    size_t writeHeader(uint8_t* out, MessageType type, uint8_t seq, uint8_t length) {
+        out[0] = SYNC;
+        out[1] = VERSION;
+        out[2] = (uint8_t)type;
+        out[3] = seq;
+        out[4] = length;
+        return HEADER_SIZE;
+    }
+
+    uint16_t readU16(const uint8_t* data) {
+        return (uint16_t)(data[0] | (data[1] << 8));
+    }
+
+    size_t writeU16(uint8_t* out, uint16_t value) {
+        out[0] = (uint8_t)(value & 0xFF);
+        out[1] = (uint8_t)(value >> 8);
+        return 2;
+    }
+
+    uint16_t toU16(uint32_t value) {
+        return value > UINT16_MAX ? UINT16_MAX : (uint16_t)value;
+    }
+
+    // count:u8 followed by count x (address:u8, weight:u16)
+    AckResult decodeSteps(const uint8_t* payload, size_t length, Command& command) {
+        if (length < 1 || payload[0] == 0 || payload[0] > MAX_ORDER_STEPS || length != 1 + (size_t)payload[0] * 3) {
+            return AckResult::MALFORMED;
+        }
+        command.stepCount = payload[0];
+        for (uint8_t i = 0; i < command.stepCount; i++) {
+            const uint8_t* step = payload + 1 + i * 3;
+            command.steps[i].address = step[0];
+            command.steps[i].weight = readU16(step + 1) / 10.0f;
+        }
+        return AckResult::OK;
+    }
+
+    int16_t toDeciGrams(float weight) {
+        float deciGrams = roundf(weight * 10.0f);
+        if (deciGrams > INT16_MAX) { return INT16_MAX; }
+        if (deciGrams < INT16_MIN) { return INT16_MIN; }
+        return (int16_t)deciGrams;
+    }
+}
+
+bool isFrame(const std::string& data) {
+    return data.size() >= 2 && (uint8_t)data[0] == SYNC;
+}
+
+AckResult decode(const std::string& data, Command& command) {
+    if (data.size() < HEADER_SIZE || (uint8_t)data[0] != SYNC) {
+        return AckResult::MALFORMED;
+    }
+
+    const uint8_t* frame = (const uint8_t*)data.data();
+    command.seq = frame[3];
+    if (frame[1] != VERSION) {
+        return AckResult::BAD_VERSION;
+    }
+
+    uint8_t length = frame[4];
+    if (data.size() != HEADER_SIZE + length) {
+        return AckResult::MALFORMED;
+    }
+
+    const uint8_t* payload = frame + HEADER_SIZE;
+    command.type = (MessageType)frame[2];
+    command.stepCount = 0;
+
+    switch (command.type) {
+    case MessageType::HELLO:
+    case MessageType::CANCEL:
+        return length == 0 ? AckResult::OK : AckResult::MALFORMED;
+    case MessageType::ORDER:
+        return decodeSteps(payload, length, command);
+    case MessageType::ORDER_RECIPE:
+    case MessageType::DELETE_RECIPE:
+        if (length != 2) {
+            return AckResult::MALFORMED;
+        }
+        command.recipeId = readU16(payload);
+        return AckResult::OK;
+    case MessageType::CANCEL_ORDER:
+        if (length != 2) {
+            return AckResult::MALFORMED;
+        }
+        command.orderId = readU16(payload);
+        return AckResult::OK;
+    case MessageType::GET_STATS:
+        if (length != 1) {
+            return AckResult::MALFORMED;
+        }
+        command.scope = payload[0];
+        return AckResult::OK;
+    case MessageType::SAVE_RECIPE:
+        if (length < 3) {
+            return AckResult::MALFORMED;
+        }
+        command.recipeId = readU16(payload);
+        return decodeSteps(payload + 2, length - 2, command);
+    default:
+        return AckResult::UNKNOWN_TYPE;
+    }
+}
+
+size_t encodeAck(uint8_t* out, uint8_t seq, uint8_t ackedSeq, AckResult result) {
+    size_t length = writeHeader(out, MessageType::ACK, seq, 2);
+    out[length++] = ackedSeq;
+    out[length++] = (uint8_t)result;
+    return length;
+}
+
+size_t encodeStatus(uint8_t* out, uint8_t seq, StatusCode code) {
+    size_t length = writeHeader(out, MessageType::STATUS, seq, 1);
+    out[length++] = (uint8_t)code;
+    return length;
+}
+
+size_t encodeCup(uint8_t* out, uint8_t seq, bool present) {
+    size_t length = writeHeader(out, MessageType::CUP, seq, 1);
+    out[length++] = present ? 1 : 0;
+    return length;
+}
+
+size_t encodeStepState(uint8_t* out, uint8_t seq, uint8_t step, StepState state) {
+    size_t length = writeHeader(out, MessageType::STEP_STATE, seq, 2);
+    out[length++] = step;
+    out[length++] = (uint8_t)state;
+    return length;
+}
+
+size_t encodeWeight(uint8_t* out, uint8_t seq, uint8_t step, float weight) {
+    int16_t deciGrams = toDeciGrams(weight);
+    size_t length = writeHeader(out, MessageType::WEIGHT, seq, 3);
+    out[length++] = step;
+    out[length++] = (uint8_t)(deciGrams & 0xFF);
+    out[length++] = (uint8_t)((uint16_t)deciGrams >> 8);
+    return length;
+}
+
+size_t encodeOrderState(uint8_t* out, uint8_t seq, uint16_t orderId, OrderState state, uint8_t queuePosition) {
+    size_t length = writeHeader(out, MessageType::ORDER_STATE, seq, 4);
+    out[length++] = (uint8_t)(orderId & 0xFF);
+    out[length++] = (uint8_t)(orderId >> 8);
+    out[length++] = (uint8_t)state;
+    out[length++] = queuePosition;
+    return length;
+}
+
+size_t encodeStepTimeline(uint8_t* out, uint8_t seq, const JobStats::StepTimeline& step) {
+    size_t length = writeHeader(out, MessageType::STEP_TIMELINE, seq, 20);
+    length += writeU16(out + length, step.orderId);
+    out[length++] = step.orderIndex;
+    out[length++] = step.stationIndex;
+    out[length++] = step.deviceIndex | (step.pump ? 0x80 : 0x00);
+    out[length++] = (step.completed ? 0x01 : 0x00) | (step.fusedArrival ? 0x02 : 0x00);
+    for (uint8_t i = 0; i < JobStats::PHASE_COUNT; i++) {
+        length += writeU16(out + length, toU16(step.phaseMS[i]));
+    }
+    length += writeU16(out + length, (uint16_t)toDeciGrams(step.targetWeight));
+    length += writeU16(out + length, (uint16_t)toDeciGrams(step.actualWeight));
+    return length;
+}
+
+size_t encodePhaseStats(uint8_t* out, uint8_t seq, JobStats::Scope scope, uint8_t slot, const JobStats::Summary& summary) {
+    size_t length = writeHeader(out, MessageType::PHASE_STATS, seq, 29);
+    out[length++] = (uint8_t)scope;
+    out[length++] = slot;
+    out[length++] = summary.samples;
+    for (uint8_t i = 0; i < JobStats::PHASE_COUNT; i++) {
+        length += writeU16(out + length, toU16(summary.p50MS[i]));
+        length += writeU16(out + length, toU16(summary.p95MS[i]));
+    }
+    length += writeU16(out + length, (uint16_t)toDeciGrams(summary.overshootP5));
+    length += writeU16(out + length, (uint16_t)toDeciGrams(summary.overshootP50));
+    length += writeU16(out + length, (uint16_t)toDeciGrams(summary.overshootP95));
+    return length;
+}
+
+// Texts the ASCII clients already display.
+const char* statusText(StatusCode code) {
+    switch (code) {
+    case StatusCode::READY:
+        return "Ready!";
+    case StatusCode::SERVING:
+        return "Serving your drink!";
+    case StatusCode::WORKING:
+        return "Still Working!";
+    case StatusCode::DONE:
+        return "Get your drink!";
+    case StatusCode::NO_CUP:
+        return "No Cup! Please add a cup!";
+    case StatusCode::UNKNOWN_RECIPE:
+        return "Unknown recipe!";
+    case StatusCode::QUEUE_FULL:
+        return "Queue full!";
+    default:
+        return "";
+    }
+}
+
+}
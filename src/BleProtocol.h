@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include "JobStats.h"
+
+#pragma once
+
+// Binary framing for the control and status characteristics:
+//
+//   [SYNC 0xA5][VERSION][type][seq][length][payload ...]
+//
+// Multi-byte fields are little endian, weights travel as uint16/int16 tenths of a gram. SYNC is not a
+// printable character, so the first byte tells a frame apart from the ASCII protocol, which stays
+// available as a fallback. Every command from the client is acknowledged with its own sequence number:
+// frames that cannot run are acknowledged on receipt, the rest once the loop has run them, with the
+// outcome. A repeated sequence number is acknowledged as DUPLICATE and not executed twice.
+namespace BleProtocol
+{
+    const uint8_t SYNC = 0xA5;
+    const uint8_t VERSION = 1;
+    const size_t HEADER_SIZE = 5;
+    const size_t MAX_FRAME_SIZE = 64;
+    const uint8_t MAX_ORDER_STEPS = 16;
+
+    enum class MessageType : uint8_t {
+        // Client -> device
+        HELLO = 0x01,           // No payload. Answered with the cup state.
+        ORDER = 0x02,           // count:u8, then count x (address:u8, weight:u16)
+        CANCEL = 0x03,          // No payload.
+        ORDER_RECIPE = 0x04,    // recipe:u16
+        SAVE_RECIPE = 0x05,     // recipe:u16, count:u8, then count x (address:u8, weight:u16)
+        DELETE_RECIPE = 0x06,   // recipe:u16
+        CANCEL_ORDER = 0x07,    // order:u16
+        GET_STATS = 0x08,       // scope:u8, 0 = last job timeline, else a JobStats::Scope
+        // Device -> client
+        ACK = 0x80,             // seq:u8, result:u8
+        STATUS = 0x81,          // code:u8
+        CUP = 0x82,             // present:u8
+        STEP_STATE = 0x83,      // step:u8, state:u8
+        WEIGHT = 0x84,          // step:u8, weight:i16
+        ORDER_STATE = 0x85,     // order:u16, state:u8, queuePosition:u8
+        STEP_TIMELINE = 0x86,   // order:u16, step:u8, station:u8, device:u8, flags:u8, 5 x phase:u16 (ms),
+                                // target:i16, actual:i16. device bit 7 set for pumps, flags bit 0 completed, bit 1 fused.
+        PHASE_STATS = 0x87,     // scope:u8, slot:u8, samples:u8, 5 x (p50:u16, p95:u16) (ms),
+                                // overshoot p5:i16, p50:i16, p95:i16
+    };
+
+    enum class AckResult : uint8_t {
+        OK = 0,
+        DUPLICATE = 1,
+        BAD_VERSION = 2,
+        MALFORMED = 3,
+        UNKNOWN_TYPE = 4,
+        BUSY = 5,
+        REJECTED = 6,           // Ran but refused: an order or recipe that does not compile, an unknown order id.
+        UNKNOWN_RECIPE = 7,
+        QUEUE_FULL = 8,
+    };
+
+    enum class StatusCode : uint8_t {
+        READY = 0,
+        SERVING = 1,
+        WORKING = 2,
+        DONE = 3,
+        NO_CUP = 4,
+        UNKNOWN_RECIPE = 5,
+        QUEUE_FULL = 6,
+    };
+
+    enum class OrderState : uint8_t {
+        QUEUED = 0,
+        SERVING = 1,
+        COMPLETED = 2,
+        CANCELLED = 3,
+    };
+
+    enum class StepState : uint8_t {
+        PROCESSING = 1,
+        COMPLETE = 2,
+    };
+
+    struct OrderStep {
+        uint8_t address;        // Same addressing as the ASCII "D:" command, 7 and up are pumps.
+        float weight;
+    };
+
+    struct Command {
+        MessageType type = MessageType::HELLO;
+        uint8_t seq = 0;
+        uint16_t recipeId = 0;
+        uint16_t orderId = 0;
+        uint8_t scope = 0;
+        uint8_t stepCount = 0;
+        OrderStep steps[MAX_ORDER_STEPS];
+    };
+
+    bool isFrame(const std::string& data);
+    AckResult decode(const std::string& data, Command& command);
+
+    // Encoders write a complete frame into out (at least MAX_FRAME_SIZE bytes) and return its length.
+    size_t encodeAck(uint8_t* out, uint8_t seq, uint8_t ackedSeq, AckResult result);
+    size_t encodeStatus(uint8_t* out, uint8_t seq, StatusCode code);
+    size_t encodeCup(uint8_t* out, uint8_t seq, bool present);
+    size_t encodeStepState(uint8_t* out, uint8_t seq, uint8_t step, StepState state);
+    size_t encodeWeight(uint8_t* out, uint8_t seq, uint8_t step, float weight);
+    size_t encodeOrderState(uint8_t* out, uint8_t seq, uint16_t orderId, OrderState state, uint8_t queuePosition);
+    size_t encodeStepTimeline(uint8_t* out, uint8_t seq, const JobStats::StepTimeline& step);
+    size_t encodePhaseStats(uint8_t* out, uint8_t seq, JobStats::Scope scope, uint8_t slot, const JobStats::Summary& summary);
+
+    const char* statusText(StatusCode code);
+}
@@ -1,40 +1,23 @@
 
 #include "BluetoothEngine.h"
-
-BluetoothEngine::BluetoothEngine() {
-    Serial.println("[BluetoothEngine] Initializing");
-    BLEDevice::init(DEVICE_NAME);    
-    server = BLEDevice::createServer();
-
-    ServerCallbacks *serverCallbacks = new ServerCallbacks();
-    serverCallbacks->engine = this;
-    server->setCallbacks(serverCallbacks);
-
-    BLEService *service = server->createService(SERVICE_UUID);
-
-    // Control
-    characteristicControl = service->createCharacteristic(CONTROL_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
-    ControlCallbacks *controlCallbacks = new ControlCallbacks();
-    controlCallbacks->engine = this;
-    characteristicControl->setCallbacks(controlCallbacks);
-    characteristicControl->addDescriptor(new BLE2902());    
-
-    // Status
-    characteristicStatus = service->createCharacteristic(STATUS_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
-    StatusCallbacks *statusCallbacks = new StatusCallbacks();
-    statusCallbacks->engine = this;
-    characteristicStatus->setCallbacks(statusCallbacks);
-    characteristicStatus->addDescriptor(new BLE2902());
-
-    // Start Service
-    service->start();
-
-    // Setup Advertising
-    BLEAdvertising *advertising = BLEDevice::getAdvertising();
-    advertising->addServiceUUID(SERVICE_UUID);
-    advertising->setScanResponse(true);
-    advertising->setMinPreferred(0x06);
-    advertising->setMinPreferred(0x12);
+#include "Logger.h"
+#include <algorithm>
+
+BluetoothEngine::BluetoothEngine() : transport(hal::platform().createBleTransport()) {
+    LOG_I("[BluetoothEngine] Initializing");
+    transport->begin(DEVICE_NAME,
+        [this](bool connected) {
+            LOG_I("[BluetoothEngine] ", connected ? "Connected" : "Disconnected");
+            setConnected(connected);
+            if (connected) {
+                setAdvertising(false);
+            }
+        },
+        [this](uint32_t intervalMS) { setConnectionInterval(intervalMS); },
+        [this](const std::string& data) {
+            LOG_D("[BluetoothEngine] onWrite > ", data.c_str());
+            didReceiveData(data);
+        });
 
     startAdvertising();
 }
@@ -52,12 +35,12 @@ void BluetoothEngine::setDidDisconnectConnectCallback(DidDisConnectCallback call
 }
 
 void BluetoothEngine::startAdvertising() {
-    BLEDevice::startAdvertising();
+    transport->startAdvertising();
     isAdvertising = true;
 }
 
 void BluetoothEngine::stopAdvertising() {
-    BLEDevice::stopAdvertising();
+    transport->stopAdvertising();
     isAdvertising = false;
 }
 
@@ -66,10 +49,35 @@ void BluetoothEngine::heartbeat() {
     if (!isConnected && !isAdvertising) {
         startAdvertising();
     }
+
+    if (schedulerNeedsReset) {
+        schedulerNeedsReset = false;
+        commandAcks.clear();
+        stepEvents.clear();
+        orderEvents.clear();
+        pendingWeights.clear();
+        reports.clear();
+        statusPending = false;
+        cupPending = false;
+        hasSentStatus = false;
+        lastFrameLength = 0;
+        sentData = "";
+    }
+
+    if (isConnected == false || hal::millis() - lastTxTimeStampMS < txIntervalMS) {
+        return;
+    }
+
+    if (transmitNext()) {
+        lastTxTimeStampMS = hal::millis();
+    }
 }
 
 void BluetoothEngine::setConnected(bool connected) {
     isConnected = connected;
+    activeProtocol = Protocol::ASCII;
+    hasRxSequence = false;
+    schedulerNeedsReset = true;
 
     if (connected == true) {
         if (didConnectCallback != nullptr) {
@@ -82,91 +90,312 @@ void BluetoothEngine::setConnected(bool connected) {
     }
 }
 
+// One notification per connection interval, a faster stream only queues up in the controller.
+void BluetoothEngine::setConnectionInterval(uint32_t intervalMS) {
+    txIntervalMS = std::max(intervalMS, (uint32_t)MIN_TX_INTERVAL_MS);
+    LOG_I("[BluetoothEngine] TX interval ", txIntervalMS, "ms");
+}
+
 void BluetoothEngine::setAdvertising(bool advertising) {
     isAdvertising = advertising;
 }
 
 void BluetoothEngine::didReceiveData(std::string data) {
-    Serial.println("[BluetoothEngine] OnWrite > " + String(data.c_str()));
+    if (BleProtocol::isFrame(data)) {
+        didReceiveFrame(data);
+        return;
+    }
+
+    LOG_D("[BluetoothEngine] OnWrite > ", data.c_str());
 
     if (didReceiveCallback != nullptr) {
         didReceiveCallback(data);
     }        
 }
 
-void BluetoothEngine::notifyStateIsProcessing(uint8_t step) {
-    sendData("S" + std::to_string(step) + "=P;"); 
+// Runs on the BLE task. Commands are handed to the loop through pendingCommands, read with readCommand(),
+// and acknowledged by the loop once they ran. Only frames that never reach the loop are acknowledged here.
+void BluetoothEngine::didReceiveFrame(const std::string& data) {
+    activeProtocol = Protocol::BINARY;
+
+    BleProtocol::Command command;
+    BleProtocol::AckResult result = BleProtocol::decode(data, command);
+    if (result == BleProtocol::AckResult::OK) {
+        if (hasRxSequence && command.seq == lastRxSequence) {
+            result = BleProtocol::AckResult::DUPLICATE;
+        } else if (pendingCommands.push(command) == false) {
+            result = BleProtocol::AckResult::BUSY;
+        } else {
+            lastRxSequence = command.seq;
+            hasRxSequence = true;
+            LOG_D("[BluetoothEngine] RXD frame type ", (int)command.type, " seq ", command.seq, " queued");
+            return;
+        }
+    }
+
+    LOG_D("[BluetoothEngine] RXD frame type ", (int)command.type, " seq ", command.seq, " -> ", (int)result);
+    pendingAcks.push({command.seq, result});
 }
 
-void BluetoothEngine::notifyStateIsComplete(uint8_t step) {
-    sendData("S" + std::to_string(step) + "=C;"); 
+bool BluetoothEngine::readCommand(BleProtocol::Command& command) {
+    return pendingCommands.pop(command);
 }
 
-void BluetoothEngine::notifyWeightUpdate(uint8_t step, double weight) {
-    sendData("W" + std::to_string(step) + "=" + std::to_string(weight) + ";"); 
+// Called from the loop with the outcome of a command taken with readCommand().
+void BluetoothEngine::acknowledge(uint8_t seq, BleProtocol::AckResult result) {
+    queueAck({seq, result});
 }
 
-void BluetoothEngine::notifyStatus(std::string status) {
-    sendData("$0=" + status);
+void BluetoothEngine::acknowledgeRequest(char request, BleProtocol::AckResult result) {
+    queueAck({0, result, request});
 }
 
-void BluetoothEngine::notifyCupStatus(bool status) {
-    std::string statusStr = status ? "1" : "0";
-    sentData = "";
-    sendData("$1=" + statusStr);
+void BluetoothEngine::queueAck(const PendingAck& ack) {
+    if (isConnected == false) {
+        return;
+    }
+
+    if (commandAcks.size() >= MAX_STEP_EVENTS) {
+        commandAcks.pop_front();
+        txStats.dropped++;
+    }
+    commandAcks.push_back(ack);
 }
 
+BluetoothEngine::Protocol BluetoothEngine::getProtocol() {
+    return activeProtocol;
+}
 
-void BluetoothEngine::sendData(std::string txString) {  
-    if (isConnected == false) {           
+// The notify* calls only queue. Step events keep their order, status, cup and each step's weight
+// keep just their newest value until heartbeat() gets a transmit slot.
+void BluetoothEngine::notifyStateIsProcessing(uint8_t step) {
+    queueStepEvent(step, BleProtocol::StepState::PROCESSING);
+}
+
+void BluetoothEngine::notifyStateIsComplete(uint8_t step) {
+    queueStepEvent(step, BleProtocol::StepState::COMPLETE);
+}
+
+void BluetoothEngine::queueStepEvent(uint8_t step, BleProtocol::StepState state) {
+    if (isConnected == false) {
         return;
     }
 
-    if (txString == sentData) {     
+    if (stepEvents.size() >= MAX_STEP_EVENTS) {
+        stepEvents.pop_front();
+        txStats.dropped++;
+    }
+    stepEvents.push_back({step, state});
+}
+
+// Order events are never coalesced, a client tracking several orders needs every transition.
+void BluetoothEngine::notifyOrderState(uint16_t orderId, BleProtocol::OrderState state, uint8_t queuePosition) {
+    if (isConnected == false) {
         return;
     }
 
-    characteristicStatus->setValue(txString);
-    characteristicStatus->notify();
-    characteristicStatus->indicate();
-    
-    sentData = txString;
-    Serial.println("[BluetoothEngine] TXD: " + String(txString.c_str()));
-} 
+    if (orderEvents.size() >= MAX_STEP_EVENTS) {
+        orderEvents.pop_front();
+        txStats.dropped++;
+    }
+    orderEvents.push_back({orderId, state, queuePosition});
+}
+
+// Answers to a client's query, already encoded. They go out last so a large answer never holds up
+// the live state of a drink being served; the sequence number is filled in when a frame is sent.
+bool BluetoothEngine::queueReport(const uint8_t* frame, size_t length) {
+    if (isConnected == false || length > BleProtocol::MAX_FRAME_SIZE) {
+        return false;
+    }
+
+    if (reports.size() >= MAX_REPORTS) {
+        txStats.dropped++;
+        return false;
+    }
+
+    ReportFrame report;
+    memcpy(report.data, frame, length);
+    report.length = length;
+    reports.push_back(report);
+    return true;
+}
+
+void BluetoothEngine::notifyWeightUpdate(uint8_t step, double weight) {
+    if (isConnected == false) {
+        return;
+    }
+
+    for (auto& pending : pendingWeights) {
+        if (pending.step == step) {
+            pending.weight = weight;
+            txStats.coalesced++;
+            return;
+        }
+    }
+    pendingWeights.push_back({step, (float)weight});
+}
 
+void BluetoothEngine::notifyStatus(BleProtocol::StatusCode status) {
+    if (isConnected == false) {
+        return;
+    }
 
+    if (statusPending) {
+        if (pendingStatus != status) {
+            pendingStatus = status;
+            txStats.coalesced++;
+        }
+        return;
+    }
 
-//ServerCallbacks
-void BluetoothEngine::ServerCallbacks::onConnect(BLEServer *server) {
-    Serial.println("[ServerCallbacks] Connected");
-    engine->setConnected(true);
-    engine->setAdvertising(false);
+    if (hasSentStatus && lastSentStatus == status) {
+        return; //Callers repeat their status every loop pass.
+    }
+    pendingStatus = status;
+    statusPending = true;
 }
 
-void BluetoothEngine::ServerCallbacks::onDisconnect(BLEServer *server) {
-    Serial.println("[ServerCallbacks] Disconnected");
-    engine->setConnected(false);    
+void BluetoothEngine::notifyCupStatus(bool status) {
+    if (isConnected == false) {
+        return;
+    }
+
+    if (cupPending) {
+        txStats.coalesced++;
+    }
+    pendingCup = status;
+    cupPending = true;
 }
 
-//ControlCallbacks
-void BluetoothEngine::ControlCallbacks::onWrite(BLECharacteristic *characteristic) {
-    std::string data = characteristic->getValue();    
-    // characteristic->setValue("AK");
-    // characteristic->notify();
-    Serial.println("[ControlCallbacks] onWrite > " + String(data.c_str()));
-    engine->didReceiveData(data);
+// Priority: acks, step events, order events, cup, status, weights oldest step first, then reports.
+bool BluetoothEngine::transmitNext() {
+    uint8_t frame[BleProtocol::MAX_FRAME_SIZE];
+    bool binary = activeProtocol == Protocol::BINARY;
+
+    PendingAck ack;
+    if (pendingAcks.pop(ack)) {
+        return sendFrame(frame, BleProtocol::encodeAck(frame, txSequence, ack.seq, ack.result), false);
+    }
+
+    if (commandAcks.empty() == false) {
+        ack = commandAcks.front();
+        commandAcks.pop_front();
+        if (ack.request != 0) {
+            char text[16];
+            snprintf(text, sizeof(text), "A%c=%u;", ack.request, (unsigned)ack.result);
+            sentData = "";
+            return sendData(text);
+        }
+        return sendFrame(frame, BleProtocol::encodeAck(frame, txSequence, ack.seq, ack.result), false);
+    }
+
+    if (stepEvents.empty() == false) {
+        StepEvent event = stepEvents.front();
+        stepEvents.pop_front();
+        if (binary) {
+            return sendFrame(frame, BleProtocol::encodeStepState(frame, txSequence, event.step, event.state), false);
+        }
+        return sendData("S" + std::to_string(event.step) + (event.state == BleProtocol::StepState::PROCESSING ? "=P;" : "=C;"));
+    }
+
+    if (orderEvents.empty() == false) {
+        OrderEvent event = orderEvents.front();
+        orderEvents.pop_front();
+        if (binary) {
+            return sendFrame(frame, BleProtocol::encodeOrderState(frame, txSequence, event.orderId, event.state, event.queuePosition), false);
+        }
+        static const char stateLetters[] = {'Q', 'S', 'C', 'X'};
+        char text[24];
+        snprintf(text, sizeof(text), "Q%u=%c,%u;", (unsigned)event.orderId, stateLetters[(uint8_t)event.state], (unsigned)event.queuePosition);
+        return sendData(text);
+    }
+
+    if (cupPending) {
+        cupPending = false;
+        if (binary) {
+            return sendFrame(frame, BleProtocol::encodeCup(frame, txSequence, pendingCup), false);
+        }
+        sentData = "";
+        return sendData(pendingCup ? "$1=1" : "$1=0");
+    }
+
+    if (statusPending) {
+        statusPending = false;
+        lastSentStatus = pendingStatus;
+        hasSentStatus = true;
+        if (binary) {
+            return sendFrame(frame, BleProtocol::encodeStatus(frame, txSequence, pendingStatus));
+        }
+        return sendData("$0=" + std::string(BleProtocol::statusText(pendingStatus)));
+    }
+
+    if (pendingWeights.empty() == false) {
+        PendingWeight pending = pendingWeights.front();
+        pendingWeights.erase(pendingWeights.begin());
+        if (binary) {
+            return sendFrame(frame, BleProtocol::encodeWeight(frame, txSequence, pending.step, pending.weight));
+        }
+        char text[24];
+        snprintf(text, sizeof(text), "W%d=%.1f;", pending.step, pending.weight);
+        return sendData(text);
+    }
+
+    if (reports.empty() == false) {
+        ReportFrame report = reports.front();
+        reports.pop_front();
+        report.data[3] = txSequence;
+        return sendFrame(report.data, report.length, false);
+    }
+
+    return false;
 }
 
-void BluetoothEngine::ControlCallbacks::onRead(BLECharacteristic *characteristic) {
-    std::string data = characteristic->getValue();
-    Serial.println("[ControlCallbacks] OnRead > " + String(data.c_str()));
+BluetoothEngine::TxStats BluetoothEngine::getTxStats() {
+    TxStats stats = txStats;
+    stats.dropped += pendingAcks.getDroppedCount() + pendingCommands.getDroppedCount();
+    return stats;
 }
 
-//StatusCallbacks
-void BluetoothEngine::StatusCallbacks::onWrite(BLECharacteristic *characteristic) {
-    Serial.println("[StatusCallbacks] onWrite");
+// Same repeat suppression as sendData(), the sequence byte is left out of the comparison.
+bool BluetoothEngine::sendFrame(uint8_t* frame, size_t length, bool skipRepeat) {
+    if (isConnected == false) {
+        return false;
+    }
+
+    if (skipRepeat && length == lastFrameLength && frame[2] == lastFrame[2] && memcmp(frame + 4, lastFrame + 4, length - 4) == 0) {
+        return false;
+    }
+
+    transport->notify(hal::BleTransport::Channel::STATUS, frame, length);
+
+    if (frame[2] != (uint8_t)BleProtocol::MessageType::ACK) {
+        memcpy(lastFrame, frame, length);
+        lastFrameLength = length;
+    }
+    txSequence++;
+    txStats.sent++;
+    return true;
 }
 
-void BluetoothEngine::StatusCallbacks::onRead(BLECharacteristic *characteristic) {
-    Serial.println("[StatusCallbacks] onRead");
+// Not a notification, the client reads the latest snapshot when it wants one.
+void BluetoothEngine::setDiagnostics(const uint8_t* data, size_t length) {
+    transport->setValue(hal::BleTransport::Channel::DIAGNOSTICS, data, length);
 }
+
+bool BluetoothEngine::sendData(std::string txString) {  
+    if (isConnected == false) {           
+        return false;
+    }
+
+    if (txString == sentData) {     
+        return false;
+    }
+
+    transport->notify(hal::BleTransport::Channel::STATUS, (const uint8_t*)txString.data(), txString.size());
+    
+    sentData = txString;
+    txStats.sent++;
+    LOG_D("[BluetoothEngine] TXD: ", txString.c_str());
+    return true;
+} 
+
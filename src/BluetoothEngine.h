@@ -1,20 +1,29 @@
 #pragma once
 
 #include "Arduino.h"
-#include <BLEDevice.h>
-#include <BLEUtils.h>
-#include <BLEServer.h>
-#include <BLE2902.h>
-
-#define SERVICE_UUID "94635d24-cf8d-4ff8-9191-de713f39db89" 
-#define CONTROL_UUID "4ac8a682-9736-4e5d-932b-e9b31405049c" 
-#define STATUS_UUID "6bcdd021-ffa5-4522-9454-a21d025d6562"
+#include "BleProtocol.h"
+#include "SampleRing.h"
+#include "hal/Hal.h"
+#include <deque>
+#include <memory>
+#include <vector>
 
 #define DEVICE_NAME "MixTender"
 
-class BluetoothEngine : public BLEServerCallbacks {
+class BluetoothEngine {
 public:
 
+    enum class Protocol {
+        ASCII,
+        BINARY,         // Chosen per connection by the client's first frame, see BleProtocol.h.
+    };
+
+    struct TxStats {
+        uint32_t sent = 0;
+        uint32_t coalesced = 0;     // Queued values replaced by a newer one before they went out.
+        uint32_t dropped = 0;       // Overflowed step events, acks and commands.
+    };
+
     using DidReceiveCallback = std::function<void(const std::string&)>;
     using DidConnectCallback = std::function<void()>;
     using DidDisConnectCallback = std::function<void()>;
@@ -27,12 +36,21 @@ public:
     void startAdvertising();
     void stopAdvertising();
     
-    void sendData(std::string status);
-    void notifyStatus(std::string status);
+    bool sendData(std::string status);
+    void notifyStatus(BleProtocol::StatusCode status);
     void notifyCupStatus(bool status);
     void notifyStateIsProcessing(uint8_t step);
     void notifyStateIsComplete(uint8_t step);
     void notifyWeightUpdate(uint8_t step, double weight);
+    void notifyOrderState(uint16_t orderId, BleProtocol::OrderState state, uint8_t queuePosition);
+    bool queueReport(const uint8_t* frame, size_t length);
+    bool readCommand(BleProtocol::Command& command);
+    void acknowledge(uint8_t seq, BleProtocol::AckResult result);
+    void acknowledgeRequest(char request, BleProtocol::AckResult result);   // ASCII "A<request>=<result>;".
+    Protocol getProtocol();
+    void setConnectionInterval(uint32_t intervalMS);
+    TxStats getTxStats();
+    void setDiagnostics(const uint8_t* data, size_t length);
 
     void heartbeat();
 
@@ -41,38 +59,74 @@ private:
     DidConnectCallback didConnectCallback;
     DidDisConnectCallback didDisConnectCallback;
 
-    BLECharacteristic *characteristicControl;
-    BLECharacteristic *characteristicStatus;
-    
-    BLEServer *server;
+    std::unique_ptr<hal::BleTransport> transport;
     bool isConnected = false;
     bool isAdvertising = false;
     std::string sentData = "";
 
-    void setConnected(bool connected);
-    void setAdvertising(bool advertising);
-    void didReceiveData(std::string data);        
+    struct PendingAck {
+        uint8_t seq;
+        BleProtocol::AckResult result;
+        char request = 0;   // Set for an ASCII request, its letter is echoed instead of a sequence number.
+    };
+
+    Protocol activeProtocol = Protocol::ASCII;
+    uint8_t txSequence = 0;
+    uint8_t lastRxSequence = 0;
+    bool hasRxSequence = false;
+    uint8_t lastFrame[BleProtocol::MAX_FRAME_SIZE];
+    size_t lastFrameLength = 0;
+    SampleRing<BleProtocol::Command, 8> pendingCommands;
+    SampleRing<PendingAck, 8> pendingAcks;
+
+    struct StepEvent {
+        uint8_t step;
+        BleProtocol::StepState state;
+    };
 
-    class ServerCallbacks : public BLEServerCallbacks {
-    public:
-        BluetoothEngine *engine;
-        void onConnect(BLEServer *server) override;
-        void onDisconnect(BLEServer *server) override;
+    struct OrderEvent {
+        uint16_t orderId;
+        BleProtocol::OrderState state;
+        uint8_t queuePosition;
     };
 
-    class StatusCallbacks : public BLECharacteristicCallbacks {
-    public:
-        BluetoothEngine *engine;
-        void onWrite(BLECharacteristic *characteristic) override;
-        void onRead(BLECharacteristic *characteristic) override;
+    struct PendingWeight {
+        uint8_t step;
+        float weight;
     };
 
-    class ControlCallbacks : public BLECharacteristicCallbacks {
-    public:
-        BluetoothEngine *engine;
-        void onWrite(BLECharacteristic *characteristic) override;
-        void onRead(BLECharacteristic *characteristic) override;
+    struct ReportFrame {
+        uint8_t data[BleProtocol::MAX_FRAME_SIZE];
+        uint8_t length;
     };
+
+    static const uint8_t MAX_STEP_EVENTS = 16;
+    static const uint8_t MAX_REPORTS = 32;
+    static const uint32_t MIN_TX_INTERVAL_MS = 15;
+    std::deque<PendingAck> commandAcks;     // Outcomes from the loop, pendingAcks is fed by the BLE task.
+    std::deque<StepEvent> stepEvents;
+    std::deque<OrderEvent> orderEvents;
+    std::vector<PendingWeight> pendingWeights;
+    std::deque<ReportFrame> reports;
+    BleProtocol::StatusCode pendingStatus = BleProtocol::StatusCode::READY;
+    BleProtocol::StatusCode lastSentStatus = BleProtocol::StatusCode::READY;
+    bool statusPending = false;
+    bool hasSentStatus = false;
+    bool pendingCup = false;
+    bool cupPending = false;
+    volatile bool schedulerNeedsReset = false;
+    uint32_t txIntervalMS = 30;
+    uint32_t lastTxTimeStampMS = 0;
+    TxStats txStats;
+
+    void setConnected(bool connected);
+    void setAdvertising(bool advertising);
+    void didReceiveData(std::string data);        
+    void didReceiveFrame(const std::string& data);
+    bool sendFrame(uint8_t* frame, size_t length, bool skipRepeat = true);
+    void queueStepEvent(uint8_t step, BleProtocol::StepState state);
+    void queueAck(const PendingAck& ack);
+    bool transmitNext();
 };
 
 
@@ -0,0 +1,90 @@
+#include "BootSequence.h"
+#include "Logger.h"
+
+uint8_t BootSequence::addStage(const char* name) {
+    if (stageCount_ >= MAX_STAGES) {
+        LOG_W("[BootSequence][addStage] Too many stages, dropping ", name);
+        return MAX_STAGES - 1;
+    }
+
+    stages_[stageCount_].name = name;
+    stages_[stageCount_].owner = this;
+    stages_[stageCount_].index = stageCount_;
+    return stageCount_++;
+}
+
+void BootSequence::run(uint8_t stage, StageFunction function) {
+    begin(stage);
+    function();
+    end(stage);
+}
+
+// The stage's results must only be touched after isDone() reports it, that is the hand-off point.
+void BootSequence::runAsync(uint8_t stage, StageFunction function, uint8_t core, uint32_t stackSize) {
+    stages_[stage].function = function;
+    begin(stage);
+    xTaskCreatePinnedToCore(stageTask_, stages_[stage].name, stackSize, &stages_[stage], 1, nullptr, core);
+}
+
+void BootSequence::stageTask_(void* arg) {
+    Stage* stage = static_cast<Stage*>(arg);
+    stage->function();
+    stage->owner->end(stage->index);
+    vTaskDelete(nullptr);
+}
+
+void BootSequence::begin(uint8_t stage) {
+    stages_[stage].startUS = micros();
+    stages_[stage].started = true;
+}
+
+void BootSequence::end(uint8_t stage) {
+    stages_[stage].endUS = micros();
+    stages_[stage].done.store(true);
+}
+
+bool BootSequence::isDone(uint8_t stage) {
+    return stages_[stage].done.load();
+}
+
+bool BootSequence::isComplete() {
+    if (readyUS_ != 0) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < stageCount_; i++) {
+        if (stages_[i].done.load() == false) {
+            return false;
+        }
+    }
+    readyUS_ = micros();
+    return true;
+}
+
+uint32_t BootSequence::getReadyTimeMS() {
+    return readyUS_ / 1000;
+}
+
+// Times are from reset. The critical path is the stage that finished last, the one worth shortening next.
+void BootSequence::report() {
+    uint8_t critical = 0;
+    for (uint8_t i = 0; i < stageCount_; i++) {
+        const Stage& stage = stages_[i];
+        if (stage.started == false) {
+            LOG_I("[BootSequence][report] ", stage.name, ": not started");
+            continue;
+        }
+        if (stage.done.load() == false) {
+            LOG_I("[BootSequence][report] ", stage.name, ": started at ", stage.startUS / 1000, "ms, still running");
+            continue;
+        }
+        if (stage.endUS > stages_[critical].endUS) {
+            critical = i;
+        }
+        LOG_I("[BootSequence][report] ", stage.name, ": ", stage.startUS / 1000, "ms -> ", stage.endUS / 1000, "ms (", (stage.endUS - stage.startUS) / 1000, "ms)");
+    }
+
+    if (readyUS_ != 0) {
+        LOG_I("[BootSequence][report] Ready at ", readyUS_ / 1000, "ms, critical path: ", stages_[critical].name);
+    }
+}
@@ -0,0 +1,43 @@
+#include "Arduino.h"
+#include <atomic>
+#include <functional>
+
+#pragma once
+
+// Named boot stages with their start and end times. A stage runs inline, in its own FreeRTOS task,
+// or is opened and closed by hand around something asynchronous like homing. Once every stage is
+// done the machine is ready and report() prints the boot-to-ready breakdown.
+class BootSequence
+{
+public:
+    using StageFunction = std::function<void()>;
+    static const uint8_t MAX_STAGES = 8;
+
+    uint8_t addStage(const char* name);
+    void run(uint8_t stage, StageFunction function);
+    void runAsync(uint8_t stage, StageFunction function, uint8_t core, uint32_t stackSize = 4096);
+    void begin(uint8_t stage);
+    void end(uint8_t stage);
+    bool isDone(uint8_t stage);
+    bool isComplete();
+    uint32_t getReadyTimeMS();
+    void report();
+
+private:
+    struct Stage {
+        const char* name = "";
+        uint32_t startUS = 0;
+        uint32_t endUS = 0;
+        bool started = false;
+        std::atomic<bool> done{false};
+        StageFunction function;
+        BootSequence* owner = nullptr;
+        uint8_t index = 0;
+    };
+
+    static void stageTask_(void* arg);
+
+    Stage stages_[MAX_STAGES];
+    uint8_t stageCount_ = 0;
+    uint32_t readyUS_ = 0;
+};
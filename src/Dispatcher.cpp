@@ -1,4 +1,6 @@
 #include "Dispatcher.h"
+#include "Logger.h"
+#include <algorithm>
 
 
 void Dispatcher::heartbeat() {
@@ -6,13 +8,18 @@ void Dispatcher::heartbeat() {
     switch (state_)
     {
     case DispatcherState::NO_CUP:
-        if (dispenser_->getAbsoluteWeight() > 10.0) {
+        dispenser_->saveCalibrationIfChanged();
+        if (acceptCup_()) {
             state_ = DispatcherState::READY;        
         }
         break;
     case DispatcherState::READY:
+       dispenser_->saveCalibrationIfChanged();
        if (dispenser_->getAbsoluteWeight() <= 3.0) {
             state_ = DispatcherState::NO_CUP;
+            awaitCupRemoval_ = false;
+        } else if (orderQueue_.empty() == false && awaitCupRemoval_ == false && transport_->isParked()) {
+            startNextOrder_();
         }
         break;
     case DispatcherState::MOVING:
@@ -41,57 +48,177 @@ void Dispatcher::heartbeat() {
 
 void Dispatcher::movingPhase_() {
     if (transport_->getState() == Transport::MachineState::AT_TARGET) {
-        Serial.println("[Dispatcher][movingPhase_] Transport at target.");
-        state_ = DispatcherState::SERVING;
-        steps_[currentStep_].beginDispensingTimeStampMS = millis();
+        LOG_I("[Dispatcher][movingPhase_] Transport at target.");
+        steps_[currentStep_].arrivalTimeStampMS = hal::millis();
+        beginDispensingStep_(Dispenser::StartMode::AWAIT_SETTLE);
+        return;
+    }    
 
-        if (steps_[currentStep_].type == Dispenser::DispenseType::PUMP) {
-            dispenser_->beginDispensingPump(steps_[currentStep_].pourDeviceIndex, steps_[currentStep_].targetWeight);
-        } else {
-            dispenser_->beginDispensingValve(steps_[currentStep_].pourDeviceIndex, steps_[currentStep_].targetWeight);
+    if (predictiveStart_ == true && predictiveBaseline_ == true) {
+        // Open the device early by its learned latency (less a small margin) so liquid lands as the tray stops.
+        const uint32_t marginMS = 50;
+        int32_t eta = transport_->getPredictedArrivalMS();
+        uint32_t latency = dispenser_->getActuationLatencyMS(steps_[currentStep_].type, steps_[currentStep_].pourDeviceIndex);
+        if (eta >= 0 && latency > marginMS && (uint32_t)eta <= latency - marginMS) {
+            LOG_I("[Dispatcher][movingPhase_] Arrival in ", eta, "ms, starting early (latency ", latency, "ms).");
+            beginDispensingStep_(Dispenser::StartMode::PREDICTIVE);
         }
-    }    
+    }
+}
+
+void Dispatcher::beginDispensingStep_(Dispenser::StartMode mode) {
+    state_ = DispatcherState::SERVING;
+    steps_[currentStep_].beginDispensingTimeStampMS = hal::millis();
+    groupSize_ = 1;
+
+    if (concurrentPumps_ == true && steps_[currentStep_].type == Dispenser::DispenseType::PUMP) {
+        std::vector<Dispenser::PumpChannel> channels;
+        for (size_t i = currentStep_; i < steps_.size(); i++) {
+            const Steps& step = steps_[i];
+            bool pumpInUse = false;
+            for (const auto& channel : channels) {
+                pumpInUse |= (channel.pumpIndex == step.pourDeviceIndex);
+            }
+            if (step.type != Dispenser::DispenseType::PUMP || step.stationIndex != steps_[currentStep_].stationIndex || pumpInUse) {
+                break;
+            }
+            Dispenser::PumpChannel channel;
+            channel.pumpIndex = step.pourDeviceIndex;
+            channel.targetWeight = step.targetWeight;
+            channels.push_back(channel);
+        }
+
+        if (channels.size() > 1) {
+            groupSize_ = channels.size();
+            for (uint8_t i = 1; i < groupSize_; i++) {
+                steps_[currentStep_ + i].beginMovementTimeStampMS = steps_[currentStep_].beginMovementTimeStampMS;
+                steps_[currentStep_ + i].arrivalTimeStampMS = steps_[currentStep_].arrivalTimeStampMS;
+                steps_[currentStep_ + i].beginDispensingTimeStampMS = steps_[currentStep_].beginDispensingTimeStampMS;
+                if (willBeginDispensingCallback_) {
+                    willBeginDispensingCallback_(steps_[currentStep_ + i].orderIndex);
+                }
+            }
+            LOG_I("[Dispatcher][beginDispensingStep_] Running ", groupSize_, " pumps concurrently.");
+            dispenser_->beginDispensingPumps(channels, mode);
+            return;
+        }
+    }
+
+    if (steps_[currentStep_].type == Dispenser::DispenseType::PUMP) {
+        dispenser_->beginDispensingPump(steps_[currentStep_].pourDeviceIndex, steps_[currentStep_].targetWeight, mode);
+    } else {
+        dispenser_->beginDispensingValve(steps_[currentStep_].pourDeviceIndex, steps_[currentStep_].targetWeight, mode);
+    }
 }
 
 void Dispatcher::servingPhase_() {
+    if (steps_[currentStep_].arrivalTimeStampMS == 0 && transport_->getState() == Transport::MachineState::AT_TARGET) {
+        for (uint8_t i = 0; i < groupSize_; i++) {
+            steps_[currentStep_ + i].arrivalTimeStampMS = hal::millis(); //Predictive start, the pour began before arrival.
+        }
+    }
+
+    if (earlyDeparture_ == true && dispenser_->canDepartEarly() && nextStepNeedsMove_()) {
+        LOG_I("[Dispatcher][servingPhase_] Drip below threshold, departing early.");
+        dispenser_->departEarly();
+        recordPourTiming_();
+        for (uint8_t i = 0; i < groupSize_; i++) {
+            steps_[currentStep_ + i].endDispensingTimeStampMS = hal::millis();
+        }
+        dripStep_ = currentStep_;
+        dripGroupSize_ = groupSize_;
+        completeSteps_();
+        return;
+    }
+
     if (dispenser_->getState() == Dispenser::DispenserState::FINISHED) {
-        Serial.println("[Dispatcher][servingPhase_] Dispensing Complete.");
+        LOG_I("[Dispatcher][servingPhase_] Dispensing Complete.");
         state_ = DispatcherState::AWAITING_END_DELAY;
-        steps_[currentStep_].endDispensingTimeStampMS = millis();
+        recordPourTiming_();
+        for (uint8_t i = 0; i < groupSize_; i++) {
+            steps_[currentStep_ + i].endDispensingTimeStampMS = hal::millis();
+        }
     }
 
     if (didUpdateWeightCallback_) {
-            didUpdateWeightCallback_(currentStep_, dispenser_->getLatestWeight());
+        if (groupSize_ > 1) {
+            for (uint8_t i = 0; i < groupSize_; i++) {
+                didUpdateWeightCallback_(steps_[currentStep_ + i].orderIndex, dispenser_->getPumpDispensedWeight(i));
+            }
+        } else {
+            didUpdateWeightCallback_(steps_[currentStep_].orderIndex, dispenser_->getLatestWeight());
+        }
     }
     
 }
 
 void Dispatcher::awaitingEndDelayPhase_() {
-    if (millis() - steps_[currentStep_].endDispensingTimeStampMS > 200) {
-        Serial.println("[Dispatcher][awaitingDelayPhase_] Delay complete.");
-        state_ = DispatcherState::STEP_COMPLETE;
-        steps_[currentStep_].stepCompleted = true;
-         if (didFinishDispensingCallback_) {
-            didFinishDispensingCallback_(currentStep_);
+    uint32_t waited = hal::millis() - steps_[currentStep_].endDispensingTimeStampMS;
+    if (dispenser_->isSettled() || waited > 200) {
+        LOG_I("[Dispatcher][awaitingDelayPhase_] Delay complete after ", waited, "ms.");
+        completeSteps_();
+    }
+}
+
+void Dispatcher::completeSteps_() {
+    state_ = DispatcherState::STEP_COMPLETE;
+    for (uint8_t i = 0; i < groupSize_; i++) {
+        steps_[currentStep_ + i].stepCompleted = true;
+        steps_[currentStep_ + i].completeTimeStampMS = hal::millis();
+        steps_[currentStep_ + i].dispensedWeight = (groupSize_ > 1) ? dispenser_->getPumpDispensedWeight(i) : dispenser_->getLastPourWeight();
+        if (didFinishDispensingCallback_) {
+            didFinishDispensingCallback_(steps_[currentStep_ + i].orderIndex);
+        }
+    }
+    currentStep_ += groupSize_;
+    groupSize_ = 1;
+    if (currentStep_ >= steps_.size()) {
+        LOG_I("[Dispatcher][completeSteps_] All steps complete.");            
+        state_ = DispatcherState::AWAITING_REMOVAL;            
+        transport_->goPark(0, liquidMass_()); 
+        if (didFinishJobCallback_) {
+            didFinishJobCallback_();
+        }           
+        if (currentOrderId_ != 0) {
+            setOrderStatus_(currentOrderId_, OrderStatus::COMPLETED);
+            currentOrderId_ = 0;
         }
-        currentStep_++;
-        if (currentStep_ >= steps_.size()) {
-            Serial.println("[Dispatcher][awaitingDelayPhase_] All steps complete.");            
-            state_ = DispatcherState::AWAITING_REMOVAL;            
-            transport_->goPark(); 
-            if (didFinishJobCallback_) {
-                didFinishJobCallback_();
-            }           
-        }  else {
-           performNextStep_();
+    }  else {
+       performNextStep_();
+    }
+}
+
+// Early departure only pays off when the tray has somewhere to go; fused steps and the last step
+// finish their closure window in place so nothing is left uncredited.
+bool Dispatcher::nextStepNeedsMove_() {
+    size_t next = currentStep_ + groupSize_;
+    if (next >= steps_.size()) {
+        return false;
+    }
+    return steps_[next].stationIndex != steps_[currentStep_].stationIndex;
+}
+
+void Dispatcher::creditDrip_(const std::vector<float>& finalWeights) {
+    if (dripStep_ < 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < finalWeights.size() && i < dripGroupSize_; i++) {
+        Steps& step = steps_[dripStep_ + i];
+        LOG_I("[Dispatcher][creditDrip_] Step ", step.orderIndex, " final weight: ", finalWeights[i], "g (+", finalWeights[i] - step.dispensedWeight, "g drip)");
+        step.dispensedWeight = finalWeights[i];
+        if (didUpdateWeightCallback_) {
+            didUpdateWeightCallback_(step.orderIndex, step.dispensedWeight);
         }
     }
+    dripStep_ = -1;
+    dripGroupSize_ = 0;
 }
 
 void Dispatcher::awaitingRemovalPhase_() {
     if (transport_->isParked()) {
         if (dispenser_->getAbsoluteWeight() < 2.0) {
-            Serial.println("[Dispatcher][awaitingRemovalPhase_] Cup Removed. Job complete.");            
+            LOG_I("[Dispatcher][awaitingRemovalPhase_] Cup Removed. Job complete.");            
             state_ = DispatcherState::JOB_COMPLETE;
             if (isReadyCallback_) {
                 isReadyCallback_();
@@ -101,38 +228,299 @@ void Dispatcher::awaitingRemovalPhase_() {
     }
 }
 
+// A hand on the tray, a cup being set down or the ringing of one just lifted all cross the 10g
+// threshold for a moment. Only a reading that stays over it and settles is a cup to serve.
+bool Dispatcher::acceptCup_() {
+    float weight = dispenser_->getAbsoluteWeight();
+    if (weight <= 3.0) {
+        awaitCupRemoval_ = false;
+    }
+    if (weight <= 10.0) {
+        cupCandidate_ = false;
+        return false;
+    }
+
+    if (cupCandidate_ == false) {
+        cupCandidate_ = true;
+        cupSinceMS_ = hal::millis();
+    }
+    if (hal::millis() - cupSinceMS_ < CUP_HOLD_MS || dispenser_->isSettled() == false) {
+        return false;
+    }
+
+    LOG_I("[Dispatcher][acceptCup_] Cup of ", weight, "g accepted.");
+    cupCandidate_ = false;
+    return true;
+}
+
 void Dispatcher::jobCompletePhase_() {    
     if (transport_->isParked()) {        
-        Serial.println("[Dispatcher][jobCompletePhase_] Job is complete. Clearing Recepie.");
+        LOG_I("[Dispatcher][jobCompletePhase_] Job is complete. Clearing Recepie.");
         reset_();
     }
 }
 
 
 void Dispatcher::cancel() {
-    Serial.println("[Dispatcher][cancel] Cancelling job.");
+    LOG_I("[Dispatcher][cancel] Cancelling job.");
     dispenser_->abortDispensing();
-    transport_->goPark();
+    transport_->goPark(0, liquidMass_());
     state_ = DispatcherState::JOB_COMPLETE;    
+    awaitCupRemoval_ = true;
+    if (currentOrderId_ != 0) {
+        setOrderStatus_(currentOrderId_, OrderStatus::CANCELLED);
+        currentOrderId_ = 0;
+    }
+}
+
+// Orders wait here until the machine is READY with a cup on the scale. The first order on an idle
+// machine therefore starts on the next heartbeat, the rest each time a served cup is swapped for a new one.
+uint16_t Dispatcher::enqueue(const CompiledJob& job) {
+    if (orderQueue_.size() >= MAX_QUEUED_ORDERS) {
+        LOG_W("[Dispatcher][enqueue] Queue full, order rejected.");
+        return 0;
+    }
+
+    if (orderQueue_.empty() && state_ == DispatcherState::READY) {
+        awaitCupRemoval_ = false; //Explicitly ordered into the cup that is already there.
+    }
+
+    Order order;
+    order.id = nextOrderId_;
+    order.job = job;
+    order.queuedTimeStampMS = hal::millis();
+    nextOrderId_ = (nextOrderId_ == UINT16_MAX) ? 1 : nextOrderId_ + 1;
+    orderQueue_.push_back(order);
+
+    LOG_I("[Dispatcher][enqueue] Order ", order.id, " queued at position ", orderQueue_.size());
+    setOrderStatus_(order.id, OrderStatus::QUEUED, orderQueue_.size());
+    return order.id;
+}
+
+bool Dispatcher::cancelOrder(uint16_t orderId) {
+    if (orderId != 0 && orderId == currentOrderId_) {
+        cancel();
+        return true;
+    }
+
+    for (auto it = orderQueue_.begin(); it != orderQueue_.end(); ++it) {
+        if (it->id == orderId) {
+            orderQueue_.erase(it);
+            LOG_I("[Dispatcher][cancelOrder] Order ", orderId, " removed from queue.");
+            setOrderStatus_(orderId, OrderStatus::CANCELLED);
+            announceQueue_();
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t Dispatcher::getQueueLength() {
+    return orderQueue_.size();
+}
+
+uint16_t Dispatcher::getCurrentOrderId() {
+    return currentOrderId_;
+}
+
+void Dispatcher::startNextOrder_() {
+    Order& order = orderQueue_.front();
+    if (start(order.job) == false) {
+        return;
+    }
+
+    currentOrderId_ = order.id;
+    jobOrderId_ = order.id;
+    LOG_I("[Dispatcher][startNextOrder_] Order ", order.id, " started after ", hal::millis() - order.queuedTimeStampMS, "ms in queue.");
+    orderQueue_.pop_front();
+    setOrderStatus_(currentOrderId_, OrderStatus::SERVING);
+    announceQueue_();
+}
+
+void Dispatcher::announceQueue_() {
+    for (size_t i = 0; i < orderQueue_.size(); i++) {
+        setOrderStatus_(orderQueue_[i].id, OrderStatus::QUEUED, i + 1);
+    }
+}
+
+void Dispatcher::setOrderStatus_(uint16_t orderId, OrderStatus status, uint8_t queuePosition) {
+    if (orderStatusCallback_) {
+        orderStatusCallback_(orderId, status, queuePosition);
+    }
+}
+
+void Dispatcher::recordPourTiming_() {
+    Dispenser::PourTiming timing = dispenser_->getLastPourTiming();
+    for (uint8_t i = 0; i < groupSize_; i++) {
+        steps_[currentStep_ + i].pourBeginTimeStampMS = timing.beginTimeStampMS;
+        steps_[currentStep_ + i].closeTimeStampMS = timing.closeTimeStampMS;
+    }
+}
+
+// Each phase runs from its own timestamp to the next one that was reached. Phases that overlapped
+// the previous one (pour opened before arrival) or never happened (cancelled) come out as zero.
+void Dispatcher::recordTimeline_() {
+    auto span = [](uint32_t fromMS, uint32_t toMS) -> uint32_t {
+        return (fromMS == 0 || toMS == 0 || (int32_t)(toMS - fromMS) < 0) ? 0 : toMS - fromMS;
+    };
+
+    std::vector<JobStats::StepTimeline> timeline;
+    for (const auto& step : steps_) {
+        if (step.beginMovementTimeStampMS == 0) {
+            continue; //Never reached.
+        }
+
+        JobStats::StepTimeline entry;
+        entry.orderId = jobOrderId_;
+        entry.orderIndex = step.orderIndex;
+        entry.stationIndex = step.stationIndex;
+        entry.pump = step.type == Dispenser::DispenseType::PUMP;
+        entry.deviceIndex = step.pourDeviceIndex;
+        entry.phaseMS[(uint8_t)JobStats::Phase::MOVE] = span(step.beginMovementTimeStampMS, step.arrivalTimeStampMS);
+        entry.phaseMS[(uint8_t)JobStats::Phase::SETTLE] = span(step.arrivalTimeStampMS, step.pourBeginTimeStampMS);
+        entry.phaseMS[(uint8_t)JobStats::Phase::POUR] = span(std::max(step.arrivalTimeStampMS, step.pourBeginTimeStampMS), step.closeTimeStampMS);
+        entry.phaseMS[(uint8_t)JobStats::Phase::CLOSE] = span(step.closeTimeStampMS, step.endDispensingTimeStampMS);
+        entry.phaseMS[(uint8_t)JobStats::Phase::DRIP] = span(step.endDispensingTimeStampMS, step.completeTimeStampMS);
+        entry.targetWeight = step.targetWeight;
+        entry.actualWeight = step.dispensedWeight;
+        entry.completed = step.stepCompleted;
+        entry.fusedArrival = step.fusedArrival;
+        timeline.push_back(entry);
+    }
+    jobStats_.record(timeline);
+}
+
+JobStats& Dispatcher::getJobStats() {
+    return jobStats_;
 }
 
 void Dispatcher::reset_() {
-        Serial.println("[Dispatcher][reset_] Job complete: " + String(steps_.size()) + " steps executed in " + String(millis() - jobBeginTimeStampMS_) + "ms.");
+        LOG_I("[Dispatcher][reset_] Job complete: ", steps_.size(), " steps executed in ", hal::millis() - jobBeginTimeStampMS_, "ms.");
+        recordTimeline_();
+        jobOrderId_ = 0;
         steps_.clear();
         state_ = DispatcherState::NO_CUP;
         currentStep_ = 0;
+        groupSize_ = 1;
+        dripStep_ = -1;
+        dripGroupSize_ = 0;
         cumulativeWeight_ = 0.0;
         jobBeginTimeStampMS_ = 0;
 }
 
 void Dispatcher::performNextStep_() {
-        Serial.println("[Dispatcher][performNextStep_] Performing next step: " + String(currentStep_) + " of " + String(steps_.size()-1));
-        transport_->goToStation(steps_[currentStep_].stationIndex);
-        steps_[currentStep_].beginMovementTimeStampMS = millis();        
-        state_ = DispatcherState::MOVING;
+        LOG_I("[Dispatcher][performNextStep_] Performing next step: ", currentStep_, " of ", steps_.size()-1);
+        steps_[currentStep_].beginMovementTimeStampMS = hal::millis();        
         if (willBeginDispensingCallback_) {
-            willBeginDispensingCallback_(currentStep_);
+            willBeginDispensingCallback_(steps_[currentStep_].orderIndex);
         }
+
+        if (transport_->isAtTarget() && transport_->getCurrentStationIndex() == steps_[currentStep_].stationIndex) {
+            LOG_I("[Dispatcher][performNextStep_] Already at station ", steps_[currentStep_].stationIndex, ", dispensing without move.");
+            steps_[currentStep_].arrivalTimeStampMS = steps_[currentStep_].beginMovementTimeStampMS;
+            beginDispensingStep_(Dispenser::StartMode::IMMEDIATE);
+            return;
+        }
+
+        predictiveBaseline_ = predictiveStart_ && dispenser_->captureBaseline();
+        transport_->goToStation(steps_[currentStep_].stationIndex, 0, liquidMass_());
+        state_ = DispatcherState::MOVING;
+}
+
+// Steps are executed station by station in a single sweep of the rail instead of recipe order.
+// On a linear rail that starts and ends at park the shortest tour visits every station on one side
+// of park before crossing to the other, so only the two sweep directions need to be compared.
+// Steps sharing a station keep their recipe order and are fused into one arrival.
+Dispatcher::Plan Dispatcher::planSteps_(std::vector<Steps>& steps) {
+    Plan plan;
+    plan.unplannedTravelSteps = estimateTravel_(steps);
+
+    if (travelPlanning_ == true && steps.size() > 1) {
+        int32_t parkAddress = transport_->getStationAddress(0);
+        std::vector<Steps> left;
+        std::vector<Steps> right;
+        for (const auto& step : steps) {
+            if (transport_->getStationAddress(step.stationIndex) < parkAddress) {
+                left.push_back(step);
+            } else {
+                right.push_back(step);
+            }
+        }
+
+        auto byAddress = [this](const Steps& a, const Steps& b) {
+            return transport_->getStationAddress(a.stationIndex) < transport_->getStationAddress(b.stationIndex);
+        };
+        std::stable_sort(right.begin(), right.end(), byAddress);
+        std::stable_sort(left.begin(), left.end(), [&byAddress](const Steps& a, const Steps& b) { return byAddress(b, a); });
+
+        std::vector<Steps> leftFirst(left);
+        leftFirst.insert(leftFirst.end(), right.begin(), right.end());
+        std::vector<Steps> rightFirst(right);
+        rightFirst.insert(rightFirst.end(), left.begin(), left.end());
+
+        if (estimateTravel_(rightFirst) < estimateTravel_(leftFirst)) {
+            steps = rightFirst;
+        } else {
+            steps = leftFirst;
+        }
+    }
+
+    for (size_t i = 0; i < steps.size(); i++) {
+        steps[i].fusedArrival = (i > 0 && steps[i].stationIndex == steps[i-1].stationIndex);
+        if (steps[i].fusedArrival == true) {
+            plan.fusedSteps++;
+        } else {
+            plan.arrivals++;
+        }
+        plan.order.push_back(steps[i].orderIndex);
+    }
+    plan.estimatedTravelSteps = estimateTravel_(steps);
+    return plan;
+}
+
+uint32_t Dispatcher::estimateTravel_(const std::vector<Steps>& steps) {
+    uint32_t distance = 0;
+    uint8_t station = 0;
+    for (const auto& step : steps) {
+        distance += transport_->getTravelDistance(station, step.stationIndex);
+        station = step.stationIndex;
+    }
+    distance += transport_->getTravelDistance(station, 0); //Park at the end of the job.
+    return distance;
+}
+
+// What has been poured so far, the empty cup weighed at start() does not slosh.
+float Dispatcher::liquidMass_() {
+    return std::max(dispenser_->getAbsoluteWeight() - cupWeight_, 0.0f);
+}
+
+void Dispatcher::setTravelPlanning(bool enabled) {
+    travelPlanning_ = enabled;
+}
+
+void Dispatcher::setConcurrentPumps(bool enabled) {
+    concurrentPumps_ = enabled;
+}
+
+void Dispatcher::setEarlyDeparture(bool enabled) {
+    earlyDeparture_ = enabled;
+}
+
+void Dispatcher::setPredictiveStart(bool enabled) {
+    predictiveStart_ = enabled;
+}
+
+const Dispatcher::Plan& Dispatcher::getPlan() {
+    return plan_;
+}
+
+void Dispatcher::printPlan() {
+    String order = "";
+    for (size_t i = 0; i < plan_.order.size(); i++) {
+        order += (i == 0 ? "" : ",") + String(plan_.order[i]);
+    }
+    LOG_I("[Dispatcher][plan] Order: ", order, " | Arrivals: ", plan_.arrivals, " Fused: ", plan_.fusedSteps);
+    LOG_I("[Dispatcher][plan] Travel: ", plan_.estimatedTravelSteps, " steps (recipe order: ", plan_.unplannedTravelSteps, " steps)");
 }
 
 void Dispatcher::clearSteps() {
@@ -140,36 +528,103 @@ void Dispatcher::clearSteps() {
 }
 
 void Dispatcher::addStep(Dispenser::DispenseType type,  uint8_t stationIndex, uint8_t pourDeviceIndex, float targetWeight) {
+    steps_.push_back(makeStep_(type, stationIndex, pourDeviceIndex, targetWeight, steps_.size()));
+}
+
+void Dispatcher::addAddressedStep(uint8_t address, float targetWeight) {
+    steps_.push_back(makeAddressedStep_(address, targetWeight, steps_.size()));
+}
+
+Dispatcher::Steps Dispatcher::makeStep_(Dispenser::DispenseType type, uint8_t stationIndex, uint8_t pourDeviceIndex, float targetWeight, uint8_t orderIndex) {
     Steps step;
+    step.orderIndex = orderIndex;
     step.stationIndex = stationIndex;    
     step.type = type;
     step.targetWeight = targetWeight;
     step.stepCompleted = false;    
     step.pourDeviceIndex = pourDeviceIndex-1; //One based index to standardize with StationIndex (0==home)
-    
-    steps_.push_back(step);
+    return step;
+}
+
+Dispatcher::Steps Dispatcher::makeAddressedStep_(uint8_t address, float targetWeight, uint8_t orderIndex) {
+    if (address >= 7) {
+        return makeStep_(Dispenser::DispenseType::PUMP, 7, address - 6, targetWeight, orderIndex);
+    }
+    return makeStep_(Dispenser::DispenseType::VALVE, address, address, targetWeight, orderIndex);
+}
+
+bool Dispatcher::validateStep_(const Steps& step) {
+    uint8_t deviceCount = (step.type == Dispenser::DispenseType::PUMP) ? dispenser_->getPumpCount() : dispenser_->getValveCount();
+    if (step.stationIndex == 0 || step.stationIndex >= transport_->getStationCount() || step.pourDeviceIndex >= deviceCount) {
+        LOG_W("[Dispatcher][compile] Step ", step.orderIndex, " has no station ", step.stationIndex, " / device ", step.pourDeviceIndex + 1);
+        return false;
+    }
+    if (step.targetWeight <= 0.0 || step.targetWeight > 1000.0) {
+        LOG_W("[Dispatcher][compile] Step ", step.orderIndex, " target out of range: ", step.targetWeight, "g");
+        return false;
+    }
+    return true;
+}
+
+// Everything start() would otherwise do per order: address mapping, validation and travel planning.
+// The job does not depend on the machine state, so it can be kept and started any number of times.
+bool Dispatcher::compile(const std::vector<Ingredient>& ingredients, CompiledJob& job) {
+    job.steps.clear();
+    for (const auto& ingredient : ingredients) {
+        Steps step = makeAddressedStep_(ingredient.address, ingredient.targetWeight, job.steps.size());
+        if (validateStep_(step) == false) {
+            return false;
+        }
+        job.steps.push_back(step);
+    }
+
+    if (job.steps.empty()) {
+        return false;
+    }
+    job.plan = planSteps_(job.steps);
+    return true;
 }
 
 bool Dispatcher::start() {
+    plan_ = planSteps_(steps_);
+    printPlan();
+    return startPlanned_();
+}
+
+bool Dispatcher::start(const CompiledJob& job) {
+    if (isServing() == true || state_ == DispatcherState::NO_CUP) {
+        LOG_W("[Dispatcher][start] Busy, job not started.");
+        return false;
+    }
+
+    steps_ = job.steps;
+    plan_ = job.plan;
+    return startPlanned_();
+}
+
+bool Dispatcher::startPlanned_() {
     if (steps_.size() == 0) {
-        Serial.println("[Dispatcher][start] No steps to execute.");
+        LOG_I("[Dispatcher][start] No steps to execute.");
         return false;
     }
 
     if (transport_->isParked() == false) {
-        Serial.println("[Dispatcher][start] Transport not ready.");
+        LOG_W("[Dispatcher][start] Transport not ready.");
         return false;
     }    
 
     currentStep_ = 0;
     cumulativeWeight_ = 0.0;
-    jobBeginTimeStampMS_ = millis();    
+    jobOrderId_ = 0;
+    jobBeginTimeStampMS_ = hal::millis();    
+    cupWeight_ = dispenser_->getAbsoluteWeight();
     
-    Serial.println("[Dispatcher][start] Performing first step: " + String(currentStep_) + " of " + String(steps_.size()-1));
-    Serial.println("[Dispatcher][start] Start weight: " + String(dispenser_->getLatestWeight()) + "g");
+    LOG_I("[Dispatcher][start] Performing first step: ", currentStep_, " of ", steps_.size()-1);
+    LOG_I("[Dispatcher][start] Start weight: ", dispenser_->getLatestWeight(), "g");
     
-    transport_->goToStation(steps_[currentStep_].stationIndex);
-    steps_[currentStep_].beginMovementTimeStampMS = millis();
+    predictiveBaseline_ = predictiveStart_ && dispenser_->captureBaseline();
+    transport_->goToStation(steps_[currentStep_].stationIndex, 0, liquidMass_());
+    steps_[currentStep_].beginMovementTimeStampMS = hal::millis();
     state_ = DispatcherState::MOVING;
 
     return true;
@@ -181,7 +636,7 @@ Dispatcher::DispatcherState Dispatcher::getState() {
 
 Dispatcher::StepStatus Dispatcher::getStepStatus() {
     StepStatus status;
-    status.index = currentStep_;
+    status.index = steps_[currentStep_].orderIndex;
     status.stationIndex = steps_[currentStep_].stationIndex;
     status.targetWeight = steps_[currentStep_].targetWeight;
     status.dispensedWeight = dispenser_->getLatestWeight();
@@ -200,7 +655,10 @@ bool Dispatcher::isServing() {
 Dispatcher::Dispatcher(std::shared_ptr<Dispenser> dispenser, std::shared_ptr<Transport> transport) {
     dispenser_ = dispenser;
     transport_ = transport;
-    state_ = DispatcherState::READY;
+    state_ = DispatcherState::NO_CUP; //A cup already on the scale at boot is accepted like any other.
+    dispenser_->setDripCreditCallback([this](const std::vector<float>& finalWeights) {
+        creditDrip_(finalWeights);
+    });
 };
 
 void Dispatcher::setWillBeginDispensingCallback(WillBeginDispensing callback) {
@@ -219,6 +677,10 @@ void Dispatcher::setDidFinishJob(DidFinishJob callback) {
     didFinishJobCallback_ = callback;
 }
 
+void Dispatcher::setOrderStatusCallback(OrderStatusChanged callback) {
+    orderStatusCallback_ = callback;
+}
+
 void Dispatcher::setIsReady(IsReady callback) {
     isReadyCallback_ = callback;
 }
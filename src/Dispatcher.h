@@ -1,7 +1,9 @@
 #include "Arduino.h"
 #include <Dispenser.h>
 #include <Transport.h>
+#include "JobStats.h"
 #include <memory>
+#include <deque>
 
 #pragma once
 
@@ -34,36 +36,99 @@ public:
 
     struct Steps
     {        
+        uint8_t orderIndex; //Position in the recipe as received, used for all client facing step reports.
         uint8_t stationIndex;
         uint8_t pourDeviceIndex;        
         float targetWeight;
-        uint32_t beginMovementTimeStampMS;
-        uint32_t beginDispensingTimeStampMS;
-        u_int32_t endDispensingTimeStampMS;
+        float dispensedWeight = 0.0;
+        uint32_t beginMovementTimeStampMS = 0;
+        uint32_t arrivalTimeStampMS = 0;
+        uint32_t beginDispensingTimeStampMS = 0;
+        uint32_t pourBeginTimeStampMS = 0;
+        uint32_t closeTimeStampMS = 0;
+        u_int32_t endDispensingTimeStampMS = 0;
+        uint32_t completeTimeStampMS = 0;
         bool stepCompleted = false;
+        bool fusedArrival = false; //Same station as the previous step, tray does not move.
         Dispenser::DispenseType type;
     };
 
+    struct Plan
+    {
+        std::vector<uint8_t> order; //orderIndex of each step in execution order.
+        uint32_t estimatedTravelSteps = 0;
+        uint32_t unplannedTravelSteps = 0;
+        uint8_t arrivals = 0;
+        uint8_t fusedSteps = 0;
+    };
+
+    // Client addressing: 1-6 are the valve stations, 7 and up are pumps 1.. on the pump station.
+    struct Ingredient
+    {
+        uint8_t address;
+        float targetWeight;
+    };
+
+    // Validated, travel-ordered steps ready for start(), see compile().
+    struct CompiledJob
+    {
+        std::vector<Steps> steps;
+        Plan plan;
+    };
+
+    enum class OrderStatus {
+        QUEUED,
+        SERVING,
+        COMPLETED,
+        CANCELLED,
+    };
+
+    struct Order
+    {
+        uint16_t id;
+        CompiledJob job;
+        uint32_t queuedTimeStampMS;
+    };
+
+    static const uint8_t MAX_QUEUED_ORDERS = 8;
+    static const uint32_t CUP_HOLD_MS = 500; //A cup must weigh in for this long, settled, before it is served.
+
 
 using WillBeginDispensing = std::function<void(const uint8_t&)>;
 using DidFinishDispensing =  std::function<void(const uint8_t&)>;
 using DidUpdateWeight =  std::function<void(const uint8_t&, float weight)>;
 using DidFinishJob =  std::function<void()>;
 using IsReady =  std::function<void()>;
+using OrderStatusChanged = std::function<void(uint16_t orderId, OrderStatus status, uint8_t queuePosition)>;
 
 Dispatcher(std::shared_ptr<Dispenser> dispenser, std::shared_ptr<Transport> transport);
 void heartbeat();
 void clearSteps();
 void addStep(Dispenser::DispenseType type,  uint8_t stationIndex, uint8_t pourDeviceIndex, float targetWeight);
+void addAddressedStep(uint8_t address, float targetWeight);
+bool compile(const std::vector<Ingredient>& ingredients, CompiledJob& job);
 bool start();
+bool start(const CompiledJob& job);
+uint16_t enqueue(const CompiledJob& job);
+bool cancelOrder(uint16_t orderId);
+uint8_t getQueueLength();
+uint16_t getCurrentOrderId();
 void cancel();
 bool isServing();
+void setTravelPlanning(bool enabled);
+void setConcurrentPumps(bool enabled);
+void setEarlyDeparture(bool enabled);
+void setPredictiveStart(bool enabled);
+const Plan& getPlan();
+void printPlan();
+JobStats& getJobStats();
 
 void setWillBeginDispensingCallback(WillBeginDispensing callback);
 void setDidFinishDispensingCallback(DidFinishDispensing callback);
 void setDidUpdateWeight(DidUpdateWeight callback);
 void setDidFinishJob(DidFinishJob callback);
 void setIsReady(IsReady callback);
+void setOrderStatusCallback(OrderStatusChanged callback);
 
 DispatcherState getState();
 StepStatus getStepStatus();
@@ -75,9 +140,26 @@ private:
     void awaitingEndDelayPhase_();
     void awaitingStartDelayPhase_();
     void awaitingRemovalPhase_();
+    bool acceptCup_();
     void jobCompletePhase_();
     void performNextStep_(); 
+    void beginDispensingStep_(Dispenser::StartMode mode);
+    void completeSteps_();
+    bool nextStepNeedsMove_();
+    void creditDrip_(const std::vector<float>& finalWeights);
+    float liquidMass_();
     void reset_();
+    void recordPourTiming_();
+    void recordTimeline_();
+    Plan planSteps_(std::vector<Steps>& steps);
+    bool startPlanned_();
+    Steps makeStep_(Dispenser::DispenseType type, uint8_t stationIndex, uint8_t pourDeviceIndex, float targetWeight, uint8_t orderIndex);
+    Steps makeAddressedStep_(uint8_t address, float targetWeight, uint8_t orderIndex);
+    bool validateStep_(const Steps& step);
+    void startNextOrder_();
+    void announceQueue_();
+    void setOrderStatus_(uint16_t orderId, OrderStatus status, uint8_t queuePosition = 0);
+    uint32_t estimateTravel_(const std::vector<Steps>& steps);
 
     std::shared_ptr<Dispenser> dispenser_;
     std::shared_ptr<Transport> transport_;
@@ -87,13 +169,32 @@ private:
     DidUpdateWeight didUpdateWeightCallback_;
     DidFinishJob didFinishJobCallback_;
     IsReady isReadyCallback_;
+    OrderStatusChanged orderStatusCallback_;
 
     std::vector<Steps> steps_;
+    Plan plan_;
+    std::deque<Order> orderQueue_;
+    uint16_t currentOrderId_ = 0; //0 when the running job did not come from the queue.
+    uint16_t jobOrderId_ = 0; //Same, but kept until the job's timeline is recorded.
+    uint16_t nextOrderId_ = 1;
+    bool awaitCupRemoval_ = false; //A cancelled job leaves its cup behind, queued orders wait for a fresh one.
+    bool cupCandidate_ = false; //Over the cup threshold since cupSinceMS_, not yet accepted.
+    uint32_t cupSinceMS_ = 0;
+    bool travelPlanning_ = true;
+    bool concurrentPumps_ = false;
+    uint8_t groupSize_ = 1; //Steps served by the current pour, more than one when pumps run concurrently.
+    bool earlyDeparture_ = false;
+    bool predictiveStart_ = false;
+    bool predictiveBaseline_ = false; //The dispenser kept a settled reading from before the current move.
+    int16_t dripStep_ = -1; //First step of a pour that departed early and is still collecting drip.
+    uint8_t dripGroupSize_ = 0;
     DispatcherState state_;
     uint32_t jobBeginTimeStampMS_;
+    JobStats jobStats_;
 
     uint8_t currentStep_=0;
     float cumulativeWeight_ = 0.0;
+    float cupWeight_ = 0.0;
     
     
 };
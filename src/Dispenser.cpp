@@ -1,32 +1,33 @@
 #include "Dispenser.h"
+#include "Logger.h"
 
 
 
-Dispenser::Dispenser(uint8_t dat_pin, uint8_t sck_pin, float kFactor,  float emptyWeight ) {
-    scale_ = std::make_unique<HX711>();
-    scale_->begin(dat_pin, sck_pin);
-    scale_->set_scale(kFactor);
+Dispenser::Dispenser(uint8_t dat_pin, uint8_t sck_pin, float kFactor,  float emptyWeight, uint8_t rate_pin) {
+    adc_ = hal::platform().createLoadCellAdc(dat_pin, sck_pin);
+    scaleFactor_ = kFactor;
     valves_.clear();
     emptyWeight_ = emptyWeight;      
     valveIndex_ = 0;
     pumpIndex_ = 0;
-    Serial.println("[Dispenser][Constructor] Dispenser created: " + String(scale_->get_units(1)));
+    LOG_I("[Dispenser][Constructor] Dispenser created, scale factor ", scaleFactor_);
+
+    loadCell_ = std::make_unique<LoadCell>(adc_.get(), dat_pin, rate_pin);
+    setEstimator(std::make_unique<KalmanEstimator>());
+    loadCell_->begin(); //From here on only the acquisition task talks to the HX711.
 };
 
 
 void Dispenser::heartbeat() {
     
-    if (scale_->is_ready()) {
-        float alpha = 0.4; // Smoothing factor. Adjust as needed.
-        float rawValue = scale_->get_units(1); // Get the current raw value        
-        filteredValue_ = alpha * rawValue + (1 - alpha) * filteredValue_; // Apply the low-pass filter
-
-        float resolution = 0.14; // Target resolution, e.g., 0.1 kg
-        float finalValue = round(filteredValue_ / resolution) * resolution; // Reduce resolution
-
-
-        latestWeight_ = finalValue; //fabs(scale_->get_units(5));
-        // Serial.println("[Dispenser][heartbeat] Latest weight: " A+ String(latestWeight_) + "g");
+    LoadCell::Sample sample;
+    while (loadCell_->read(sample)) {
+        processSample_(sample);
+    }
+    if (estimator_->hasEstimate()) {
+        latestWeight_ = estimator_->predict(hal::micros()); //Predicted for now, not for when the last sample was taken.
+        filteredWeight_ = estimator_->getMass();
+        flowRate_ = estimator_->getFlowRate();
     }
 
     if (state_ == DispenserState::READY) {
@@ -38,45 +39,266 @@ void Dispenser::heartbeat() {
     }
 
     if (state_ == DispenserState::AWAITING_CLOSURE) {
-        if (millis() - awaitingClosureTimeStampMS_ > 1000) {
-            Serial.println("[Dispenser][AWAITING_CLOSURE] Awaiting closure complete.");
+        if (concurrent_ == true) {
+            attributeConcurrentFlow_(); //Keep crediting what is still in the air after the pumps stop.
+        }
+        if (awaitSettle_(awaitingClosureTimeStampMS_, 1000, "AWAITING_CLOSURE")) {
+            LOG_I("[Dispenser][AWAITING_CLOSURE] Awaiting closure complete.");
+            if (dispenseType_ == DispenseType::PUMP) {
+                learnPumpFlowRates_();
+            }
+            learnInFlightWeight_();
+            noteCalibrationChange_();
             resetDispensing_();
         }
     }
 
     if (state_ == DispenserState::AWAITING_STABILITY) {
-        if (millis() - awaitingStabilityTimeStampMS_ > 500) {
+        if (awaitSettle_(awaitingStabilityTimeStampMS_, 500, "AWAITING_STABILITY")) {
+            if (trailing_ == true) {
+                creditTrailingDrip_();
+            }
+            tare();
             state_ = DispenserState::STABLE;            
         }
     }
 
     if (state_ == DispenserState::STABLE) {             
-            Serial.println("[Dispenser][STABLE] Station Begin weight: " + String(getLatestWeight()) + "g");            
+            LOG_I("[Dispenser][STABLE] Station Begin weight: ", getLatestWeight(), "g");            
             state_ = DispenserState::DISPENSING;
-            if (dispenseType_ == DispenseType::PUMP) {
+            pourBeginTimeStampMS_ = hal::millis();
+            lastPourTiming_.beginTimeStampMS = pourBeginTimeStampMS_;
+            lastPourTiming_.closeTimeStampMS = 0;
+            latencyMeasured_ = concurrent_; //Several pumps share the first gram, nothing to learn per pump.
+            if (concurrent_ == true) {
+                attributedWeight_ = latestWeight_;
+                for (auto& channel : pumpChannels_) {
+                    pumps_[channel.pumpIndex]->on();
+                    channel.running = true;
+                    channel.beginTimeStampMS = pourBeginTimeStampMS_;
+                }
+            } else if (dispenseType_ == DispenseType::PUMP) {
                 pumps_[pourDeviceIndex_]->on();
             } else {
                 valves_[pourDeviceIndex_]->setPosition(Valve::Position::OPEN);                            
+                valveOpening_ = 1.0;
             }
     }
 
-    if (state_ == DispenserState::DISPENSING) {
-        if (latestWeight_ >= targetWeight_) {
-            Serial.println("[Dispenser][DISPENSING] Dispensing complete.");
+    if (state_ == DispenserState::DISPENSING && concurrent_ == true) {
+        attributeConcurrentFlow_();
+    } else if (state_ == DispenserState::DISPENSING) {
+        if (latestWeight_ >= targetWeight_ - inFlightWeight_()) {
+            LOG_I("[Dispenser][DISPENSING] Dispensing complete.");
             finishDispensing_();
+        } else if (proportionalValves_ == true && dispenseType_ == DispenseType::VALVE && newSample_ == true) {
+            controlValveFlow_();
         }
     }
+
+    newSample_ = false;
+};
+
+// Full flow for the bulk of the pour, then a flow-rate loop that slows the valve down so the
+// remaining weight takes roughly approachTimeS to pour.
+void Dispenser::controlValveFlow_() {
+    float remaining = targetWeight_ - inFlightWeight_() - latestWeight_;
+    float opening = 1.0;
+
+    if (remaining < valveControl_.throttleWeight) {
+        float targetFlow = max(remaining / valveControl_.approachTimeS, valveControl_.minFlowRate);
+        opening = valveOpening_ + valveControl_.gain * (targetFlow - flowRate_);
+        opening = constrain(opening, valveControl_.minOpening, 1.0f);
+    }
+
+    if (opening != valveOpening_) {
+        valveOpening_ = opening;
+        valves_[pourDeviceIndex_]->setOpening(valveOpening_);
+    }
+};
+
+// The fixed delay is only an upper bound, a flat signal ends the wait as soon as it is seen.
+bool Dispenser::awaitSettle_(uint32_t sinceMS, uint32_t timeoutMS, const char* phase) {
+    uint32_t waited = hal::millis() - sinceMS;
+    bool settled = stability_.isSettled();
+    if (settled == false && waited <= timeoutMS) {
+        return false;
+    }
+
+    lastSettle_.waitedMS = waited;
+    lastSettle_.timedOut = !settled;
+    LOG_I("[Dispenser][", phase, "] ", (settled ? "Settled" : "Timed out"), " after ", waited, "ms (saved ", settled ? timeoutMS - waited : 0, "ms)");
+    return true;
+};
+
+// Called right before the tray moves. A PREDICTIVE start zeroes on this reading because the scale is
+// braking and still converging by the time the device opens. Only a settled scale with nothing left
+// to credit gives one; a pour that departed early is still dripping.
+bool Dispenser::captureBaseline() {
+    hasBaseline_ = trailing_ == false && stability_.getSampleCount() > 0 && stability_.isSettled();
+    if (hasBaseline_ == true) {
+        baselineRaw_ = offset_ + (int32_t)(stability_.getMean() * scaleFactor_);
+    }
+    return hasBaseline_;
+};
+
+// Drip has slowed enough that the rest can land while the tray is already moving.
+bool Dispenser::canDepartEarly() {
+    if (state_ != DispenserState::AWAITING_CLOSURE) {
+        return false;
+    }
+    return hal::millis() - awaitingClosureTimeStampMS_ >= 150 && fabs(flowRate_) < dripThreshold_;
+};
+
+// Ends the closure window now and keeps the current tare, so whatever still drips is credited to this
+// pour once the next station has settled and before it tares.
+float Dispenser::departEarly() {
+    float committedWeight = latestWeight_;
+    if (state_ != DispenserState::AWAITING_CLOSURE) {
+        return committedWeight;
+    }
+
+    LOG_I("[Dispenser][departEarly] Departing with ", committedWeight, "g, flow ", flowRate_, "g/s");
+    if (dispenseType_ == DispenseType::PUMP) {
+        learnPumpFlowRates_();
+    }
+    trailing_ = true;
+    lastPourWeight_ = committedWeight;
+    trailingType_ = dispenseType_;
+    trailingDeviceIndex_ = pourDeviceIndex_;
+    trailingCloseWeight_ = closeWeight_;
+    trailingCommittedWeight_ = committedWeight;
+    trailingChannels_.clear();
+    if (concurrent_ == true) {
+        trailingChannels_ = pumpChannels_;
+    }
+    state_ = DispenserState::FINISHED;
+    awaitingClosureTimeStampMS_ = 0;
+    return committedWeight;
+};
+
+// Runs once the next station has settled, the weight is still relative to the departed pour's tare.
+void Dispenser::creditTrailingDrip_() {
+    trailing_ = false;
+    float finalWeight = latestWeight_;
+    std::vector<float> finalWeights;
+
+    if (trailingChannels_.empty() == false) {
+        float drip = finalWeight - trailingCommittedWeight_;
+        float totalRate = 0.0;
+        for (const auto& channel : trailingChannels_) {
+            totalRate += pumps_[channel.pumpIndex]->getFlowRate();
+        }
+        for (const auto& channel : trailingChannels_) {
+            finalWeights.push_back(channel.dispensedWeight + (totalRate > 0.0 ? drip * pumps_[channel.pumpIndex]->getFlowRate() / totalRate : 0.0));
+        }
+    } else {
+        finalWeights.push_back(finalWeight);
+        if (trailingType_ == DispenseType::PUMP) {
+            pumps_[trailingDeviceIndex_]->learnInFlightWeight(finalWeight - trailingCloseWeight_);
+        } else {
+            valves_[trailingDeviceIndex_]->learnInFlightWeight(finalWeight - trailingCloseWeight_);
+        }
+        noteCalibrationChange_();
+    }
+
+    LOG_I("[Dispenser][creditTrailingDrip_] Departed pour final weight: ", finalWeight, "g (committed ", trailingCommittedWeight_, "g)");
+    if (dripCreditCallback_ != nullptr) {
+        dripCreditCallback_(finalWeights);
+    }
+};
+
+void Dispenser::setDripCreditCallback(DripCreditCallback callback) {
+    dripCreditCallback_ = callback;
 };
 
+void Dispenser::setDripThreshold(float gramsPerSecond) {
+    dripThreshold_ = gramsPerSecond;
+};
+
+void Dispenser::setStabilityTolerance(float maxStdDev, float maxSlope, uint32_t windowMS) {
+    stability_.setTolerance(maxStdDev, maxSlope, windowMS);
+};
+
+bool Dispenser::isSettled() {
+    return stability_.isSettled();
+};
+
+Dispenser::SettleReport Dispenser::getLastSettleReport() {
+    return lastSettle_;
+}
+
+// Kept until the next pour opens, so it can still be read after the closure window ended.
+Dispenser::PourTiming Dispenser::getLastPourTiming() {
+    return lastPourTiming_;
+};
+
+float Dispenser::getFlowRate() {
+    return flowRate_;
+};
+
+void Dispenser::setProportionalValves(bool enabled) {
+    proportionalValves_ = enabled;
+};
+
+void Dispenser::setValveControl(ValveControl control) {
+    valveControl_ = control;
+};
+
+void Dispenser::processSample_(const LoadCell::Sample& sample) {
+    float rawValue = (sample.raw - offset_) / scaleFactor_;
+    estimator_->update(rawValue, sample.timeStampUS);
+    newSample_ = true;
+    stability_.addSample(rawValue, sample.timeStampUS / 1000);
+
+    if (state_ == DispenserState::DISPENSING && latencyMeasured_ == false && estimator_->getMass() >= 1.0) {
+        latencyMeasured_ = true;
+        uint32_t latency = sample.timeStampUS / 1000 - pourBeginTimeStampMS_;
+        if (dispenseType_ == DispenseType::PUMP) {
+            pumps_[pourDeviceIndex_]->learnActuationLatencyMS(latency);
+        } else {
+            valves_[pourDeviceIndex_]->learnActuationLatencyMS(latency);
+        }
+    }
+};
+
+void Dispenser::setEstimator(std::unique_ptr<WeightEstimator> estimator) {
+    estimator_ = std::move(estimator);
+    estimator_->setLatencyUS(loadCell_->getSamplePeriodUS() / 2);
+};
+
+void Dispenser::setSampleRate(LoadCell::Rate rate) {
+    loadCell_->setRate(rate);
+    estimator_->setLatencyUS(loadCell_->getSamplePeriodUS() / 2);
+};
+
+// Lets other work that disturbs the HX711 timing (LED frames) go in between conversions.
+bool Dispenser::isLoadCellQuietFor(uint32_t durationUS) {
+    return loadCell_->isQuietFor(durationUS);
+};
+
+// Zeroes on the newest samples instead of reading the HX711 again, the acquisition task owns the bus
+// and callers have already waited for the signal to settle.
 void Dispenser::tare() {
-    Serial.println("[Dispenser][tare] Scale Tared.");
-    scale_->tare();
+    float zero = (stability_.getSampleCount() > 0) ? stability_.getMean() : estimator_->getMass();
+    tareTo_(offset_ + (int32_t)(zero * scaleFactor_));
+};
+
+void Dispenser::tareTo_(int32_t zeroRaw) {
+    offset_ = zeroRaw;
+    LOG_I("[Dispenser][tare] Scale Tared.");
+    estimator_->reset(); //Otherwise the estimate carries the pre-tare weight and can end a pour early.
+    latestWeight_ = 0.0;
+    filteredWeight_ = 0.0;
+    flowRate_ = 0.0;
+    stability_.reset();
+    hasBaseline_ = false;
 };
 
 
 void Dispenser::selectValveForTrim(uint32_t valveId, Valve::Position position) {
     if (valveId > valves_.size()) {
-        Serial.println("[Dispenser][selectValveForTrim] Invalid valve Index: " + String(valveId) + " out of " + String(valves_.size()) + " valves.");
+        LOG_W("[Dispenser][selectValveForTrim] Invalid valve Index: ", valveId, " out of ", valves_.size(), " valves.");
         return;
     }
     
@@ -90,35 +312,173 @@ void Dispenser::selectValveForTrim(uint32_t valveId, Valve::Position position) {
     }
 };
 
-void Dispenser::beginDispensingPump(uint8_t pumpIndex, float targetWeight) {
+void Dispenser::beginDispensingPump(uint8_t pumpIndex, float targetWeight, StartMode mode) {
     if (pumpIndex > pumps_.size()) {
-        Serial.println("[Dispenser][beginDispensing] Invalid pump Index: " + String(pumpIndex) + " out of " + String(pumps_.size()-1) + " pumps.");
+        LOG_W("[Dispenser][beginDispensing] Invalid pump Index: ", pumpIndex, " out of ", pumps_.size()-1, " pumps.");
         return;
     }
 
     dispenseType_ = DispenseType::PUMP;
-    state_ = DispenserState::AWAITING_STABILITY;
-    tare();
-    Serial.println("[Dispenser][beginDispensing] Beginning dispensing on pump IDX: " + String(pumpIndex));    
+    concurrent_ = false;
+    LOG_I("[Dispenser][beginDispensing] Beginning dispensing on pump IDX: ", pumpIndex);    
     targetWeight_ = targetWeight;
-    awaitingStabilityTimeStampMS_ = millis();
-
     pourDeviceIndex_ = pumpIndex;
+    beginPour_(mode);
 };
 
-void Dispenser::beginDispensingValve(uint8_t valveIndex, float targetWeight) {   
+void Dispenser::beginDispensingValve(uint8_t valveIndex, float targetWeight, StartMode mode) {   
     if (valveIndex > valves_.size()) {
-        Serial.println("[Dispenser][beginDispensing] Invalid valve Index: " + String(valveIndex) + " out of " + String(valves_.size()-1) + " valves.");
+        LOG_W("[Dispenser][beginDispensing] Invalid valve Index: ", valveIndex, " out of ", valves_.size()-1, " valves.");
         return;
     } 
 
     dispenseType_ = DispenseType::VALVE;
-    state_ = DispenserState::AWAITING_STABILITY;
-    tare();
-    Serial.println("[Dispenser][beginDispensing] Beginning dispensing on valve IDX: " + String(valveIndex));    
+    concurrent_ = false;
+    LOG_I("[Dispenser][beginDispensing] Beginning dispensing on valve IDX: ", valveIndex);    
     targetWeight_ = targetWeight;
-    awaitingStabilityTimeStampMS_ = millis();
     pourDeviceIndex_ = valveIndex;
+    beginPour_(mode);
+};
+
+// All channels run at once and the single scale reading is split between them in proportion to each
+// pump's learned flow rate. A channel stops on its own target; the pour ends when the last one stops.
+void Dispenser::beginDispensingPumps(const std::vector<PumpChannel>& channels, StartMode mode) {
+    for (const auto& channel : channels) {
+        if (channel.pumpIndex >= pumps_.size()) {
+            LOG_W("[Dispenser][beginDispensingPumps] Invalid pump Index: ", channel.pumpIndex, " out of ", pumps_.size()-1, " pumps.");
+            return;
+        }
+    }
+
+    dispenseType_ = DispenseType::PUMP;
+    concurrent_ = true;
+    pumpChannels_ = channels;
+    float totalTarget = 0.0;
+    for (auto& channel : pumpChannels_) {
+        channel.dispensedWeight = 0.0;
+        channel.running = false;
+        totalTarget += channel.targetWeight;
+    }
+
+    LOG_I("[Dispenser][beginDispensingPumps] Beginning concurrent dispensing on ", pumpChannels_.size(), " pumps.");
+    targetWeight_ = totalTarget;
+    pourDeviceIndex_ = pumpChannels_[0].pumpIndex;
+    beginPour_(mode);
+};
+
+void Dispenser::beginPour_(StartMode mode) {
+    awaitingStabilityTimeStampMS_ = hal::millis();
+    state_ = DispenserState::AWAITING_STABILITY;
+
+    if (mode == StartMode::PREDICTIVE && hasBaseline_ == false) {
+        LOG_W("[Dispenser][beginPour_] No settled baseline for a predictive start, awaiting settle.");
+        mode = StartMode::AWAIT_SETTLE;
+    }
+    if (mode == StartMode::AWAIT_SETTLE) {
+        return; //Tared once the cup has settled, after any drip from a departed pour is credited.
+    }
+
+    // PREDICTIVE: the tray is still braking, zero on the reading from before the move and open right
+    // away so liquid lands as the tray stops. IMMEDIATE: the tray did not move, the latest samples do.
+    if (mode == StartMode::PREDICTIVE) {
+        tareTo_(baselineRaw_);
+    } else {
+        if (trailing_ == true) {
+            creditTrailingDrip_();
+        }
+        tare();
+    }
+    state_ = DispenserState::STABLE;
+};
+
+void Dispenser::attributeConcurrentFlow_() {
+    float delta = latestWeight_ - attributedWeight_;
+    attributedWeight_ = latestWeight_;
+
+    bool anyRunning = false;
+    float totalRate = 0.0;
+    for (const auto& channel : pumpChannels_) {
+        anyRunning |= channel.running;
+    }
+    for (const auto& channel : pumpChannels_) {
+        if (channel.running == true || anyRunning == false) {
+            totalRate += pumps_[channel.pumpIndex]->getFlowRate();
+        }
+    }
+    if (totalRate <= 0.0) {
+        return;
+    }
+
+    for (auto& channel : pumpChannels_) {
+        if (channel.running == true || anyRunning == false) {
+            channel.dispensedWeight += delta * (pumps_[channel.pumpIndex]->getFlowRate() / totalRate);
+        }
+    }
+
+    if (state_ != DispenserState::DISPENSING) {
+        return;
+    }
+
+    bool stillRunning = false;
+    for (auto& channel : pumpChannels_) {
+        if (channel.running == true && channel.dispensedWeight >= channel.targetWeight - pumps_[channel.pumpIndex]->getInFlightWeight()) {
+            LOG_I("[Dispenser][attributeConcurrentFlow_] Pump IDX: ", channel.pumpIndex, " reached ", channel.dispensedWeight, "g");
+            pumps_[channel.pumpIndex]->off();
+            channel.running = false;
+            channel.endTimeStampMS = hal::millis();
+        }
+        stillRunning |= channel.running;
+    }
+
+    if (stillRunning == false) {
+        LOG_I("[Dispenser][DISPENSING] Concurrent dispensing complete.");
+        finishDispensing_();
+    }
+};
+
+void Dispenser::learnPumpFlowRates_() {
+    if (concurrent_ == false) {
+        uint32_t durationMS = awaitingClosureTimeStampMS_ - pourBeginTimeStampMS_;
+        if (durationMS > 0) {
+            pumps_[pourDeviceIndex_]->learnFlowRate(latestWeight_ * 1000.0 / durationMS);
+        }
+        return;
+    }
+
+    // Individual shares are only estimates, so rescale every pump by how far the combined prediction was off.
+    float predicted = 0.0;
+    for (const auto& channel : pumpChannels_) {
+        predicted += pumps_[channel.pumpIndex]->getFlowRate() * (channel.endTimeStampMS - channel.beginTimeStampMS) / 1000.0;
+    }
+    if (predicted <= 0.0) {
+        return;
+    }
+    float correction = latestWeight_ / predicted;
+    for (const auto& channel : pumpChannels_) {
+        pumps_[channel.pumpIndex]->learnFlowRate(pumps_[channel.pumpIndex]->getFlowRate() * correction);
+    }
+};
+
+uint32_t Dispenser::getActuationLatencyMS(DispenseType type, uint8_t pourDeviceIndex) {
+    if (type == DispenseType::PUMP) {
+        return pourDeviceIndex < pumps_.size() ? pumps_[pourDeviceIndex]->getActuationLatencyMS() : 0;
+    }
+    return pourDeviceIndex < valves_.size() ? valves_[pourDeviceIndex]->getActuationLatencyMS() : 0;
+};
+
+float Dispenser::getLastPourWeight() {
+    return lastPourWeight_;
+};
+
+bool Dispenser::isConcurrent() {
+    return concurrent_;
+};
+
+float Dispenser::getPumpDispensedWeight(uint8_t channel) {
+    if (channel >= pumpChannels_.size()) {
+        return 0.0;
+    }
+    return pumpChannels_[channel].dispensedWeight;
 };
 
 // void Dispenser::beginDispensing(uint8_t valveOrPumpIndex, float targetWeight, DispenseType type) {
@@ -146,28 +506,158 @@ void Dispenser::beginDispensingValve(uint8_t valveIndex, float targetWeight) {
 // };
 
 void Dispenser::abortDispensing() {    
-    Serial.println("[Dispenser][abortDispensing] Aborting dispensing.");
+    LOG_I("[Dispenser][abortDispensing] Aborting dispensing.");
     
-    if (dispenseType_ == DispenseType::PUMP) {
+    if (concurrent_ == true) {
+        for (auto& channel : pumpChannels_) {
+            pumps_[channel.pumpIndex]->off();
+            channel.running = false;
+        }
+    } else if (dispenseType_ == DispenseType::PUMP) {
         pumps_[pourDeviceIndex_]->off();
     } else {
         valves_[pourDeviceIndex_]->setPosition(Valve::Position::CLOSED);
     }
     
+    trailing_ = false;
     resetDispensing_(true); //Skip Callback....
 };
 
 void Dispenser::finishDispensing_() {        
-    if (dispenseType_ == DispenseType::PUMP) {
-        Serial.println("[Dispenser][finishDispensing_] Finishing dispensing internal pump IDX: " + String(pourDeviceIndex_));
+    if (concurrent_ == true) {
+        LOG_I("[Dispenser][finishDispensing_] Finishing concurrent dispensing on ", pumpChannels_.size(), " pumps.");
+    } else if (dispenseType_ == DispenseType::PUMP) {
+        LOG_I("[Dispenser][finishDispensing_] Finishing dispensing internal pump IDX: ", pourDeviceIndex_);
         pumps_[pourDeviceIndex_]->off();
     } else {
-        Serial.println("[Dispenser][finishDispensing_] Finishing dispensing internal valve IDX: " + String(pourDeviceIndex_));
+        LOG_I("[Dispenser][finishDispensing_] Finishing dispensing internal valve IDX: ", pourDeviceIndex_);
         valves_[pourDeviceIndex_]->setPosition(Valve::Position::CLOSED);    
     }
 
     state_ = DispenserState::AWAITING_CLOSURE;
-    awaitingClosureTimeStampMS_ = millis();
+    awaitingClosureTimeStampMS_ = hal::millis();
+    lastPourTiming_.closeTimeStampMS = awaitingClosureTimeStampMS_;
+    closeWeight_ = latestWeight_;
+    stability_.reset(); //Only samples taken after the close count towards settling.
+};
+
+float Dispenser::inFlightWeight_() {
+    if (dispenseType_ == DispenseType::PUMP) {
+        return pumps_[pourDeviceIndex_]->getInFlightWeight();
+    }
+    return valves_[pourDeviceIndex_]->getInFlightWeight();
+};
+
+// Concurrent pours are skipped: once a pump stops, its tail can't be told apart from the pumps still running.
+void Dispenser::learnInFlightWeight_() {
+    if (concurrent_ == true) {
+        return;
+    }
+
+    float observed = latestWeight_ - closeWeight_;
+    if (dispenseType_ == DispenseType::PUMP) {
+        pumps_[pourDeviceIndex_]->learnInFlightWeight(observed);
+        LOG_I("[Dispenser][learnInFlightWeight_] Pump IDX: ", pourDeviceIndex_, " in-flight: ", observed, "g, model: ", pumps_[pourDeviceIndex_]->getInFlightWeight(), "g");
+    } else {
+        valves_[pourDeviceIndex_]->learnInFlightWeight(observed);
+        LOG_I("[Dispenser][learnInFlightWeight_] Valve IDX: ", pourDeviceIndex_, " in-flight: ", observed, "g, model: ", valves_[pourDeviceIndex_]->getInFlightWeight(), "g");
+    }
+};
+
+void Dispenser::loadCalibration() {
+    std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+    preferences->begin("dispenser", true);
+    char key[16];
+    for (size_t i = 0; i < valves_.size(); i++) {
+        snprintf(key, sizeof(key), "v%d_if", (int)i);
+        valves_[i]->setInFlightWeight(preferences->getFloat(key, 0.0));
+        snprintf(key, sizeof(key), "v%d_al", (int)i);
+        valves_[i]->setActuationLatencyMS(preferences->getUInt(key, valves_[i]->getActuationLatencyMS()));
+    }
+    for (size_t i = 0; i < pumps_.size(); i++) {
+        snprintf(key, sizeof(key), "p%d_if", (int)i);
+        pumps_[i]->setInFlightWeight(preferences->getFloat(key, 0.0));
+        snprintf(key, sizeof(key), "p%d_al", (int)i);
+        pumps_[i]->setActuationLatencyMS(preferences->getUInt(key, pumps_[i]->getActuationLatencyMS()));
+        snprintf(key, sizeof(key), "p%d_fr", (int)i);
+        pumps_[i]->setFlowRate(preferences->getFloat(key, 0.0));
+    }
+    preferences->end();
+    snapshotCalibration_();
+    lastCalibrationSaveMS_ = hal::millis();
+    LOG_I("[Dispenser][loadCalibration] Loaded calibration for ", valves_.size(), " valves and ", pumps_.size(), " pumps.");
+};
+
+void Dispenser::saveCalibration() {
+    std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+    preferences->begin("dispenser", false);
+    char key[16];
+    for (size_t i = 0; i < valves_.size(); i++) {
+        snprintf(key, sizeof(key), "v%d_if", (int)i);
+        preferences->putFloat(key, valves_[i]->getInFlightWeight());
+        snprintf(key, sizeof(key), "v%d_al", (int)i);
+        preferences->putUInt(key, valves_[i]->getActuationLatencyMS());
+    }
+    for (size_t i = 0; i < pumps_.size(); i++) {
+        snprintf(key, sizeof(key), "p%d_if", (int)i);
+        preferences->putFloat(key, pumps_[i]->getInFlightWeight());
+        snprintf(key, sizeof(key), "p%d_al", (int)i);
+        preferences->putUInt(key, pumps_[i]->getActuationLatencyMS());
+        snprintf(key, sizeof(key), "p%d_fr", (int)i);
+        preferences->putFloat(key, pumps_[i]->getFlowRate());
+    }
+    preferences->end();
+    snapshotCalibration_();
+    calibrationDirty_ = false;
+    lastCalibrationSaveMS_ = hal::millis();
+};
+
+// Flash writes can stall the loop for tens of milliseconds, so learning only marks the calibration
+// dirty and the dispatcher calls this while the machine is idle. Writes are rate limited as well.
+void Dispenser::saveCalibrationIfChanged() {
+    if (calibrationDirty_ == false || hal::millis() - lastCalibrationSaveMS_ < CALIBRATION_SAVE_INTERVAL_MS) {
+        return;
+    }
+    LOG_I("[Dispenser][saveCalibrationIfChanged] Saving learned calibration.");
+    saveCalibration();
+};
+
+bool Dispenser::isCalibrationDirty() {
+    return calibrationDirty_;
+};
+
+void Dispenser::snapshotCalibration_() {
+    savedValves_.assign(valves_.size(), CalibrationRecord());
+    for (size_t i = 0; i < valves_.size(); i++) {
+        savedValves_[i].inFlightWeight = valves_[i]->getInFlightWeight();
+        savedValves_[i].actuationLatencyMS = valves_[i]->getActuationLatencyMS();
+    }
+    savedPumps_.assign(pumps_.size(), CalibrationRecord());
+    for (size_t i = 0; i < pumps_.size(); i++) {
+        savedPumps_[i].inFlightWeight = pumps_[i]->getInFlightWeight();
+        savedPumps_[i].actuationLatencyMS = pumps_[i]->getActuationLatencyMS();
+        savedPumps_[i].flowRate = pumps_[i]->getFlowRate();
+    }
+};
+
+// Small wobble in the learned values is not worth a flash write: 0.2g in flight, 10ms of latency, 2% of flow.
+void Dispenser::noteCalibrationChange_() {
+    auto drifted = [](const CalibrationRecord& saved, float inFlightWeight, uint32_t latencyMS, float flowRate) {
+        return fabs(inFlightWeight - saved.inFlightWeight) > 0.2 ||
+            abs((int32_t)latencyMS - (int32_t)saved.actuationLatencyMS) > 10 ||
+            fabs(flowRate - saved.flowRate) > 0.02 * fabs(saved.flowRate) + 0.01;
+    };
+
+    if (savedValves_.size() != valves_.size() || savedPumps_.size() != pumps_.size()) {
+        calibrationDirty_ = true;
+        return;
+    }
+    for (size_t i = 0; i < valves_.size(); i++) {
+        calibrationDirty_ |= drifted(savedValves_[i], valves_[i]->getInFlightWeight(), valves_[i]->getActuationLatencyMS(), 0.0);
+    }
+    for (size_t i = 0; i < pumps_.size(); i++) {
+        calibrationDirty_ |= drifted(savedPumps_[i], pumps_[i]->getInFlightWeight(), pumps_[i]->getActuationLatencyMS(), pumps_[i]->getFlowRate());
+    }
 };
 
 Dispenser::DispenserState Dispenser::getState() {
@@ -178,13 +668,23 @@ float Dispenser::getLatestWeight() {
     return latestWeight_ ;
 };
 
+// Cup presence: filtered mass without the flow term. Extrapolating a step like a cup being lifted
+// swings well past the new weight, only the stop decision wants the prediction.
 float Dispenser::getAbsoluteWeight() {
-    float offset = ((float)scale_->get_offset() / (float)scale_->get_scale());
-    float absWeight = (latestWeight_ + offset) - emptyWeight_;
+    float offset = (float)offset_ / scaleFactor_;
+    float absWeight = (filteredWeight_ + offset) - emptyWeight_;
 
     return absWeight; //fabs(offset);
 };
 
+float Dispenser::getScaleFactor() {
+    return scaleFactor_;
+};
+
+void Dispenser::setScaleFactor(float kFactor) {
+    scaleFactor_ = kFactor;
+};
+
 void Dispenser::resetDispensing_(bool skipCallback) {    
 
     uint8_t index = valveIndex_;
@@ -195,7 +695,8 @@ void Dispenser::resetDispensing_(bool skipCallback) {
     if (completionCallback_ != nullptr && skipCallback == false) { completionCallback_(dispenseType_, valveIndex_, latestWeight_); }
 
     state_ = DispenserState::FINISHED;
-    Serial.println("[Dispenser][resetDispensing_] Resetting dispensing state.");
+    lastPourWeight_ = latestWeight_;
+    LOG_I("[Dispenser][resetDispensing_] Resetting dispensing state.");
     targetWeight_ = 0.0;
     valveIndex_ = 0;
     pumpIndex_ = 0;
@@ -214,7 +715,7 @@ void Dispenser::trimValve(int value) {
     const auto& valvePtr = valves_[valveIndex_];
 
     if (valvePtr == nullptr) {
-        Serial.println("[Dispenser][trimValve] Valve Index: " + String(valveIndex_) + " is null.");
+        LOG_W("[Dispenser][trimValve] Valve Index: ", valveIndex_, " is null.");
         return;
     }
 
@@ -233,7 +734,7 @@ void Dispenser::trimValve(int value) {
 
 void Dispenser::resetTrimPositions() {
     if (valves_.size() == 0 || valveIndex_ > valves_.size()-1) {
-        Serial.println("[Dispenser][resetTrimPositions] No valves registered or selected.");
+        LOG_I("[Dispenser][resetTrimPositions] No valves registered or selected.");
         return;
     }
 
@@ -253,6 +754,14 @@ uint8_t Dispenser::registerPump(std::shared_ptr<Pump> pump) {
     return pumps_.size();
 };
 
+uint8_t Dispenser::getValveCount() {
+    return valves_.size();
+};
+
+uint8_t Dispenser::getPumpCount() {
+    return pumps_.size();
+};
+
 void Dispenser::registerCompletionCallback(DispenseCompleteCallback callback) {
     completionCallback_ = callback;
 };
\ No newline at end of file
@@ -2,7 +2,10 @@
 #include "Valve.h"
 #include "Pump.h"
 #include <memory>
-#include "HX711.h"
+#include "hal/Hal.h"
+#include "StabilityDetector.h"
+#include "LoadCell.h"
+#include "WeightEstimator.h"
 
 #pragma once
 
@@ -19,51 +22,168 @@ public:
         FINISHED,
     };
 
+    enum class StartMode {
+        AWAIT_SETTLE,   //Wait for the cup to settle after the move, then tare and open.
+        IMMEDIATE,      //Tray did not move, tare and open right away.
+        PREDICTIVE,     //Tray is about to arrive, tare on the latest samples and open now.
+    };
+
     enum class DispenseType {
         VALVE,
         PUMP,
     };
 
+    struct PumpChannel {
+        uint8_t pumpIndex;
+        float targetWeight;
+        float dispensedWeight = 0.0;
+        bool running = false;
+        uint32_t beginTimeStampMS = 0;
+        uint32_t endTimeStampMS = 0;
+    };
+
+    struct ValveControl {
+        float throttleWeight = 15.0; //Remaining grams at which the valve starts to throttle.
+        float approachTimeS = 1.5;   //Time the remaining weight should take to pour once throttling.
+        float minFlowRate = 2.0;     //g/s
+        float minOpening = 0.2;
+        float gain = 0.02;           //Opening change per g/s of flow error.
+    };
+
+    struct SettleReport {
+        uint32_t waitedMS = 0;
+        bool timedOut = false;
+    };
+
+    struct PourTiming {
+        uint32_t beginTimeStampMS = 0; //Device opened.
+        uint32_t closeTimeStampMS = 0; //Device commanded closed, the last pump for a concurrent pour.
+    };
+
     using DispenseCompleteCallback = std::function<void(DispenseType type, uint8_t index, float dispensedWeight)>;
+    using DripCreditCallback = std::function<void(const std::vector<float>& finalWeights)>; //One entry per channel of the departed pour.
 
-    Dispenser(uint8_t dat_pin, uint8_t sck_pin, float kFactor = 428.0, float emptyWeight = 0.0);
+    Dispenser(uint8_t dat_pin, uint8_t sck_pin, float kFactor = 428.0, float emptyWeight = 0.0, uint8_t rate_pin = LoadCell::NO_PIN);
     u_int8_t registerValve(std::shared_ptr<Valve> valve);
     u_int8_t registerPump(std::shared_ptr<Pump> pump);
+    uint8_t getValveCount();
+    uint8_t getPumpCount();
     
     // void beginDispensing(uint8_t valveOrPumpIndex, float targetWeight, DispenseType type);    
     
-    void beginDispensingPump(uint8_t pourDeviceIndex, float targetWeight);    
-    void beginDispensingValve(uint8_t pourDeviceIndex, float targetWeight);    
+    void beginDispensingPump(uint8_t pourDeviceIndex, float targetWeight, StartMode mode = StartMode::AWAIT_SETTLE);    
+    void beginDispensingValve(uint8_t pourDeviceIndex, float targetWeight, StartMode mode = StartMode::AWAIT_SETTLE);    
+    void beginDispensingPumps(const std::vector<PumpChannel>& channels, StartMode mode = StartMode::AWAIT_SETTLE);
+    uint32_t getActuationLatencyMS(DispenseType type, uint8_t pourDeviceIndex);
+    bool isConcurrent();
+    float getPumpDispensedWeight(uint8_t channel);
+    float getLastPourWeight();
 
     void registerCompletionCallback(DispenseCompleteCallback callback);
+    void setDripCreditCallback(DripCreditCallback callback);
+    void setDripThreshold(float gramsPerSecond);
+    bool captureBaseline();
+    bool canDepartEarly();
+    float departEarly();
     void abortDispensing();
     void heartbeat();
     void tare();
+    void setSampleRate(LoadCell::Rate rate);
+    bool isLoadCellQuietFor(uint32_t durationUS);
+    void setEstimator(std::unique_ptr<WeightEstimator> estimator);
     DispenserState getState();
     float getLatestWeight();
     float getAbsoluteWeight();
+    float getFlowRate();
+    void setProportionalValves(bool enabled);
+    void setValveControl(ValveControl control);
+    void setStabilityTolerance(float maxStdDev, float maxSlope, uint32_t windowMS);
+    bool isSettled();
+    SettleReport getLastSettleReport();
+    PourTiming getLastPourTiming();
     void setAllValves(Valve::Position position);    
     void trimValve(int value);
     void resetTrimPositions();
     void selectValveForTrim(uint32_t valveId, Valve::Position position);
-    std::unique_ptr<HX711> scale_;
+    void loadCalibration();
+    void saveCalibration();
+    void saveCalibrationIfChanged();
+    bool isCalibrationDirty();
+    float getScaleFactor();
+    void setScaleFactor(float kFactor);
+    std::unique_ptr<hal::LoadCellAdc> adc_;
+    std::unique_ptr<LoadCell> loadCell_;
+    std::unique_ptr<WeightEstimator> estimator_;
     
 
 private:
+    // Learned values as last written to NVS, a device is only rewritten once it drifted from them.
+    struct CalibrationRecord {
+        float inFlightWeight = 0.0;
+        uint32_t actuationLatencyMS = 0;
+        float flowRate = 0.0;
+    };
+
+    static const uint32_t CALIBRATION_SAVE_INTERVAL_MS = 5 * 60 * 1000;
+
+    float scaleFactor_;
+    int32_t offset_ = 0;    // Raw counts at zero, moved by tare().
+
     void resetDispensing_(bool skipCallback = false);
+    void beginPour_(StartMode mode);
+    void processSample_(const LoadCell::Sample& sample);
     void finishDispensing_();
+    void attributeConcurrentFlow_();
+    void learnPumpFlowRates_();
+    void learnInFlightWeight_();
+    float inFlightWeight_();
+    void controlValveFlow_();
+    bool awaitSettle_(uint32_t sinceMS, uint32_t timeoutMS, const char* phase);
+    void creditTrailingDrip_();
+    void snapshotCalibration_();
+    void tareTo_(int32_t zeroRaw);
+    void noteCalibrationChange_();
     DispenseCompleteCallback completionCallback_;
+    DripCreditCallback dripCreditCallback_;
+    float dripThreshold_ = 1.5; //g/s, above the estimator's flow noise at rest
+    bool trailing_ = false; //Departed before closure completed, drip is still being credited to that pour.
+    DispenseType trailingType_;
+    uint8_t trailingDeviceIndex_;
+    float trailingCloseWeight_;
+    float trailingCommittedWeight_;
+    std::vector<PumpChannel> trailingChannels_;
     std::vector<std::shared_ptr<Valve>> valves_;
     std::vector<std::shared_ptr<Pump>> pumps_;
     
     float targetWeight_;
     float latestWeight_;
+    float filteredWeight_ = 0.0; //Estimator mass without the prediction, for cup presence.
     uint8_t valveIndex_;    
     uint8_t pumpIndex_;
     uint8_t pourDeviceIndex_;
+    std::vector<PumpChannel> pumpChannels_;
+    bool concurrent_ = false;
+    float attributedWeight_ = 0.0;
+    float closeWeight_ = 0.0;
+    float lastPourWeight_ = 0.0;
+    float flowRate_ = 0.0;
+    bool newSample_ = false;
+    bool proportionalValves_ = false;
+    ValveControl valveControl_;
+    float valveOpening_ = 1.0;
+    StabilityDetector stability_;
+    SettleReport lastSettle_;
+    uint32_t pourBeginTimeStampMS_;
+    PourTiming lastPourTiming_;
+    bool latencyMeasured_ = true;
+    bool hasBaseline_ = false; //Settled reading taken before the tray moved, zero for a PREDICTIVE start.
+    int32_t baselineRaw_ = 0;
+    std::vector<CalibrationRecord> savedValves_;
+    std::vector<CalibrationRecord> savedPumps_;
+    bool calibrationDirty_ = false;
+    uint32_t lastCalibrationSaveMS_ = 0;
 
     float emptyWeight_;    
-    float filteredValue_;
     DispenseType dispenseType_;
     uint32_t awaitingClosureTimeStampMS_;
     uint32_t awaitingStabilityTimeStampMS_;
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <math.h>
+
+#pragma once
+
+// Fixed-memory histogram of unsigned values. Buckets are exact below 4, above that there are four
+// buckets per power of two, so a percentile is within 25% of the real value from 1 up to about
+// two million (2 s in microseconds) in 320 bytes. Larger values land in the last bucket; min and
+// max are always exact.
+class Histogram
+{
+public:
+    static const uint8_t SUB_BUCKETS = 4;
+    static const uint8_t BUCKETS = 80;
+
+    void add(uint32_t value) {
+        counts_[bucketOf_(value)]++;
+        count_++;
+        if (value < min_) {
+            min_ = value;
+        }
+        if (value > max_) {
+            max_ = value;
+        }
+    }
+
+    void reset() {
+        for (uint8_t i = 0; i < BUCKETS; i++) {
+            counts_[i] = 0;
+        }
+        count_ = 0;
+        min_ = UINT32_MAX;
+        max_ = 0;
+    }
+
+    uint32_t getCount() const { return count_; }
+    uint32_t getMin() const { return count_ == 0 ? 0 : min_; }
+    uint32_t getMax() const { return max_; }
+
+    // Upper edge of the bucket holding the given fraction (0..1) of the samples, clamped to the
+    // observed range so p100 is max and a single sample reads back exactly.
+    uint32_t percentile(float fraction) const {
+        if (count_ == 0) {
+            return 0;
+        }
+
+        uint32_t rank = (uint32_t)ceilf(fraction * count_);
+        if (rank < 1) {
+            rank = 1;
+        }
+
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < BUCKETS; i++) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint32_t edge = upperEdge_(i);
+                return edge < min_ ? min_ : (edge > max_ ? max_ : edge);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static uint8_t bucketOf_(uint32_t value) {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        uint8_t msb = 31 - __builtin_clz(value);
+        uint32_t index = (msb - 1) * SUB_BUCKETS + ((value >> (msb - 2)) & (SUB_BUCKETS - 1));
+        return index < BUCKETS ? index : BUCKETS - 1;
+    }
+
+    static uint32_t upperEdge_(uint8_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        uint8_t msb = index / SUB_BUCKETS + 1;
+        uint32_t sub = index % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (msb - 2)) - 1;
+    }
+
+    uint32_t counts_[BUCKETS] = {};
+    uint32_t count_ = 0;
+    uint32_t min_ = UINT32_MAX;
+    uint32_t max_ = 0;
+};
@@ -0,0 +1,66 @@
+#include "InputShaper.h"
+#include <math.h>
+
+static const float PI_F = 3.14159265f;
+static const float GRAVITY = 9.81f;
+
+std::vector<InputShaper::Impulse> InputShaper::design(Type type, float frequencyHz, float damping) {
+    std::vector<Impulse> impulses;
+    if (type == Type::NONE || frequencyHz <= 0.0f) {
+        impulses.push_back({1.0f, 0.0f});
+        return impulses;
+    }
+
+    float k = expf(-damping * PI_F / sqrtf(1.0f - damping * damping));
+    float halfPeriod = 1.0f / (2.0f * frequencyHz * sqrtf(1.0f - damping * damping));
+
+    if (type == Type::ZV) {
+        impulses.push_back({1.0f / (1.0f + k), 0.0f});
+        impulses.push_back({k / (1.0f + k), halfPeriod});
+    } else {
+        float d = 1.0f + 2.0f * k + k * k;
+        impulses.push_back({1.0f / d, 0.0f});
+        impulses.push_back({2.0f * k / d, halfPeriod});
+        impulses.push_back({k * k / d, 2.0f * halfPeriod});
+    }
+    return impulses;
+}
+
+// Residual vibration of the shaped sequence relative to a single unshaped impulse (0 = none, 1 = unshaped).
+float InputShaper::residualVibration(const std::vector<Impulse>& impulses, float frequencyHz, float damping) {
+    float omega = 2.0f * PI_F * frequencyHz;
+    float omegaD = omega * sqrtf(1.0f - damping * damping);
+    float tEnd = impulses.back().timeS;
+    float c = 0.0f;
+    float s = 0.0f;
+    for (const auto& impulse : impulses) {
+        float decay = expf(-damping * omega * (tEnd - impulse.timeS));
+        c += impulse.amplitude * decay * cosf(omegaD * impulse.timeS);
+        s += impulse.amplitude * decay * sinf(omegaD * impulse.timeS);
+    }
+    return sqrtf(c * c + s * s);
+}
+
+// First sloshing mode of a cylindrical cup: omega^2 = g * k * tanh(k * h) with k = 1.841 / R.
+float InputShaper::sloshFrequencyHz(float liquidMassG, float cupRadiusM) {
+    float k = 1.841f / cupRadiusM;
+    float height = (liquidMassG / 1000000.0f) / (PI_F * cupRadiusM * cupRadiusM); //Water, 1g per cm^3.
+    if (height <= 0.0f) {
+        return 0.0f;
+    }
+    return sqrtf(GRAVITY * k * tanhf(k * height)) / (2.0f * PI_F);
+}
+
+PendulumModel::PendulumModel(float frequencyHz, float damping) : omega_(2.0f * PI_F * frequencyHz), damping_(damping) {}
+
+void PendulumModel::step(float cartAccelerationMS2, float dtS) {
+    // Small angle pendulum in the accelerating cart frame, length chosen so that sqrt(g / L) = omega.
+    float length = GRAVITY / (omega_ * omega_);
+    float angularAcceleration = -omega_ * omega_ * angle_ - 2.0f * damping_ * omega_ * angularVelocity_ - cartAccelerationMS2 / length;
+    angularVelocity_ += angularAcceleration * dtS;
+    angle_ += angularVelocity_ * dtS;
+}
+
+float PendulumModel::getAmplitude() {
+    return sqrtf(angle_ * angle_ + (angularVelocity_ / omega_) * (angularVelocity_ / omega_));
+}
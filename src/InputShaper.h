@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <vector>
+
+#pragma once
+
+// Zero-vibration input shapers for moving a cup of liquid. A move is split into impulses whose
+// responses cancel the slosh mode at the given frequency and damping ratio.
+class InputShaper
+{
+public:
+    enum class Type {
+        NONE,
+        ZV,
+        ZVD,
+    };
+
+    struct Impulse {
+        float amplitude; //Fraction of the move, all impulses sum to 1.
+        float timeS;
+    };
+
+    static std::vector<Impulse> design(Type type, float frequencyHz, float damping);
+    static float residualVibration(const std::vector<Impulse>& impulses, float frequencyHz, float damping);
+    static float sloshFrequencyHz(float liquidMassG, float cupRadiusM);
+};
+
+// Damped pendulum stand-in for the first slosh mode, driven by the cart acceleration. Used on the
+// host to check shapers and acceleration limits against a simulated cup.
+class PendulumModel
+{
+public:
+    PendulumModel(float frequencyHz, float damping);
+    void step(float cartAccelerationMS2, float dtS);
+    float getAngle() { return angle_; }
+    float getAmplitude(); //Peak angle of the free oscillation from the current state.
+
+private:
+    float omega_;
+    float damping_;
+    float angle_ = 0.0;
+    float angularVelocity_ = 0.0;
+};
@@ -0,0 +1,133 @@
+#include "JobStats.h"
+#include "Logger.h"
+#include <algorithm>
+#include <math.h>
+
+template <typename T>
+void JobStats::Window<T>::add(T value) {
+    values[next] = value;
+    next = (next + 1) % WINDOW;
+    if (count < WINDOW) {
+        count++;
+    }
+}
+
+template <typename T>
+T JobStats::Window<T>::percentile(float fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    T sorted[WINDOW];
+    std::copy(values, values + count, sorted);
+    std::sort(sorted, sorted + count);
+    int rank = (int)ceilf(fraction * count) - 1;
+    return sorted[std::max(0, std::min(rank, (int)count - 1))];
+}
+
+void JobStats::record(const std::vector<StepTimeline>& job) {
+    lastJob_ = job;
+
+    for (const auto& step : job) {
+        if (step.completed == false) {
+            continue;
+        }
+
+        Rolling* station = rolling_(Scope::STATION, step.stationIndex);
+        if (station != nullptr) {
+            add_(*station, step);
+        }
+        Rolling* device = rolling_(Scope::DEVICE, deviceSlot(step.pump, step.deviceIndex));
+        if (device != nullptr) {
+            add_(*device, step);
+        }
+    }
+}
+
+void JobStats::add_(Rolling& rolling, const StepTimeline& step) {
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+        rolling.phases[i].add(std::min(step.phaseMS[i], (uint32_t)UINT16_MAX));
+    }
+    float overshoot = roundf((step.actualWeight - step.targetWeight) * 10.0f);
+    rolling.overshoot.add((int16_t)std::max(std::min(overshoot, (float)INT16_MAX), (float)INT16_MIN));
+}
+
+const std::vector<JobStats::StepTimeline>& JobStats::getLastJob() {
+    return lastJob_;
+}
+
+// Valves take the first slots, pumps follow, so one index covers both device kinds. Devices past
+// the table get an index no slot answers to.
+uint8_t JobStats::deviceSlot(bool pump, uint8_t deviceIndex) {
+    if (deviceIndex >= (pump ? MAX_PUMPS : MAX_VALVES)) {
+        return UINT8_MAX;
+    }
+    return pump ? MAX_VALVES + deviceIndex : deviceIndex;
+}
+
+uint8_t JobStats::getSlotCount(Scope scope) {
+    return scope == Scope::STATION ? MAX_STATIONS : MAX_VALVES + MAX_PUMPS;
+}
+
+JobStats::Rolling* JobStats::rolling_(Scope scope, uint8_t index) {
+    if (scope == Scope::STATION) {
+        return index < MAX_STATIONS ? &stations_[index] : nullptr;
+    }
+    return index < MAX_VALVES + MAX_PUMPS ? &devices_[index] : nullptr;
+}
+
+bool JobStats::getSummary(Scope scope, uint8_t index, Summary& summary) {
+    Rolling* rolling = rolling_(scope, index);
+    if (rolling == nullptr || rolling->overshoot.count == 0) {
+        return false;
+    }
+
+    summary.samples = rolling->overshoot.count;
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+        summary.p50MS[i] = rolling->phases[i].percentile(0.50f);
+        summary.p95MS[i] = rolling->phases[i].percentile(0.95f);
+    }
+    summary.overshootP5 = rolling->overshoot.percentile(0.05f) / 10.0f;
+    summary.overshootP50 = rolling->overshoot.percentile(0.50f) / 10.0f;
+    summary.overshootP95 = rolling->overshoot.percentile(0.95f) / 10.0f;
+    return true;
+}
+
+void JobStats::report() {
+    for (const auto& step : lastJob_) {
+        LOG_I("[JobStats][report] Step ", step.orderIndex, " st ", step.stationIndex, (step.pump ? " pump " : " valve "), step.deviceIndex,
+              ": mv ", step.phaseMS[0], " st ", step.phaseMS[1], " pr ", step.phaseMS[2], " cl ", step.phaseMS[3], " dr ", step.phaseMS[4],
+              "ms, ", step.actualWeight, "/", step.targetWeight, "g", (step.completed ? "" : " cancelled"));
+    }
+
+    // One line per slot to stay within a log record: p50/p95 ms of move, settle, pour, close and drip,
+    // then overshoot p5/p50/p95 in grams.
+    LOG_I("[JobStats][report] p50/p95 ms: mv st pr cl dr, overshoot p5/p50/p95 g");
+    const Scope scopes[] = {Scope::STATION, Scope::DEVICE};
+    for (Scope scope : scopes) {
+        for (uint8_t index = 0; index < getSlotCount(scope); index++) {
+            Summary summary;
+            if (getSummary(scope, index, summary) == false) {
+                continue;
+            }
+
+            const char* kind = scope == Scope::STATION ? "Station " : (index < MAX_VALVES ? "Valve " : "Pump ");
+            uint8_t number = (scope == Scope::DEVICE && index >= MAX_VALVES) ? index - MAX_VALVES : index;
+            LOG_I("[JobStats][report] ", kind, number, " n=", summary.samples,
+                  " ", summary.p50MS[0], "/", summary.p95MS[0], " ", summary.p50MS[1], "/", summary.p95MS[1],
+                  " ", summary.p50MS[2], "/", summary.p95MS[2], " ", summary.p50MS[3], "/", summary.p95MS[3],
+                  " ", summary.p50MS[4], "/", summary.p95MS[4],
+                  ", ", summary.overshootP5, "/", summary.overshootP50, "/", summary.overshootP95);
+        }
+    }
+}
+
+void JobStats::reset() {
+    lastJob_.clear();
+    for (auto& station : stations_) {
+        station = Rolling();
+    }
+    for (auto& device : devices_) {
+        device = Rolling();
+    }
+}
@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <vector>
+
+#pragma once
+
+// Timeline of every step of the last job and rolling statistics over the most recent steps per
+// station and per pour device. A step is split into the phases below; each is the wall time that
+// phase added to the job, so overlaps (predictive start, early departure) count once.
+class JobStats
+{
+public:
+    enum class Phase : uint8_t {
+        MOVE,       // Movement started -> tray at the station.
+        SETTLE,     // At the station -> device opened.
+        POUR,       // Device opened -> device commanded closed.
+        CLOSE,      // Commanded closed -> closure window over (scale settled or departed early).
+        DRIP,       // Closure window over -> step complete.
+    };
+
+    enum class Scope : uint8_t {
+        STATION = 1,
+        DEVICE = 2,
+    };
+
+    static const uint8_t PHASE_COUNT = 5;
+    static const uint8_t WINDOW = 32;
+    static const uint8_t MAX_STATIONS = 8;
+    static const uint8_t MAX_VALVES = 6;
+    static const uint8_t MAX_PUMPS = 6;
+
+    struct StepTimeline {
+        uint16_t orderId = 0;       // 0 when the job did not come from the order queue.
+        uint8_t orderIndex = 0;
+        uint8_t stationIndex = 0;
+        bool pump = false;
+        uint8_t deviceIndex = 0;
+        uint32_t phaseMS[PHASE_COUNT] = {};
+        float targetWeight = 0.0;
+        float actualWeight = 0.0;
+        bool completed = false;     // False for steps a cancel cut short, those stay out of the statistics.
+        bool fusedArrival = false;
+    };
+
+    struct Summary {
+        uint8_t samples = 0;
+        uint32_t p50MS[PHASE_COUNT] = {};
+        uint32_t p95MS[PHASE_COUNT] = {};
+        float overshootP5 = 0.0;    // Actual minus target, grams.
+        float overshootP50 = 0.0;
+        float overshootP95 = 0.0;
+    };
+
+    void record(const std::vector<StepTimeline>& job);
+    const std::vector<StepTimeline>& getLastJob();
+    bool getSummary(Scope scope, uint8_t index, Summary& summary);
+    uint8_t getSlotCount(Scope scope);
+    void report();
+    void reset();
+
+    static uint8_t deviceSlot(bool pump, uint8_t deviceIndex);
+
+private:
+    // Last WINDOW values, percentiles are taken on a sorted copy when asked for.
+    template <typename T>
+    struct Window {
+        T values[WINDOW];
+        uint8_t count = 0;
+        uint8_t next = 0;
+
+        void add(T value);
+        T percentile(float fraction) const;
+    };
+
+    struct Rolling {
+        Window<uint16_t> phases[PHASE_COUNT];
+        Window<int16_t> overshoot;    // Tenths of a gram.
+    };
+
+    void add_(Rolling& rolling, const StepTimeline& step);
+    Rolling* rolling_(Scope scope, uint8_t index);
+
+    std::vector<StepTimeline> lastJob_;
+    Rolling stations_[MAX_STATIONS];
+    Rolling devices_[MAX_VALVES + MAX_PUMPS];
+};
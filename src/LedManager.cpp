@@ -1,99 +1,185 @@
 #include "LedManager.h"
+#include "LedTables.h"
+#include "Logger.h"
+#include <algorithm>
 
 LedManager::LedManager(uint8_t dataPin) {
     numLeds_ = 75;
     dataPin_ = dataPin;    
-    FastLED.addLeds<NEOPIXEL, SDA>(leds_, 75);  // GRB ordering is assumed    
-    FastLED.clear();
-    FastLED.show();        
-    FastLED.setBrightness(100);
+    strip_ = hal::platform().createLedStrip(dataPin, 75);
+    strip_->setBrightness(100);
     currentFX_ = FX::NONE;
+    frameTimeUS_ = numLeds_ * hal::LedStrip::PIXEL_US + hal::LedStrip::LATCH_US;
+    // Rounded up so the home end of the travel lands on the last LED, like map() did.
+    trayScaleQ16_ = (((uint32_t)numLeds_ << 16) + TRAY_TRAVEL_STEPS - 1) / TRAY_TRAVEL_STEPS;
 }
 
 
 void LedManager::heartbeat() {
-    if (currentFX_ == FX::FADEIN) {
-        performFade_();
+    uint32_t now = hal::micros();
+    if (now - lastFrameUS_ < frameIntervalUS_) {
+        return;
     }
+
+    // Layers are composed only for a frame that can go out right away.
+    bool animating = layersChanged_ || currentFX_ == FX::FADEIN || pulsing_;
+    if ((animating == false && dirty_ == false) || strip_->isBusy()) {
+        return;
+    }
+    if (renderGate_ && renderGate_(frameTimeUS_) == false) {
+        return;
+    }
+
+    if (animating) {
+        render_();
+    }
+    if (dirty_ == false) {
+        lastFrameUS_ = now;
+        return;
+    }
+
+    strip_->show(leds_, numLeds_);
+    dirty_ = false;
+    lastFrameUS_ = now;
+    frameCount_++;
+}
+
+void LedManager::setRenderGate(RenderGate gate) {
+    renderGate_ = gate;
+}
+
+void LedManager::setMaxFrameRate(uint8_t fps) {
+    frameIntervalUS_ = 1000000 / std::max<uint8_t>(fps, 1);
+}
+
+// Only a changed pixel makes the frame dirty, redrawing the same picture every loop costs nothing.
+void LedManager::setPixel_(int index, hal::Rgb color) {
+    if (index < 0 || index >= numLeds_ || leds_[index] == color) {
+        return;
+    }
+    leds_[index] = color;
+    dirty_ = true;
+}
+
+void LedManager::report() {
+    LOG_I("[LedManager][report] Frames: ", frameCount_, " composed: ", renderTimes_.getCount(),
+        " render us p50: ", renderTimes_.percentile(0.5), " p99: ", renderTimes_.percentile(0.99), " max: ", renderTimes_.getMax());
 }
 
-void LedManager::setAllLeds(CRGB color, bool shouldRender) {
+void LedManager::resetRenderTimes() {
+    renderTimes_.reset();
+}
+
+// Fills the strip and drops every other layer.
+void LedManager::setAllLeds(hal::Rgb color) {
     currentColor_ = color;
     backgroundColor_ = color;
     currentBrightness_ = calculateBrightness_(color);    
-    bool changesExist = false;
-    for (int i = 0; i < numLeds_; i++) {
-        if (leds_[i] != color) {            
-            leds_[i] = color; // Correcting previous mistake: Direct assignment is used, not ->setRGB        
-            changesExist = true;
-        }
-    }
-
-    if (shouldRender == true) {
-        if (changesExist == true) {
-         FastLED.show();  
-        }
-    }    
+    currentFX_ = FX::NONE;
+    hideOverlays_();
+    layersChanged_ = true;
 }
 
-void LedManager::setLed(int index, CRGB color) {
-    leds_[index] = color; // Again, correcting: Direct assignment is correct
-    FastLED.show();
+void LedManager::setLed(int index, hal::Rgb color) {
+    setPixel_(index, color);
 }
 
 void LedManager::clearAllLeds() {
-    currentColor_ = CRGB::Black; // Using CRGB::Black for clarity
+    currentColor_ = hal::Rgb(); // Black
     
     for (int i = 0; i < numLeds_; i++) {
-        leds_[i] = CRGB::Black; // Using CRGB::Black for clarity
+        setPixel_(i, hal::Rgb());
     }
-    FastLED.show();
 }
 
 void LedManager::clearLed(int index) {
-    leds_[index] = CRGB::Black; // Using CRGB::Black for clarity
-    FastLED.show();
+    setPixel_(index, hal::Rgb());
 }
  
  
- void LedManager::fadeTo(CRGB startColor, CRGB targetColor, int durationMS) {
+ // The fade covers the whole strip, the tray, progress and pulse layers go away with it.
+ void LedManager::fadeTo(hal::Rgb startColor, hal::Rgb targetColor, int durationMS) {
+        hideOverlays_();
         if (targetColor == targetColor_ || targetColor == currentColor_) {
             return;
         }
         
         targetColor_ = targetColor;
+        setAllLeds(startColor);
         currentFX_ = FX::FADEIN;
         FXdurationMS_ = durationMS;
         startColor_ = startColor;
-        setAllLeds(startColor);
-        startTimestamp_ = millis(); // Capture the start time of the fade
+        startTimestamp_ = hal::millis(); // Capture the start time of the fade
     }
 
+    // Runs once per composed frame with an eased Q8 progress, the last frame lands on the target
+    // even when it comes late.
     void LedManager::performFade_() {
-        unsigned long currentTime = millis();
-        if (currentTime - startTimestamp_ <= FXdurationMS_) {
-            // Calculate the progress ratio based on elapsed time
-            float progress = (currentTime - startTimestamp_) / (float)FXdurationMS_;
-
-            CRGB newColor = CRGB(
-                lerp8by8(startColor_.r, targetColor_.r, progress * 255),
-                lerp8by8(startColor_.g, targetColor_.g, progress * 255),
-                lerp8by8(startColor_.b, targetColor_.b, progress * 255)
-            );
-
-            // Apply the new color to all LEDs
-            for (int j = 0; j < numLeds_; j++) {
-                leds_[j] = newColor;
+        uint32_t elapsed = hal::millis() - startTimestamp_;
+        if (elapsed >= FXdurationMS_) {
+            currentFX_ = FX::NONE;
+            currentColor_ = targetColor_;
+            return;
+        }
+        uint8_t fraction = LedTables::EASE_IN_OUT[(elapsed << 8) / FXdurationMS_];
+        currentColor_ = LedTables::blend(startColor_, targetColor_, fraction);
+    }
+
+    // Breathing level: a triangle over the period, eased and gamma corrected so it looks even.
+    uint8_t LedManager::pulseLevel_() {
+        uint32_t phase = (hal::millis() - pulseStartMS_) % pulsePeriodMS_;
+        uint32_t ramp = (phase * 510) / pulsePeriodMS_;
+        uint8_t triangle = ramp < 256 ? ramp : 510 - ramp;
+        return LedTables::GAMMA[LedTables::EASE_IN_OUT[triangle]];
+    }
+
+    // Composes the layers into the frame buffer. The per-LED work is a few compares and at most
+    // three 8-bit blends, divisions happen once per frame.
+    void LedManager::render_() {
+        uint32_t began = hal::micros();
+
+        if (currentFX_ == FX::FADEIN) {
+            performFade_();
+        }
+        uint8_t pulse = pulsing_ ? pulseLevel_() : 0;
+
+        uint8_t trayStart = trayEnd_ - TRAY_WIDTH;
+        uint8_t barStart = trayVisible_ ? trayStart : 0;
+        uint8_t barLength = trayVisible_ ? TRAY_WIDTH : numLeds_;
+        uint32_t barQ8 = progressQ8_ * barLength;    // Lit LEDs, Q8.
+        uint8_t barFull = barQ8 >> 8;
+        uint8_t barEdge = LedTables::GAMMA[barQ8 & 0xFF];
+
+        for (int i = 0; i < numLeds_; i++) {
+            hal::Rgb color = currentColor_;
+            if (trayVisible_ && i >= trayStart && i < trayEnd_) {
+                color = trayColor_;
             }
-            currentColor_ = newColor;
-            FastLED.show(); // Update the LEDs
-            
-            // End the effect once the progress completes
-            if (progress >= 1.0) {                
-                currentFX_ = FX::NONE;
-                currentColor_ = targetColor_;
+            if (progressVisible_ && i >= barStart) {
+                int lit = i - barStart;
+                if (lit < barFull) {
+                    color = progressColor_;
+                } else if (lit == barFull && lit < barLength) {
+                    color = LedTables::blend(color, progressColor_, barEdge);
+                }
             }
-        }   
+            if (pulse > 0) {
+                color = LedTables::blend(color, pulseColor_, pulse);
+            }
+            setPixel_(i, color);
+        }
+
+        layersChanged_ = false;
+        renderTimes_.add(hal::micros() - began);
+    }
+
+    void LedManager::hideOverlays_() {
+        if (trayVisible_ || progressVisible_ || pulsing_) {
+            layersChanged_ = true;
+        }
+        trayVisible_ = false;
+        progressVisible_ = false;
+        pulsing_ = false;
     }
 // void LedManager::fadeTo(CRGB startColor, CRGB targetColor, int durationMS) {    
 //     if (targetColor == targetColor_ || targetColor == currentColor_) {        
@@ -141,31 +227,78 @@ void LedManager::clearLed(int index) {
 // }
 
 
-uint8_t LedManager::calculateBrightness_(CRGB color) {
-    return max(color.r, max(color.g, color.b));
+uint8_t LedManager::calculateBrightness_(hal::Rgb color) {
+    return std::max(color.r, std::max(color.g, color.b));
 }
 
-void LedManager::setRange(uint8_t start, uint8_t end, CRGB color) {
-    setAllLeds(backgroundColor_, false);
-    for (int i = start; i < end; i++) {
-        leds_[i] = color;
+void LedManager::setRange(uint8_t start, uint8_t end, hal::Rgb color) {
+    for (int i = 0; i < numLeds_; i++) {
+        setPixel_(i, (i >= start && i < end) ? color : backgroundColor_);
     }
-    FastLED.show();
 }
 
-void LedManager::trackTray(uint32_t position, CRGB color, CRGB backgroundColor) {
+// Called every loop while the carriage moves, it only marks the layers changed when the window
+// lands on another LED. The background replaces the fill and stops a running fade.
+void LedManager::trackTray(uint32_t position, hal::Rgb color, hal::Rgb backgroundColor) {
+    uint32_t stepsFromHome = position < TRAY_TRAVEL_STEPS ? TRAY_TRAVEL_STEPS - position : 0;
+    uint32_t ledIndex = (stepsFromHome * trayScaleQ16_) >> 16;
+    if (ledIndex < TRAY_WIDTH) {
+        ledIndex = TRAY_WIDTH;
+    }
+
+    if (trayVisible_ && ledIndex == trayEnd_ && color == trayColor_ && backgroundColor == currentColor_ && currentFX_ == FX::NONE) {
+        return;
+    }
     backgroundColor_ = backgroundColor;
-    int ledIndex = map(position, 2340, 0, 0, numLeds_); 
-    if (ledIndex<=14) {ledIndex = 14;}
-    setRange(ledIndex-14, ledIndex, color);    
+    currentColor_ = backgroundColor;
+    currentFX_ = FX::NONE;
+    trayVisible_ = true;
+    trayEnd_ = ledIndex;
+    trayColor_ = color;
+    layersChanged_ = true;
 }
 
-bool LedManager::fadedComplete() {
-    if (currentFX_ == FX::NONE  && currentColor_ == targetColor_) {
-        return true;
+// Fills from the home side of the tray window, or of the strip when the tray is not tracked.
+void LedManager::setProgress(uint16_t permille, hal::Rgb color) {
+    uint16_t progressQ8 = ((uint32_t)std::min<uint16_t>(permille, 1000) << 8) / 1000;
+    if (progressVisible_ && progressQ8 == progressQ8_ && color == progressColor_) {
+        return;
+    }
+    progressVisible_ = true;
+    progressQ8_ = progressQ8;
+    progressColor_ = color;
+    layersChanged_ = true;
+}
+
+void LedManager::hideProgress() {
+    if (progressVisible_) {
+        progressVisible_ = false;
+        layersChanged_ = true;
     }
 }
 
+// Keeps its phase when called again with the same pulse, so it can be set every loop.
+void LedManager::setPulse(hal::Rgb color, uint16_t periodMS) {
+    if (pulsing_ && color == pulseColor_ && periodMS == pulsePeriodMS_) {
+        return;
+    }
+    pulsing_ = true;
+    pulseColor_ = color;
+    pulsePeriodMS_ = std::max<uint16_t>(periodMS, 1);
+    pulseStartMS_ = hal::millis();
+}
+
+void LedManager::stopPulse() {
+    if (pulsing_) {
+        pulsing_ = false;
+        layersChanged_ = true;
+    }
+}
+
+bool LedManager::fadedComplete() {
+    return currentFX_ == FX::NONE && currentColor_ == targetColor_;
+}
+
 bool LedManager::isFading() {
     return currentFX_ == FX::FADEIN;
 }
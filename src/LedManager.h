@@ -1,11 +1,19 @@
 
 
 #include <Arduino.h>
-#include <FastLED.h>
+#include <functional>
 #include <memory>
+#include "Histogram.h"
+#include "hal/Hal.h"
 
 #pragma once
 
+// Setters only draw into the frame buffer. heartbeat() advances the effect and sends the frame when
+// it changed, at most at the frame rate, once the strip is free and the render gate allows it.
+// Effects are layers composed bottom to top: the fill (fadeTo/setAllLeds), the tray window
+// (trackTray), the step progress bar inside it (setProgress) and a pulse over the whole strip
+// (setPulse). Composing is integer only with the same per-LED work whatever is on, and only runs
+// for a frame that can go out; its time is kept in getRenderTimes().
 class LedManager
 {    
 public:    
@@ -15,39 +23,79 @@ enum class FX {
     FADEIN
 };
 
+// Asked before a frame goes out with the time the strip needs for it, false holds the frame back.
+using RenderGate = std::function<bool(uint32_t frameUS)>;
+
 LedManager(uint8_t dataPin);
 void heartbeat();
+void setRenderGate(RenderGate gate);
+void setMaxFrameRate(uint8_t fps);
+uint32_t getFrameCount() { return frameCount_; }
+const Histogram& getRenderTimes() { return renderTimes_; }
+void report();
+void resetRenderTimes();
 
-void setAllLeds(CRGB color, bool shouldRender = true);
-void setLed(int index, CRGB color);
+void setAllLeds(hal::Rgb color);
+void setLed(int index, hal::Rgb color);
 void clearAllLeds();
 void clearLed(int index);
-void fadeTo(CRGB startColor, CRGB targetColor, int durationMS);
-void setRange(uint8_t start, uint8_t end, CRGB color);
-void trackTray(uint32_t position, CRGB color, CRGB backgroundColor);
+void fadeTo(hal::Rgb startColor, hal::Rgb targetColor, int durationMS);
+void setRange(uint8_t start, uint8_t end, hal::Rgb color);
+void trackTray(uint32_t position, hal::Rgb color, hal::Rgb backgroundColor);
+void setProgress(uint16_t permille, hal::Rgb color);
+void hideProgress();
+void setPulse(hal::Rgb color, uint16_t periodMS);
+void stopPulse();
 void fadeShow();
 bool fadedComplete();
 bool isFading();
-CRGB getCurrentColor() { return currentColor_; }
+hal::Rgb getCurrentColor() { return currentColor_; }
 FX getCurrentFX() { return currentFX_; }
    
         
 private:    
-    uint8_t calculateBrightness_(CRGB color);
+    static const uint32_t TRAY_TRAVEL_STEPS = 2340;  // Carriage steps across the strip.
+    static const uint8_t TRAY_WIDTH = 14;           // LEDs under the tray.
+
+    uint8_t calculateBrightness_(hal::Rgb color);
+    void render_();
     void performFade_();
+    uint8_t pulseLevel_();
+    void hideOverlays_();
+    void setPixel_(int index, hal::Rgb color);
     int numLeds_;
     uint8_t dataPin_;  
+    std::unique_ptr<hal::LedStrip> strip_;
     int prevTimeStamp_; 
-    CRGB leds_[76];
-    CRGB backgroundColor_;
+    hal::Rgb leds_[76];
+    hal::Rgb backgroundColor_;
     FX currentFX_ = FX::NONE;
     uint32_t FXdurationMS_;
     uint32_t FXPeriodMS_;
     uint32_t startTimestamp_;
-    CRGB startColor_;
-    CRGB targetColor_;
-    CRGB currentColor_; 
-    CRGB colorWheel_[3] = {CRGB::Red, CRGB::Green, CRGB::Blue}; 
+    hal::Rgb startColor_;
+    hal::Rgb targetColor_;
+    hal::Rgb currentColor_; 
+    hal::Rgb colorWheel_[3] = {hal::Rgb(255, 0, 0), hal::Rgb(0, 255, 0), hal::Rgb(0, 0, 255)}; 
     uint8_t currentBrightness_;   
     uint8_t showStepIndex_ = 0;   
+    bool dirty_ = false;
+    RenderGate renderGate_;
+    uint32_t frameIntervalUS_ = 1000000 / 30;
+    uint32_t frameTimeUS_;
+    uint32_t lastFrameUS_ = 0;
+    uint32_t frameCount_ = 0;
+    bool layersChanged_ = false;
+    bool trayVisible_ = false;
+    uint8_t trayEnd_ = TRAY_WIDTH;      // One past the last LED of the window.
+    hal::Rgb trayColor_;
+    uint32_t trayScaleQ16_;             // LEDs per carriage step, Q16.
+    bool progressVisible_ = false;
+    uint16_t progressQ8_ = 0;           // 0..256 of the bar.
+    hal::Rgb progressColor_;
+    bool pulsing_ = false;
+    hal::Rgb pulseColor_;
+    uint16_t pulsePeriodMS_ = 1000;
+    uint32_t pulseStartMS_ = 0;
+    Histogram renderTimes_;             // Composition time per frame, microseconds.
 };
@@ -0,0 +1,56 @@
+#include <stdint.h>
+#include <array>
+#include "hal/Hal.h"
+
+#pragma once
+
+// Lookup tables and 8-bit fixed-point helpers for LedManager's effects. The tables are built by
+// the compiler, so they cost flash and no boot time, and an effect frame needs no floats.
+namespace LedTables
+{
+    namespace detail
+    {
+        // x^(1/5) by Newton's method, only ever evaluated at compile time.
+        constexpr double fifthRoot(double x) {
+            double y = 1.0;
+            for (int i = 0; i < 40; i++) {
+                y = y - (y * y * y * y * y - x) / (5 * y * y * y * y);
+            }
+            return y;
+        }
+
+        // Perceived brightness -> PWM duty, gamma 2.2.
+        constexpr std::array<uint8_t, 256> makeGamma() {
+            std::array<uint8_t, 256> table = {};
+            for (int i = 1; i < 256; i++) {
+                double x = i / 255.0;
+                table[i] = (uint8_t)(x * x * fifthRoot(x) * 255.0 + 0.5);
+            }
+            return table;
+        }
+
+        // Smoothstep, 3t^2 - 2t^3, in integers.
+        constexpr std::array<uint8_t, 256> makeEaseInOut() {
+            std::array<uint8_t, 256> table = {};
+            for (uint32_t t = 0; t < 256; t++) {
+                table[t] = (uint8_t)((t * t * (3 * 255 - 2 * t) + 255 * 255 / 2) / (255 * 255));
+            }
+            return table;
+        }
+    }
+
+    constexpr std::array<uint8_t, 256> GAMMA = detail::makeGamma();
+    constexpr std::array<uint8_t, 256> EASE_IN_OUT = detail::makeEaseInOut();
+
+    // from + (to - from) * fraction / 256, the same rounding as FastLED's lerp8by8().
+    inline uint8_t lerp8(uint8_t from, uint8_t to, uint8_t fraction) {
+        if (to > from) {
+            return from + (uint8_t)(((to - from) * fraction) >> 8);
+        }
+        return from - (uint8_t)(((from - to) * fraction) >> 8);
+    }
+
+    inline hal::Rgb blend(hal::Rgb from, hal::Rgb to, uint8_t fraction) {
+        return hal::Rgb(lerp8(from.r, to.r, fraction), lerp8(from.g, to.g, fraction), lerp8(from.b, to.b, fraction));
+    }
+}
@@ -0,0 +1,110 @@
+#include "LoadCell.h"
+#include "Logger.h"
+
+LoadCell::LoadCell(hal::LoadCellAdc* adc, uint8_t dat_pin, uint8_t rate_pin) : adc_(adc), dat_pin_(dat_pin), rate_pin_(rate_pin) {
+    if (rate_pin_ != NO_PIN) {
+        hal::gpio().pinMode(rate_pin_, OUTPUT);
+        hal::gpio().digitalWrite(rate_pin_, LOW);
+    }
+}
+
+void LoadCell::begin(uint8_t core, uint8_t priority) {
+#ifdef ARDUINO
+    if (task_ != nullptr) {
+        return;
+    }
+
+    xTaskCreatePinnedToCore(acquisitionTask_, "LoadCell", 3072, this, priority, &task_, core);
+    hal::gpio().attachInterrupt(dat_pin_, dataReadyISR_, this, FALLING);
+    LOG_I("[LoadCell][begin] Acquisition task started on core ", core);
+#endif
+}
+
+// DOUT also toggles while the task shifts a conversion out, those extra wake ups find the
+// HX711 not ready and go straight back to sleep.
+void IRAM_ATTR LoadCell::dataReadyISR_(void* arg, uint32_t timeStampUS) {
+    LoadCell* loadCell = static_cast<LoadCell*>(arg);
+    loadCell->dataReadyTimeStampUS_ = timeStampUS;
+#ifdef ARDUINO
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(loadCell->task_, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+#endif
+}
+
+void LoadCell::acquisitionTask_(void* arg) {
+    static_cast<LoadCell*>(arg)->acquire_();
+}
+
+void LoadCell::acquire_() {
+#ifdef ARDUINO
+    for (;;) {
+        // The timeout keeps sampling alive should an edge ever be missed.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(150));
+        poll_();
+    }
+#endif
+}
+
+bool LoadCell::poll_() {
+    if (adc_->isReady() == false) {
+        return false;
+    }
+
+    Sample sample;
+    sample.timeStampUS = dataReadyTimeStampUS_;
+    sample.raw = adc_->read();
+    uint32_t now = hal::micros();
+    if (now - sample.timeStampUS > getSamplePeriodUS()) {
+        sample.timeStampUS = now; //Woke on the timeout, the edge time is stale.
+    }
+    ring_.push(sample);
+    lastSampleUS_ = sample.timeStampUS;
+    sampleCount_++;
+    return true;
+}
+
+bool LoadCell::read(Sample& sample) {
+#ifndef ARDUINO
+    poll_();
+#endif
+    return ring_.pop(sample);
+}
+
+// The HX711 output rate is strapped by its RATE pin, only available when that pin is wired to a GPIO.
+void LoadCell::setRate(Rate rate) {
+    if (rate_pin_ == NO_PIN) {
+        LOG_W("[LoadCell][setRate] RATE pin not wired, staying at ", rate_ == Rate::SPS_80 ? 80 : 10, "Hz");
+        return;
+    }
+
+    rate_ = rate;
+    hal::gpio().digitalWrite(rate_pin_, rate_ == Rate::SPS_80 ? HIGH : LOW);
+    LOG_I("[LoadCell][setRate] Sample rate set to ", rate_ == Rate::SPS_80 ? 80 : 10, "Hz");
+}
+
+LoadCell::Rate LoadCell::getRate() {
+    return rate_;
+}
+
+uint32_t LoadCell::getSamplePeriodUS() {
+    return rate_ == Rate::SPS_80 ? 12500 : 100000;
+}
+
+uint32_t LoadCell::getDroppedCount() {
+    return ring_.getDroppedCount();
+}
+
+uint32_t LoadCell::getSampleCount() {
+    return sampleCount_;
+}
+
+// True when the next durationUS neither reach the next conversion nor overlap the read of the last
+// one. The HX711 converts continuously, the phase of the last sample predicts the next edge.
+bool LoadCell::isQuietFor(uint32_t durationUS) {
+    uint32_t period = getSamplePeriodUS();
+    uint32_t phase = (hal::micros() - lastSampleUS_) % period;
+    return phase >= READ_GUARD_US && phase + durationUS < period;
+}
@@ -0,0 +1,53 @@
+#include "Arduino.h"
+#include "SampleRing.h"
+#include "hal/Hal.h"
+
+#pragma once
+
+// Owns the HX711 bus. A dedicated task wakes on the DOUT data-ready edge, reads every conversion and
+// pushes it with its timestamp into a lock-free ring, so sample timing no longer depends on loop().
+// Host builds have no task, read() polls the ADC instead.
+class LoadCell
+{
+public:
+    static const uint8_t NO_PIN = 0xFF;
+    static const uint32_t READ_GUARD_US = 500;  // After a data-ready edge, covers the task waking and shifting the conversion out.
+
+    enum class Rate {
+        SPS_10,
+        SPS_80,
+    };
+
+    struct Sample {
+        int32_t raw;
+        uint32_t timeStampUS;
+    };
+
+    LoadCell(hal::LoadCellAdc* adc, uint8_t dat_pin, uint8_t rate_pin = NO_PIN);
+    void begin(uint8_t core = 1, uint8_t priority = 3);
+    bool read(Sample& sample);
+    void setRate(Rate rate);
+    Rate getRate();
+    uint32_t getSamplePeriodUS();
+    uint32_t getDroppedCount();
+    uint32_t getSampleCount();
+    bool isQuietFor(uint32_t durationUS);
+
+private:
+    static void dataReadyISR_(void* arg, uint32_t timeStampUS);
+    static void acquisitionTask_(void* arg);
+    void acquire_();
+    bool poll_();
+
+    hal::LoadCellAdc* adc_;
+    uint8_t dat_pin_;
+    uint8_t rate_pin_;
+    Rate rate_ = Rate::SPS_10;
+#ifdef ARDUINO
+    TaskHandle_t task_ = nullptr;
+#endif
+    volatile uint32_t dataReadyTimeStampUS_ = 0;
+    volatile uint32_t lastSampleUS_ = 0;
+    uint32_t sampleCount_ = 0;
+    SampleRing<Sample, 64> ring_;
+};
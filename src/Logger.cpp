@@ -0,0 +1,141 @@
+#include "Logger.h"
+#ifndef ARDUINO
+#include "hal/Hal.h"
+#include <mutex>
+#include <stdio.h>
+#endif
+
+namespace {
+    const char levelLetters[] = {'?', 'E', 'W', 'I', 'D'};
+}
+
+// Static storage, nothing is allocated at run time.
+uint32_t Logger::dropped_ = 0;
+uint32_t Logger::logged_ = 0;
+
+uint32_t Logger::getDroppedCount() {
+    return dropped_;
+}
+
+uint32_t Logger::getLoggedCount() {
+    return logged_;
+}
+
+#ifdef ARDUINO
+Logger::Record Logger::ring_[Logger::RING_SIZE];
+portMUX_TYPE Logger::lock_ = portMUX_INITIALIZER_UNLOCKED;
+uint32_t Logger::head_ = 0;
+uint32_t Logger::tail_ = 0;
+TaskHandle_t Logger::task_ = nullptr;
+
+void Logger::begin(uint8_t core, uint8_t priority) {
+    if (task_ != nullptr) {
+        return;
+    }
+    xTaskCreatePinnedToCore(drainTask_, "Logger", 3072, nullptr, priority, &task_, core);
+}
+
+// Several tasks log, so the slot is claimed under a spinlock. Only a bounded memcpy runs inside it.
+void Logger::push_(Level level, const char* text, size_t length) {
+    portENTER_CRITICAL(&lock_);
+    if (head_ - tail_ >= RING_SIZE) {
+        dropped_++;
+        portEXIT_CRITICAL(&lock_);
+        return;
+    }
+    Record& record = ring_[head_ % RING_SIZE];
+    record.timeStampMS = millis();
+    record.level = level;
+    record.length = length;
+    memcpy(record.text, text, length);
+    head_++;
+    logged_++;
+    portEXIT_CRITICAL(&lock_);
+}
+
+bool Logger::pop_(Record& record) {
+    portENTER_CRITICAL(&lock_);
+    if (tail_ == head_) {
+        portEXIT_CRITICAL(&lock_);
+        return false;
+    }
+    record = ring_[tail_ % RING_SIZE];
+    tail_++;
+    portEXIT_CRITICAL(&lock_);
+    return true;
+}
+
+void Logger::drainTask_(void* arg) {
+    Record record;
+    char prefix[24];
+    uint32_t reportedDropped = 0;
+    for (;;) {
+        while (pop_(record)) {
+            int length = snprintf(prefix, sizeof(prefix), "[%lu][%c]", (unsigned long)record.timeStampMS, levelLetters[(uint8_t)record.level]);
+            Serial.write((const uint8_t*)prefix, length);
+            Serial.write((const uint8_t*)record.text, record.length);
+            Serial.write((const uint8_t*)"\r\n", 2);
+        }
+
+        if (dropped_ != reportedDropped) {
+            int length = snprintf(prefix, sizeof(prefix), "[Logger] dropped %lu", (unsigned long)(dropped_ - reportedDropped));
+            Serial.write((const uint8_t*)prefix, length);
+            Serial.write((const uint8_t*)"\r\n", 2);
+            reportedDropped = dropped_;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+#else
+void Logger::begin(uint8_t core, uint8_t priority) {
+}
+
+void Logger::push_(Level level, const char* text, size_t length) {
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+    printf("[%lu][%c]%.*s\n", (unsigned long)hal::millis(), levelLetters[(uint8_t)level], (int)length, text);
+    logged_++;
+}
+#endif
+
+void Logger::Line::append(const char* value) {
+    while (*value != '\0' && length < RECORD_SIZE - 1) {
+        text[length++] = *value++;
+    }
+    text[length] = '\0';
+}
+
+void Logger::Line::append(char value) {
+    char text[2] = {value, '\0'};
+    append(text);
+}
+
+// Same rendering as Arduino's String(bool).
+void Logger::Line::append(bool value) {
+    append(value ? "1" : "0");
+}
+
+void Logger::Line::append(Hex value) {
+    char text[12];
+    snprintf(text, sizeof(text), "%lx", (unsigned long)value.value);
+    append(text);
+}
+
+void Logger::Line::appendSigned(long long value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%lld", value);
+    append(text);
+}
+
+void Logger::Line::appendUnsigned(unsigned long long value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%llu", value);
+    append(text);
+}
+
+// Two decimals, like String(float).
+void Logger::Line::appendFloat(double value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%.2f", value);
+    append(text);
+}
@@ -0,0 +1,128 @@
+#include "Arduino.h"
+#include <string>
+#include <type_traits>
+
+#pragma once
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Levels above LOG_LEVEL compile to nothing, their arguments are not even evaluated. They still
+// sit in a dead branch so they keep type-checking and don't leave log-only variables unused.
+#define LOG_DISCARD_(...) do { if (false) Logger::log(Logger::Level::DEBUG, __VA_ARGS__); } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(...) Logger::log(Logger::Level::ERROR, __VA_ARGS__)
+#else
+#define LOG_E(...) LOG_DISCARD_(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(...) Logger::log(Logger::Level::WARN, __VA_ARGS__)
+#else
+#define LOG_W(...) LOG_DISCARD_(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(...) Logger::log(Logger::Level::INFO, __VA_ARGS__)
+#else
+#define LOG_I(...) LOG_DISCARD_(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(...) Logger::log(Logger::Level::DEBUG, __VA_ARGS__)
+#else
+#define LOG_D(...) LOG_DISCARD_(__VA_ARGS__)
+#endif
+
+// Log lines are built from their pieces straight into a fixed record, LOG_I("[Class][method] w: ", w, "g"),
+// copied into a preallocated ring and written to the UART by a low priority task. Callers never
+// allocate and never wait on the serial port, a full ring drops the line and counts it.
+// Host builds have no task, lines go straight to stdout stamped with the HAL clock.
+class Logger
+{
+public:
+    enum class Level : uint8_t {
+        ERROR = 1,
+        WARN,
+        INFO,
+        DEBUG,
+    };
+
+    struct Hex {
+        uint32_t value;
+    };
+
+    static const size_t RECORD_SIZE = 128;
+    static const size_t RING_SIZE = 32;
+
+    static void begin(uint8_t core = 0, uint8_t priority = 1);
+    static uint32_t getDroppedCount();
+    static uint32_t getLoggedCount();
+
+    template <typename... Args>
+    static void log(Level level, const Args&... args) {
+        Line line;
+        (line.append(args), ...);
+        push_(level, line.text, line.length);
+    }
+
+private:
+    struct Line {
+        char text[RECORD_SIZE];
+        size_t length = 0;
+
+        void append(const char* value);
+        void append(const std::string& value) { append(value.c_str()); }
+        void append(const String& value) { append(value.c_str()); }
+        void append(char value);
+        void append(bool value);
+        void append(Hex value);
+        void appendSigned(long long value);
+        void appendUnsigned(unsigned long long value);
+        void appendFloat(double value);
+
+        template <typename T>
+        typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type append(T value) {
+            if (std::is_floating_point<T>::value) {
+                appendFloat((double)value);
+            } else if (std::is_signed<T>::value) {
+                appendSigned((long long)value);
+            } else {
+                appendUnsigned((unsigned long long)value);
+            }
+        }
+    };
+
+    struct Record {
+        uint32_t timeStampMS;
+        Level level;
+        uint8_t length;
+        char text[RECORD_SIZE];
+    };
+
+    static uint32_t dropped_;
+    static uint32_t logged_;
+#ifdef ARDUINO
+    static Record ring_[RING_SIZE];
+    static portMUX_TYPE lock_;
+    static uint32_t head_;
+    static uint32_t tail_;
+    static TaskHandle_t task_;
+#endif
+
+    static void push_(Level level, const char* text, size_t length);
+    static bool pop_(Record& record);
+    static void drainTask_(void* arg);
+};
+
+inline Logger::Hex LogHex(uint32_t value) {
+    return Logger::Hex{value};
+}
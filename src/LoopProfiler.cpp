@@ -0,0 +1,112 @@
+#include "LoopProfiler.h"
+#include "Logger.h"
+#include <string.h>
+
+uint8_t LoopProfiler::addComponent(const char* name, uint32_t deadlineUS) {
+    if (componentCount_ >= MAX_COMPONENTS) {
+        LOG_W("[LoopProfiler][addComponent] Too many components, dropping ", name);
+        return MAX_COMPONENTS - 1;
+    }
+
+    components_[componentCount_].name = name;
+    components_[componentCount_].deadlineUS = deadlineUS;
+    return componentCount_++;
+}
+
+void LoopProfiler::setDeadline(uint8_t component, uint32_t deadlineUS) {
+    components_[component].deadlineUS = deadlineUS;
+}
+
+void LoopProfiler::begin(uint8_t component) {
+    components_[component].startUS = hal::micros();
+}
+
+void LoopProfiler::end(uint8_t component) {
+    Component& entry = components_[component];
+    record_(entry, hal::micros() - entry.startUS);
+}
+
+// The first tick only starts the clock, there is no period to record yet.
+void LoopProfiler::tick(uint8_t component) {
+    Component& entry = components_[component];
+    uint32_t now = hal::micros();
+    if (entry.running) {
+        record_(entry, now - entry.startUS);
+    }
+    entry.startUS = now;
+    entry.running = true;
+}
+
+void LoopProfiler::record_(Component& component, uint32_t elapsedUS) {
+    component.histogram.add(elapsedUS);
+    if (component.deadlineUS != 0 && elapsedUS > component.deadlineUS) {
+        component.deadlineMisses++;
+    }
+}
+
+uint8_t LoopProfiler::getComponentCount() {
+    return componentCount_;
+}
+
+LoopProfiler::Summary LoopProfiler::getSummary(uint8_t component) {
+    const Component& entry = components_[component];
+    Summary summary;
+    summary.name = entry.name;
+    summary.count = entry.histogram.getCount();
+    summary.minUS = entry.histogram.getMin();
+    summary.p50US = entry.histogram.percentile(0.50f);
+    summary.p99US = entry.histogram.percentile(0.99f);
+    summary.maxUS = entry.histogram.getMax();
+    summary.deadlineUS = entry.deadlineUS;
+    summary.deadlineMisses = entry.deadlineMisses;
+    return summary;
+}
+
+// Snapshot for the diagnostics characteristic, little endian:
+//   [count:u8] then per component [nameLength:u8][name][samples:u32][min:u32][p50:u32][p99:u32]
+//   [max:u32][deadline:u32][misses:u32], times in microseconds.
+// Components that don't fit in capacity are left out, count says how many made it.
+size_t LoopProfiler::encode(uint8_t* out, size_t capacity) {
+    if (capacity < 1) {
+        return 0;
+    }
+
+    size_t length = 1;
+    uint8_t encoded = 0;
+    for (uint8_t i = 0; i < componentCount_; i++) {
+        Summary summary = getSummary(i);
+        size_t nameLength = strnlen(summary.name, MAX_NAME_LENGTH);
+        if (length + 1 + nameLength + 7 * 4 > capacity) {
+            break;
+        }
+
+        out[length++] = nameLength;
+        memcpy(out + length, summary.name, nameLength);
+        length += nameLength;
+
+        const uint32_t fields[] = {summary.count, summary.minUS, summary.p50US, summary.p99US, summary.maxUS, summary.deadlineUS, summary.deadlineMisses};
+        for (uint32_t field : fields) {
+            for (uint8_t byte = 0; byte < 4; byte++) {
+                out[length++] = (field >> (8 * byte)) & 0xFF;
+            }
+        }
+        encoded++;
+    }
+    out[0] = encoded;
+    return length;
+}
+
+void LoopProfiler::report() {
+    for (uint8_t i = 0; i < componentCount_; i++) {
+        Summary summary = getSummary(i);
+        LOG_I("[LoopProfiler][report] ", summary.name, ": n=", summary.count, " min ", summary.minUS, "us p50 ", summary.p50US, "us p99 ", summary.p99US, "us max ", summary.maxUS, "us, ", summary.deadlineMisses, " over ", summary.deadlineUS, "us");
+    }
+}
+
+void LoopProfiler::reset() {
+    for (uint8_t i = 0; i < componentCount_; i++) {
+        components_[i].histogram.reset();
+        components_[i].deadlineMisses = 0;
+        components_[i].running = false;
+    }
+}
@@ -0,0 +1,53 @@
+#include "Arduino.h"
+#include "Histogram.h"
+#include "hal/Hal.h"
+
+#pragma once
+
+// Execution time of each component of the control loop, plus the loop period itself, kept in
+// fixed-memory histograms. begin()/end() bracket a component, tick() records the time since its
+// previous tick (the period). A sample over the component's deadline counts as a miss.
+// Only the loop task may touch the profiler; the BLE side gets a snapshot through encode().
+class LoopProfiler
+{
+public:
+    static const uint8_t MAX_COMPONENTS = 12;
+    static const uint8_t MAX_NAME_LENGTH = 12;
+
+    struct Summary {
+        const char* name = "";
+        uint32_t count = 0;
+        uint32_t minUS = 0;
+        uint32_t p50US = 0;
+        uint32_t p99US = 0;
+        uint32_t maxUS = 0;
+        uint32_t deadlineUS = 0;
+        uint32_t deadlineMisses = 0;
+    };
+
+    uint8_t addComponent(const char* name, uint32_t deadlineUS);
+    void setDeadline(uint8_t component, uint32_t deadlineUS);
+    void begin(uint8_t component);
+    void end(uint8_t component);
+    void tick(uint8_t component);
+    uint8_t getComponentCount();
+    Summary getSummary(uint8_t component);
+    size_t encode(uint8_t* out, size_t capacity);
+    void report();
+    void reset();
+
+private:
+    struct Component {
+        const char* name = "";
+        uint32_t deadlineUS = 0;
+        uint32_t startUS = 0;
+        uint32_t deadlineMisses = 0;
+        bool running = false;
+        Histogram histogram;
+    };
+
+    void record_(Component& component, uint32_t elapsedUS);
+
+    Component components_[MAX_COMPONENTS];
+    uint8_t componentCount_ = 0;
+};
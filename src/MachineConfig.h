@@ -0,0 +1,30 @@
+#include "Arduino.h"
+#include "Transport.h"
+
+#pragma once
+
+// Geometry and calibration of the machine, shared by the firmware and the host simulator so both
+// move and weigh the same way.
+namespace MachineConfig
+{
+    const uint32_t PARK_STEP_ADDRESS = 15;
+    const int32_t STATION_STEP_ADDRESSES[] = {12, 426, 875, 1309, 1759, 2192, 230}; // Last one is the pumps.
+
+    const float CALIBRATION_FACTOR = 439;
+    const float EMPTY_WEIGHT = 121.38;
+
+    // Defines the stations and motion profiles on a freshly created transport.
+    inline void configureTransport(Transport& transport) {
+        for (int32_t stepAddress : STATION_STEP_ADDRESSES) {
+            transport.defineStation(stepAddress);
+        }
+
+        //Motion profiles: maxDistance, VSTART, A1, V1, AMAX, VMAX, DMAX, D1, VSTOP
+        transport.setMotionProfiles({
+            {600,  10, 400, 250, 300, 600,  300, 450, 20},
+            {1400, 10, 450, 300, 350, 1000, 350, 500, 20},
+            {2400, 10, 500, 350, 400, 1400, 400, 550, 20},
+        });
+        transport.setHomingMode(Transport::HomingMode::FAST);
+    }
+}
@@ -1,8 +1,8 @@
 #include "Pump.h"
 
 Pump::Pump(uint8_t pin_pump) : pin_pump_(pin_pump), stateTimeStamp_(0) {
-    pinMode(pin_pump_, OUTPUT);
-    digitalWrite(pin_pump_, LOW);
+    hal::gpio().pinMode(pin_pump_, OUTPUT);
+    hal::gpio().digitalWrite(pin_pump_, LOW);
     currentState_ = State::OFF;
 }
 
@@ -12,12 +12,12 @@ Pump::State Pump::getState() {
 
 void Pump::setState(State state) {
     if (state == State::ON) {
-        digitalWrite(pin_pump_, HIGH);
+        hal::gpio().digitalWrite(pin_pump_, HIGH);
     } else {
-        digitalWrite(pin_pump_, LOW);
+        hal::gpio().digitalWrite(pin_pump_, LOW);
     }
     currentState_ = state;
-    stateTimeStamp_ = millis();
+    stateTimeStamp_ = hal::millis();
 }
 
 void Pump::on() {
@@ -27,3 +27,50 @@ void Pump::on() {
 void Pump::off() {
     setState(State::OFF);
 }
+
+
+uint32_t Pump::getStateTimeStamp() {
+    return stateTimeStamp_;
+}
+
+float Pump::getFlowRate() {
+    return flowRate_;
+}
+
+void Pump::setFlowRate(float gramsPerSecond) {
+    if (gramsPerSecond <= 0.0) {
+        return;
+    }
+    flowRate_ = gramsPerSecond;
+}
+
+void Pump::learnFlowRate(float gramsPerSecond) {
+    if (gramsPerSecond <= 0.0) {
+        return;
+    }
+    flowRate_ = 0.7 * flowRate_ + 0.3 * gramsPerSecond;
+}
+
+float Pump::getInFlightWeight() {
+    return inFlightWeight_;
+}
+
+void Pump::setInFlightWeight(float weight) {
+    inFlightWeight_ = constrain(weight, 0.0f, 20.0f);
+}
+
+void Pump::learnInFlightWeight(float observedWeight) {
+    setInFlightWeight(0.7 * inFlightWeight_ + 0.3 * observedWeight);
+}
+
+uint32_t Pump::getActuationLatencyMS() {
+    return actuationLatencyMS_;
+}
+
+void Pump::setActuationLatencyMS(uint32_t latencyMS) {
+    actuationLatencyMS_ = constrain(latencyMS, (uint32_t)0, (uint32_t)2000);
+}
+
+void Pump::learnActuationLatencyMS(uint32_t observedMS) {
+    setActuationLatencyMS((7 * actuationLatencyMS_ + 3 * observedMS) / 10);
+}
\ No newline at end of file
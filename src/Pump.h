@@ -1,4 +1,5 @@
 #include "Arduino.h"
+#include "hal/Hal.h"
 
 #pragma once
 
@@ -15,10 +16,23 @@ public:
     void setState(State state);
     void on();
     void off();   
+    uint32_t getStateTimeStamp();
+    float getFlowRate();
+    void setFlowRate(float gramsPerSecond);
+    void learnFlowRate(float gramsPerSecond);
+    float getInFlightWeight();
+    void setInFlightWeight(float weight);
+    void learnInFlightWeight(float observedWeight);
+    uint32_t getActuationLatencyMS();
+    void setActuationLatencyMS(uint32_t latencyMS);
+    void learnActuationLatencyMS(uint32_t observedMS);
     
 private:    
     Pump::State position_;
     uint8_t pin_pump_;    
     State currentState_;
     uint32_t stateTimeStamp_;
+    float flowRate_ = 10.0; //g/s, refined after every pour.
+    uint32_t actuationLatencyMS_ = 300; //Open command to first weight on the scale.
+    float inFlightWeight_ = 0.0; //Grams that still land in the cup after the pump stops.
 };
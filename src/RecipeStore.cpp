@@ -0,0 +1,177 @@
+#include "RecipeStore.h"
+#include "Logger.h"
+#include <algorithm>
+
+// Blob layout per recipe: one (address:u8, weight:u16 tenths of a gram) triple per ingredient.
+// The "ids" blob lists the stored recipe IDs as u16.
+
+namespace {
+    void recipeKey(char* key, size_t size, uint16_t recipeId) {
+        snprintf(key, size, "r%u", (unsigned)recipeId);
+    }
+}
+
+RecipeStore::RecipeStore(std::shared_ptr<Dispatcher> dispatcher) : dispatcher_(dispatcher) {
+    std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+    preferences->begin("recipes", true);
+    size_t length = preferences->getBytesLength("ids");
+    recipeIds_.resize(length / sizeof(uint16_t));
+    if (recipeIds_.empty() == false) {
+        preferences->getBytes("ids", recipeIds_.data(), recipeIds_.size() * sizeof(uint16_t));
+    }
+    preferences->end();
+    LOG_I("[RecipeStore][Constructor] ", recipeIds_.size(), " recipes stored.");
+}
+
+// Compiled before it is written, a recipe the machine cannot make is never stored.
+bool RecipeStore::save(uint16_t recipeId, const std::vector<Dispatcher::Ingredient>& ingredients) {
+    auto job = std::make_shared<Dispatcher::CompiledJob>();
+    if (dispatcher_->compile(ingredients, *job) == false) {
+        LOG_W("[RecipeStore][save] Recipe ", recipeId, " rejected.");
+        return false;
+    }
+
+    std::vector<uint8_t> blob;
+    blob.reserve(ingredients.size() * 3);
+    for (const auto& ingredient : ingredients) {
+        uint16_t deciGrams = (uint16_t)constrain(round(ingredient.targetWeight * 10.0), 0.0, 65535.0);
+        blob.push_back(ingredient.address);
+        blob.push_back(deciGrams & 0xFF);
+        blob.push_back(deciGrams >> 8);
+    }
+
+    char key[8];
+    recipeKey(key, sizeof(key), recipeId);
+    std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+    preferences->begin("recipes", false);
+    bool written = preferences->putBytes(key, blob.data(), blob.size()) == blob.size();
+    preferences->end();
+    if (written == false) {
+        LOG_W("[RecipeStore][save] NVS write failed for recipe ", recipeId);
+        return false;
+    }
+
+    if (std::find(recipeIds_.begin(), recipeIds_.end(), recipeId) == recipeIds_.end()) {
+        recipeIds_.push_back(recipeId);
+        saveIndex_();
+    }
+
+    if (cache_.count(recipeId) == 0) {
+        evict_();
+    }
+    cache_[recipeId] = {job, ++useCounter_};
+    LOG_I("[RecipeStore][save] Recipe ", recipeId, " stored with ", ingredients.size(), " ingredients.");
+    return true;
+}
+
+bool RecipeStore::load(uint16_t recipeId, std::vector<Dispatcher::Ingredient>& ingredients) {
+    char key[8];
+    recipeKey(key, sizeof(key), recipeId);
+    std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+    preferences->begin("recipes", true);
+    size_t length = preferences->getBytesLength(key);
+    std::vector<uint8_t> blob(length);
+    if (length > 0) {
+        preferences->getBytes(key, blob.data(), length);
+    }
+    preferences->end();
+
+    ingredients.clear();
+    for (size_t i = 0; i + 2 < blob.size(); i += 3) {
+        ingredients.push_back({blob[i], (uint16_t)(blob[i + 1] | (blob[i + 2] << 8)) / 10.0f});
+    }
+    return ingredients.empty() == false;
+}
+
+bool RecipeStore::remove(uint16_t recipeId) {
+    auto it = std::find(recipeIds_.begin(), recipeIds_.end(), recipeId);
+    if (it == recipeIds_.end()) {
+        return false;
+    }
+
+    char key[8];
+    recipeKey(key, sizeof(key), recipeId);
+    std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+    preferences->begin("recipes", false);
+    preferences->remove(key);
+    preferences->end();
+
+    recipeIds_.erase(it);
+    saveIndex_();
+    cache_.erase(recipeId);
+    LOG_I("[RecipeStore][remove] Recipe ", recipeId, " removed.");
+    return true;
+}
+
+// A miss loads and compiles from NVS once, every later order of the recipe is served from RAM.
+std::shared_ptr<const Dispatcher::CompiledJob> RecipeStore::getJob(uint16_t recipeId) {
+    auto cached = cache_.find(recipeId);
+    if (cached != cache_.end()) {
+        cached->second.lastUse = ++useCounter_;
+        return cached->second.job;
+    }
+
+    std::vector<Dispatcher::Ingredient> ingredients;
+    if (load(recipeId, ingredients) == false) {
+        LOG_W("[RecipeStore][getJob] Unknown recipe ", recipeId);
+        return nullptr;
+    }
+
+    auto job = std::make_shared<Dispatcher::CompiledJob>();
+    if (dispatcher_->compile(ingredients, *job) == false) {
+        return nullptr;
+    }
+
+    evict_();
+    cache_[recipeId] = {job, ++useCounter_};
+    return job;
+}
+
+std::vector<uint16_t> RecipeStore::getRecipeIds() {
+    return recipeIds_;
+}
+
+void RecipeStore::warmCache() {
+    for (size_t i = 0; i < recipeIds_.size() && i < MAX_CACHED; i++) {
+        getJob(recipeIds_[i]);
+    }
+    LOG_I("[RecipeStore][warmCache] ", cache_.size(), " recipes compiled.");
+}
+
+void RecipeStore::printRecipes() {
+    for (uint16_t recipeId : recipeIds_) {
+        std::vector<Dispatcher::Ingredient> ingredients;
+        load(recipeId, ingredients);
+        String text = "";
+        for (size_t i = 0; i < ingredients.size(); i++) {
+            text += (i == 0 ? "" : ",") + String(ingredients[i].address) + "=" + String(ingredients[i].targetWeight);
+        }
+        LOG_I("[RecipeStore][printRecipes] ", recipeId, (cache_.count(recipeId) ? " (cached): " : ": "), text);
+    }
+}
+
+void RecipeStore::saveIndex_() {
+    std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+    preferences->begin("recipes", false);
+    if (recipeIds_.empty()) {
+        preferences->remove("ids");
+    } else {
+        preferences->putBytes("ids", recipeIds_.data(), recipeIds_.size() * sizeof(uint16_t));
+    }
+    preferences->end();
+}
+
+// Least recently used entry goes when the cache is full.
+void RecipeStore::evict_() {
+    if (cache_.size() < MAX_CACHED) {
+        return;
+    }
+
+    auto oldest = cache_.begin();
+    for (auto it = cache_.begin(); it != cache_.end(); ++it) {
+        if (it->second.lastUse < oldest->second.lastUse) {
+            oldest = it;
+        }
+    }
+    cache_.erase(oldest);
+}
@@ -0,0 +1,40 @@
+#include "Arduino.h"
+#include "Dispatcher.h"
+#include "hal/Hal.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+#pragma once
+
+// Recipes persisted in NVS by ID, plus a RAM cache of their compiled jobs. Ordering a cached recipe
+// costs a map lookup, nothing is parsed, validated or planned again. Stored recipes have no length
+// limit beyond NVS blob size.
+class RecipeStore
+{
+public:
+    static const uint8_t MAX_CACHED = 16;
+
+    RecipeStore(std::shared_ptr<Dispatcher> dispatcher);
+    bool save(uint16_t recipeId, const std::vector<Dispatcher::Ingredient>& ingredients);
+    bool load(uint16_t recipeId, std::vector<Dispatcher::Ingredient>& ingredients);
+    bool remove(uint16_t recipeId);
+    std::shared_ptr<const Dispatcher::CompiledJob> getJob(uint16_t recipeId);
+    std::vector<uint16_t> getRecipeIds();
+    void warmCache();
+    void printRecipes();
+
+private:
+    struct CacheEntry {
+        std::shared_ptr<const Dispatcher::CompiledJob> job;
+        uint32_t lastUse;
+    };
+
+    void saveIndex_();
+    void evict_();
+
+    std::shared_ptr<Dispatcher> dispatcher_;
+    std::vector<uint16_t> recipeIds_;
+    std::map<uint16_t, CacheEntry> cache_;
+    uint32_t useCounter_ = 0;
+};
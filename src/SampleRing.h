@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include <atomic>
+
+#pragma once
+
+// Single producer / single consumer ring buffer. The producer (acquisition task or ISR) only writes
+// head_ and the consumer only writes tail_, so neither side needs a lock. N must be a power of two.
+template <typename T, uint32_t N>
+class SampleRing
+{
+public:
+    static_assert((N & (N - 1)) == 0, "SampleRing size must be a power of two");
+
+    bool push(const T& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= N) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t size() {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    uint32_t getDroppedCount() {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    T items_[N];
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> dropped_{0};
+};
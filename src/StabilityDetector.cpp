@@ -0,0 +1,111 @@
+#include "StabilityDetector.h"
+#include <math.h>
+
+StabilityDetector::StabilityDetector(float maxStdDev, float maxSlope, uint32_t windowMS) {
+    setTolerance(maxStdDev, maxSlope, windowMS);
+    reset();
+}
+
+void StabilityDetector::addSample(float value, uint32_t timeStampMS) {
+    values_[head_] = value;
+    timeStamps_[head_] = timeStampMS;
+    head_ = (head_ + 1) % WINDOW_SIZE;
+    if (count_ < WINDOW_SIZE) {
+        count_++;
+    }
+}
+
+void StabilityDetector::reset() {
+    head_ = 0;
+    count_ = 0;
+}
+
+void StabilityDetector::setTolerance(float maxStdDev, float maxSlope, uint32_t windowMS) {
+    maxStdDev_ = maxStdDev;
+    maxSlope_ = maxSlope;
+    windowMS_ = windowMS;
+}
+
+// Samples within windowMS of the newest one, so the same tolerance works at 10Hz and 80Hz.
+uint8_t StabilityDetector::windowCount_() {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint32_t newest = timeStamps_[(head_ + WINDOW_SIZE - 1) % WINDOW_SIZE];
+    uint8_t n = 1;
+    while (n < count_ && newest - timeStamps_[(head_ + WINDOW_SIZE - 1 - n) % WINDOW_SIZE] <= windowMS_) {
+        n++;
+    }
+    return n;
+}
+
+// The window has to span most of windowMS before the signal can be called settled, so a freshly
+// reset detector never settles on its first couple of samples.
+bool StabilityDetector::isSettled() {
+    uint8_t n = windowCount_();
+    if (n < 3) {
+        return false;
+    }
+    uint32_t span = timeStamps_[(head_ + WINDOW_SIZE - 1) % WINDOW_SIZE] - timeStamps_[(head_ + WINDOW_SIZE - n) % WINDOW_SIZE];
+    if (span < windowMS_ * 3 / 4) {
+        return false;
+    }
+    return sqrtf(getVariance()) <= maxStdDev_ && fabsf(getSlope()) <= maxSlope_;
+}
+
+float StabilityDetector::getMean() {
+    uint8_t n = windowCount_();
+    if (n == 0) {
+        return 0.0;
+    }
+    float sum = 0.0;
+    for (uint8_t i = 1; i <= n; i++) {
+        sum += values_[(head_ + WINDOW_SIZE - i) % WINDOW_SIZE];
+    }
+    return sum / n;
+}
+
+float StabilityDetector::getVariance() {
+    uint8_t n = windowCount_();
+    if (n < 2) {
+        return 0.0;
+    }
+    float mean = getMean();
+    float sum = 0.0;
+    for (uint8_t i = 1; i <= n; i++) {
+        float d = values_[(head_ + WINDOW_SIZE - i) % WINDOW_SIZE] - mean;
+        sum += d * d;
+    }
+    return sum / (n - 1);
+}
+
+float StabilityDetector::getSlope() {
+    uint8_t n = windowCount_();
+    if (n < 2) {
+        return 0.0;
+    }
+    uint32_t t0 = timeStamps_[(head_ + WINDOW_SIZE - n) % WINDOW_SIZE];
+    float meanT = 0.0;
+    float meanV = getMean();
+    for (uint8_t i = 1; i <= n; i++) {
+        meanT += (timeStamps_[(head_ + WINDOW_SIZE - i) % WINDOW_SIZE] - t0) / 1000.0f;
+    }
+    meanT /= n;
+
+    float num = 0.0;
+    float den = 0.0;
+    for (uint8_t i = 1; i <= n; i++) {
+        uint8_t idx = (head_ + WINDOW_SIZE - i) % WINDOW_SIZE;
+        float dt = (timeStamps_[idx] - t0) / 1000.0f - meanT;
+        num += dt * (values_[idx] - meanV);
+        den += dt * dt;
+    }
+    if (den <= 0.0) {
+        return 0.0;
+    }
+    return num / den;
+}
+
+uint8_t StabilityDetector::getSampleCount() {
+    return count_;
+}
@@ -0,0 +1,32 @@
+#include <stdint.h>
+
+#pragma once
+
+// Tracks the spread and trend of the most recent load cell samples so callers can tell when the
+// reading has gone flat instead of waiting out a fixed delay.
+class StabilityDetector
+{
+public:
+    static const uint8_t WINDOW_SIZE = 32;
+
+    StabilityDetector(float maxStdDev = 0.3, float maxSlope = 2.0, uint32_t windowMS = 250);
+    void addSample(float value, uint32_t timeStampMS);
+    void reset();
+    void setTolerance(float maxStdDev, float maxSlope, uint32_t windowMS);
+    bool isSettled();
+    float getMean();
+    float getVariance();
+    float getSlope(); //Units per second, least squares over the window.
+    uint8_t getSampleCount();
+
+private:
+    uint8_t windowCount_();
+
+    float values_[WINDOW_SIZE];
+    uint32_t timeStamps_[WINDOW_SIZE];
+    uint8_t head_ = 0;
+    uint8_t count_ = 0;
+    float maxStdDev_;
+    float maxSlope_;
+    uint32_t windowMS_;
+};
@@ -1,30 +1,38 @@
 #include "Transport.h"
+#include "Logger.h"
+#include <algorithm>
+
+namespace {
+  const uint32_t RAMP_STAT_POSITION_REACHED = hal::StepperDriver::RAMP_STAT_POSITION_REACHED;
+  const uint32_t DRV_STATUS_FAULTS = (1UL << 25) | (1UL << 27) | (1UL << 28) | (1UL << 29) | (1UL << 30); // ot, s2ga, s2gb, ola, olb
+  const uint32_t IDLE_MIRROR_INTERVAL_US = 100000;
+  const float SHAPED_CREEP_SPEED = 2; // steps/s, VMAX floor of a shaped move so the ramp generator never stops short of XTARGET.
+}
 
 Transport::Transport(uint8_t PIN_HOME_SW, uint8_t PIN_ENABLE, uint8_t PIN_CS, uint32_t parkStepAddress): 
     PIN_HOME_SW_(PIN_HOME_SW), 
     PIN_ENABLE_(PIN_ENABLE), 
     PIN_CS_(PIN_CS) 
 {
-  motor_ = std::make_unique<TMC5160_SPI>(PIN_CS);  
-  TMC5160::PowerStageParameters powerStageParams; // defaults.
-  TMC5160::MotorParameters motorParams;
-  motorParams.globalScaler = 60; // Adapt to your driver and motor (check TMC5160 datasheet - "Selecting sense resistors")
-  motorParams.irun = 25;
-  motorParams.ihold = 17;
-  motor_->begin(powerStageParams, motorParams, TMC5160::NORMAL_MOTOR_DIRECTION);  
-  motor_->setRampMode(TMC5160::POSITIONING_MODE);
+  motor_ = hal::platform().createStepper(PIN_CS);
   motor_->setMaxSpeed(400);
-  motor_->setAcceleration(250);
-  digitalWrite(PIN_ENABLE_, LOW);
+  motor_->setAcceleration(deceleration_);
+  hal::gpio().digitalWrite(PIN_ENABLE_, LOW);
   motor_->enable();  
   defineStation(parkStepAddress);
-
+  hal::gpio().attachInterrupt(PIN_HOME_SW_, homeSwitchISR_, this, RISING);
 }
 
 Transport::~Transport() {}
 
 void Transport::heartbeat() {
-  
+  refreshMirror_();
+
+  // Off park a persisted reference would be wrong after a power loss, cleared once the carriage moves.
+  if (referencePersisted_ && mirror_.speed != 0) {
+    persistReference_(false);
+  }
+
   switch (machineState_)
   {
   //write all cases
@@ -39,9 +47,19 @@ void Transport::heartbeat() {
   }
   if (homingStage_ == Transport::HomingStage::REFINING) {
     homing_awaiting_home_sw_refining();
+  }
+  if (homingStage_ == Transport::HomingStage::FAST_SEEKING) {
+    homing_awaiting_fast_seek();
+  }
+  if (homingStage_ == Transport::HomingStage::STOPPING) {
+    homing_awaiting_stop();
+  }
+  if (homingStage_ == Transport::HomingStage::VERIFYING) {
+    homing_awaiting_verify_touch();
   }
     break;
   case Transport::MachineState::MOVING_TO_TARGET_POS:
+    issueShapedRamp_();
     awaiting_target_pos();
     break;
   case Transport::MachineState::AT_TARGET:
@@ -53,11 +71,44 @@ void Transport::heartbeat() {
 
 
 void Transport::moveStepsRight(uint32_t steps) {
-  motor_->setTargetPosition(motor_->getCurrentPosition() - steps);
+  setTargetPosition_(mirror_.position - steps);
 }
 
 void Transport::moveStepsLeft(uint32_t steps) {
-  motor_->setTargetPosition(motor_->getCurrentPosition() + steps);
+  setTargetPosition_(mirror_.position + steps);
+}
+
+// One SPI burst per interval instead of a read per caller per loop pass. Everything in the
+// loop (arrival, prediction, homing, LED tracking) works off this snapshot. Standing still only
+// DRV_STATUS can change, so it alone is polled at the idle interval.
+void Transport::refreshMirror_() {
+  uint32_t now = hal::micros();
+  bool moving = machineState_ == Transport::MachineState::MOVING_TO_TARGET_POS || machineState_ == Transport::MachineState::HOMING || mirror_.speed != 0;
+  if (mirrorStale_ == false && now - mirror_.timeStampUS < (moving ? mirrorIntervalUS_ : IDLE_MIRROR_INTERVAL_US)) {
+    return;
+  }
+
+  if (mirrorStale_ || moving) {
+    mirror_.position = motor_->getCurrentPosition();
+    mirror_.speed = motor_->getCurrentSpeed();
+    mirror_.rampStatus = motor_->readRampStatus();
+  }
+  mirror_.driverStatus = motor_->readDriverStatus();
+  mirror_.timeStampUS = now;
+  mirror_.refreshCount++;
+  mirrorStale_ = false;
+
+  uint32_t faults = mirror_.driverStatus & DRV_STATUS_FAULTS;
+  if (faults != reportedDriverFaults_) {
+    LOG_W("[Transport][refreshMirror_] -> Driver status faults: 0x", LogHex(faults));
+    reportedDriverFaults_ = faults;
+  }
+}
+
+// Any new target invalidates the cached ramp status, the next heartbeat re-reads it before judging arrival.
+void Transport::setTargetPosition_(int32_t position) {
+  motor_->setTargetPosition(position);
+  mirrorStale_ = true;
 }
 
 uint32_t Transport::defineStation(int32_t stepAddress) {
@@ -67,62 +118,291 @@ uint32_t Transport::defineStation(int32_t stepAddress) {
   return stations_.size() - 1;
 }
 
+uint8_t Transport::getStationCount() {
+  return stations_.size();
+}
+
+int32_t Transport::getStationAddress(uint8_t stationIndex) {
+  if (stationIndex >= stations_.size()) {
+    return stations_[0].stepAddress;
+  }
+  return stations_[stationIndex].stepAddress;
+}
+
+uint32_t Transport::getTravelDistance(uint8_t fromStationIndex, uint8_t toStationIndex) {
+  return abs(getStationAddress(toStationIndex) - getStationAddress(fromStationIndex));
+}
+
+int8_t Transport::getCurrentStationIndex() {
+  return currentStationIndex_;
+}
+
+// Milliseconds until the carriage stops on target, -1 while it is not yet braking into it.
+// Assumes a constant deceleration so the remaining time is twice the distance over the current speed.
+int32_t Transport::getPredictedArrivalMS() {
+  if (machineState_ != Transport::MachineState::MOVING_TO_TARGET_POS || currentStation_ == nullptr) {
+    return -1;
+  }
+
+  float remaining = fabs(currentStation_->stepAddress - mirror_.position);
+  if (remaining < 1.0) {
+    return 0;
+  }
+
+  // A shaped move brakes in steps, the plan knows when it ends.
+  if (shapedRamp_.active) {
+    float elapsedS = (hal::millis() - shapedRamp_.beginMS) / 1000.0;
+    float endS = shapedRamp_.accelTimeS + shapedRamp_.cruiseTimeS + shapedRamp_.decelTimeS + shapedRamp_.impulses.back().timeS;
+    if (elapsedS < shapedRamp_.accelTimeS + shapedRamp_.cruiseTimeS) {
+      return -1;
+    }
+    return (int32_t)(std::max(endS - elapsedS, 0.0f) * 1000.0);
+  }
+
+  float speed = fabs(mirror_.speed);
+  if (speed < 1.0) {
+    return -1;
+  }
+
+  float brakingDistance = (speed * speed) / (2.0 * deceleration_);
+  if (remaining > brakingDistance * 1.1 + 1.0) {
+    return -1;
+  }
+
+  return (int32_t)(2000.0 * remaining / speed);
+}
+
 uint32_t Transport::getCurrentPosition() {
-  return motor_->getCurrentPosition();
+  return mirror_.position;
+}
+
+float Transport::getCurrentSpeed() {
+  return mirror_.speed;
+}
+
+uint32_t Transport::getDriverStatus() {
+  return mirror_.driverStatus;
+}
+
+const Transport::RegisterMirror& Transport::getRegisterMirror() {
+  return mirror_;
+}
+
+void Transport::setMirrorInterval(uint32_t intervalUS) {
+  mirrorIntervalUS_ = intervalUS;
 }
 
 
 void Transport::refMachine(DidHomeCallback didHomeCallback) {  
-  Serial.println("[Transport][refMachine] -> Homing...");
+  LOG_I("[Transport][refMachine] -> Homing...");
   
   if (didHomeCallback != nullptr) {
     didHomeCallback_ = std::make_shared<DidHomeCallback>(didHomeCallback);
   } 
   
   setState_(Transport::MachineState::HOMING);
+  homingStartMS_ = hal::millis();
+  isHomed_ = false;
+  shapedRamp_.active = false;
+
+  // Sitting on the switch there is no rising edge to latch, the standard sequence backs off it first.
+  if (homingMode_ == Transport::HomingMode::FAST && hal::gpio().digitalRead(PIN_HOME_SW_) == LOW) {
+    std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+    preferences->begin("transport", true);
+    bool referenceValid = preferences->getBool("ref_ok", false);
+    int32_t referencePosition = preferences->getInt("ref_pos", 0);
+    preferences->end();
+
+    if (referenceValid) {
+      startVerifyTouch_(referencePosition);
+    } else {
+      startFastSeek_();
+    }
+    return;
+  }
+
+  startStandardSeek_();
+}
+
+void Transport::startStandardSeek_() {
+  homingMethod_ = "standard";
   homingStage_ = Transport::HomingStage::SEEKING_HOME;
   motor_->stop();  
   motor_->setCurrentPosition(4000);    
+  mirror_.position = 4000;
   motor_->setMaxSpeed(60);  
-  motor_->setTargetPosition(0); 
+  setTargetPosition_(0); 
 }
 
 void Transport::homing_awaiting_rough_home_sw() {  
   
-  if (digitalRead(PIN_HOME_SW_) == HIGH ) {        
-    Serial.println("[Transport][refMachine] -> Rogh home switch triggered. Retracting...");
+  if (hal::gpio().digitalRead(PIN_HOME_SW_) == HIGH ) {        
+    LOG_I("[Transport][refMachine] -> Rogh home switch triggered. Retracting...");
     motor_->stop();  
     motor_->setCurrentPosition(0);
+    mirror_.position = 0;
     motor_->setMaxSpeed(40);  
-    motor_->setTargetPosition(40);
+    setTargetPosition_(40);
     homingStage_ = Transport::HomingStage::RETRACTING;
     return;
   }
 }
 
 void Transport::homing_awaiting_retract() {
- if (motor_->getCurrentPosition() >= 40) {  
-    Serial.println("[Transport][refMachine] -> Retract position reached. Refining...");
+ if (mirrorStale_ == false && mirror_.position >= 40) {  
+    LOG_I("[Transport][refMachine] -> Retract position reached. Refining...");
     motor_->setMaxSpeed(20);  
-    motor_->setTargetPosition(-10);
+    setTargetPosition_(-10);
     homingStage_ = Transport::HomingStage::REFINING;
     return;
   } 
 }
 
 void Transport::homing_awaiting_home_sw_refining() {
-  if (digitalRead(PIN_HOME_SW_) == HIGH) {
-    Serial.println("[Transport][refMachine] -> Unit is fully HOMED... Parking");
+  if (hal::gpio().digitalRead(PIN_HOME_SW_) == HIGH) {
+    LOG_I("[Transport][refMachine] -> Unit is fully HOMED... Parking");
     motor_->stop();  
     motor_->setCurrentPosition(0);    
-    goPark(50);
+    mirror_.position = 0;
+    finishHoming_();
+    return;
+  }
+}
+
+void Transport::setHomingMode(HomingMode mode) {
+  homingMode_ = mode;
+}
+
+void Transport::setHomingParameters(HomingParameters parameters) {
+  homingParameters_ = parameters;
+}
+
+// Only the edge time is taken here, SPI is not safe from an ISR. The position is rebuilt from it in heartbeat().
+void IRAM_ATTR Transport::homeSwitchISR_(void* arg, uint32_t timeStampUS) {
+  Transport* transport = static_cast<Transport*>(arg);
+  if (transport->homeSwitchArmed_ && transport->homeSwitchLatched_ == false) {
+    transport->homeSwitchTimeStampUS_ = timeStampUS;
+    transport->homeSwitchLatched_ = true;
+  }
+}
+
+void Transport::armHomeSwitch_() {
+  homeSwitchLatched_ = false;
+  homeSwitchArmed_ = true;
+}
+
+// The carriage cruises at constant speed when it crosses the switch, so the position at the edge is the
+// position now minus the distance covered since. Stops the motor once the latch has been resolved.
+bool Transport::latchHomePosition_() {
+  if (homeSwitchLatched_ == false) {
+    return false;
+  }
+
+  homeSwitchArmed_ = false;
+  float position = motor_->getCurrentPosition();
+  float speed = motor_->getCurrentSpeed();
+  uint32_t elapsedUS = hal::micros() - homeSwitchTimeStampUS_;
+  motor_->stop();
+  latchedHomePosition_ = position - speed * (elapsedUS / 1000000.0);
+  mirrorStale_ = true;
+  homingStage_ = Transport::HomingStage::STOPPING;
+  LOG_I("[Transport][latchHomePosition_] -> Switch latched at ", latchedHomePosition_, " (", elapsedUS, "us late, ", speed, " steps/s)");
+  return true;
+}
+
+void Transport::startFastSeek_() {
+  LOG_I("[Transport][refMachine] -> Fast seek at ", homingParameters_.seekSpeed, " steps/s");
+  homingMethod_ = "fast seek";
+  homingStage_ = Transport::HomingStage::FAST_SEEKING;
+  motor_->stop();
+  motor_->setCurrentPosition(homingParameters_.seekTravel);
+  mirror_.position = homingParameters_.seekTravel;
+  motor_->setRampSpeeds(0, 0.1, 0);
+  motor_->setAccelerations(homingParameters_.seekAcceleration, homingParameters_.seekAcceleration, homingParameters_.seekAcceleration, homingParameters_.seekAcceleration);
+  motor_->setMaxSpeed(homingParameters_.seekSpeed);
+  armHomeSwitch_();
+  setTargetPosition_(0);
+}
+
+// Trusts the persisted position and only touches the switch, expecting it within verifyTolerance of zero.
+void Transport::startVerifyTouch_(int32_t referencePosition) {
+  LOG_I("[Transport][refMachine] -> Persisted reference at ", referencePosition, ", verification touch");
+  homingMethod_ = "verification touch";
+  homingStage_ = Transport::HomingStage::VERIFYING;
+  motor_->stop();
+  motor_->setCurrentPosition(referencePosition);
+  mirror_.position = referencePosition;
+  motor_->setRampSpeeds(0, 0.1, 0);
+  motor_->setAccelerations(homingParameters_.seekAcceleration, homingParameters_.seekAcceleration, homingParameters_.seekAcceleration, homingParameters_.seekAcceleration);
+  motor_->setMaxSpeed(homingParameters_.verifySpeed);
+  armHomeSwitch_();
+  setTargetPosition_(-homingParameters_.verifyTolerance);
+}
+
+void Transport::homing_awaiting_fast_seek() {
+  if (latchHomePosition_()) {
+    return;
+  }
 
-    if (didHomeCallback_ != nullptr) {
-      (*didHomeCallback_)(true);
+  if (mirrorStale_ == false && (mirror_.rampStatus & RAMP_STAT_POSITION_REACHED)) {
+    LOG_W("[Transport][refMachine] -> Fast seek ran out of travel without a switch, falling back to standard homing");
+    homeSwitchArmed_ = false;
+    startStandardSeek_();
+  }
+}
+
+void Transport::homing_awaiting_verify_touch() {
+  if (latchHomePosition_()) {
+    if (fabs(latchedHomePosition_) > homingParameters_.verifyTolerance) {
+      LOG_I("[Transport][refMachine] -> Reference was off by ", latchedHomePosition_, " steps, corrected from the latch");
     }
+    return;
+  }
+
+  if (mirrorStale_ == false && (mirror_.rampStatus & RAMP_STAT_POSITION_REACHED)) {
+    LOG_W("[Transport][refMachine] -> Switch not found where the persisted reference put it, fast seeking");
+    startFastSeek_();
+  }
+}
 
+// Once stopped, the position is rewritten so the latched switch edge becomes zero.
+void Transport::homing_awaiting_stop() {
+  if (mirrorStale_ || fabs(mirror_.speed) > 0.5) {
     return;
   }
+
+  float position = motor_->getCurrentPosition();
+  motor_->setCurrentPosition(position - latchedHomePosition_);
+  mirror_.position = position - latchedHomePosition_;
+  finishHoming_();
+}
+
+void Transport::finishHoming_() {
+  homingDurationMS_ = hal::millis() - homingStartMS_;
+  LOG_I("[Transport][refMachine] -> Unit is fully HOMED (", homingMethod_, ") in ", homingDurationMS_, "ms... Parking");
+  homingStage_ = Transport::HomingStage::PARKED;
+  isHomed_ = true;
+  goPark(50);
+
+  if (didHomeCallback_ != nullptr) {
+    (*didHomeCallback_)(true);
+  }
+}
+
+// Written only on arriving at park and on leaving it, a power loss anywhere else finds the flag cleared.
+// Keys already holding the value are not rewritten, park sits on the same step every time.
+void Transport::persistReference_(bool valid) {
+  std::unique_ptr<hal::Storage> preferences = hal::platform().createStorage();
+  preferences->begin("transport", false);
+  int32_t position = (int32_t)round(mirror_.position);
+  if (valid && preferences->getInt("ref_pos", position + 1) != position) {
+    preferences->putInt("ref_pos", position);
+  }
+  if (preferences->getBool("ref_ok", !valid) != valid) {
+    preferences->putBool("ref_ok", valid);
+  }
+  preferences->end();
+  referencePersisted_ = valid;
 }
 
 void Transport::setState_(MachineState state) {
@@ -135,23 +415,153 @@ void Transport::setState_(MachineState state) {
 }
 
 
-void Transport::goPark(uint16_t speed) {
+void Transport::goPark(uint16_t speed, float liquidMass) {
+  goToStation(0, speed, liquidMass);
+}
+
+void Transport::setSloshControl(SloshControl control) {
+  sloshControl_ = control;
+}
+
+void Transport::setMotionProfiles(std::vector<MotionProfile> profiles) {
+  motionProfiles_ = profiles;
+  std::sort(motionProfiles_.begin(), motionProfiles_.end(), [](const MotionProfile& a, const MotionProfile& b) {
+    return a.maxDistance < b.maxDistance;
+  });
+}
+
+// Short hops never reach a high VMAX, so each distance band gets its own ramp. Longer moves use the
+// upper A1/V1 stage to keep accelerating well past the speed a single trapezoid could brake from.
+void Transport::applyMotionProfile_(uint32_t distance, float accelScale) {
+  const MotionProfile* profile = &motionProfiles_.back();
+  for (const auto& candidate : motionProfiles_) {
+    if (distance <= candidate.maxDistance) {
+      profile = &candidate;
+      break;
+    }
+  }
+
+  motor_->setRampSpeeds(profile->vstart, profile->vstop, profile->v1);
+  motor_->setAccelerations(profile->amax * accelScale, profile->dmax * accelScale, profile->a1 * accelScale, profile->d1 * accelScale);
+  motor_->setMaxSpeed(profile->vmax);
+  deceleration_ = ((profile->v1 > 0) ? profile->d1 : profile->dmax) * accelScale; //Final braking phase, used for arrival prediction.
+  maxSpeed_ = profile->vmax;
+  acceleration_ = profile->amax * accelScale;
+  maxDeceleration_ = profile->dmax * accelScale;
+  LOG_I("[Transport][applyMotionProfile_] ", distance, " steps -> profile up to ", profile->maxDistance, " (vmax ", profile->vmax, ")");
+}
+
+// Plain trapezoid, V1 = 0 disables the A1/D1 stage.
+void Transport::applyTrapezoid_(uint16_t speed, float accelScale) {
+  motor_->setRampSpeeds(0, 0.1, 0);
+  motor_->setAccelerations(250 * accelScale, 250 * accelScale, 250 * accelScale, 250 * accelScale);
   motor_->setMaxSpeed(speed);
-  goToStation(0, speed);
+  deceleration_ = 250 * accelScale;
+  maxSpeed_ = speed;
+  acceleration_ = 250 * accelScale;
+  maxDeceleration_ = 250 * accelScale;
+}
+
+// The TMC5160 retargets on every XTARGET write, so a shaped move cannot be built from staged targets.
+// Instead the trapezoid the ramp generator would have run is convolved with the shaper impulses and
+// followed through VMAX: the commanded acceleration becomes the staircase that cancels the slosh, the
+// impulses sum to 1 so the distance is unchanged, and the driver still stops on XTARGET by itself.
+void Transport::planShapedMove_(uint32_t distance, float liquidMass) {
+  float frequency = InputShaper::sloshFrequencyHz(liquidMass, sloshControl_.cupRadiusM);
+  shapedRamp_.impulses = InputShaper::design(sloshControl_.shaper, frequency, sloshControl_.damping);
+
+  // Too short to reach VMAX, the peak speed is where the accelerating and braking parabolas meet.
+  float speed = maxSpeed_;
+  float rampDistance = speed * speed / (2.0 * acceleration_) + speed * speed / (2.0 * maxDeceleration_);
+  if (rampDistance > distance) {
+    speed = sqrt(2.0 * distance * acceleration_ * maxDeceleration_ / (acceleration_ + maxDeceleration_));
+    rampDistance = distance;
+  }
+  shapedRamp_.speed = speed;
+  shapedRamp_.accelTimeS = speed / acceleration_;
+  shapedRamp_.decelTimeS = speed / maxDeceleration_;
+  shapedRamp_.cruiseTimeS = speed > 0 ? (distance - rampDistance) / speed : 0;
+  shapedRamp_.beginMS = hal::millis();
+  shapedRamp_.active = true;
+
+  // V1 = 0 so AMAX and DMAX bound how fast the driver follows VMAX, the staircase never asks for more.
+  motor_->setRampSpeeds(0, SHAPED_CREEP_SPEED, 0);
+  motor_->setAccelerations(acceleration_, maxDeceleration_, acceleration_, maxDeceleration_);
+  LOG_I("[Transport][planShapedMove_] ", shapedRamp_.impulses.size(), " impulses for ", liquidMass, "g at ", frequency, "Hz, peak ", speed, " steps/s");
+  issueShapedRamp_();
+}
+
+float Transport::unshapedSpeedAt_(float elapsedS) {
+  if (elapsedS <= 0) {
+    return 0;
+  }
+  if (elapsedS < shapedRamp_.accelTimeS) {
+    return acceleration_ * elapsedS;
+  }
+  elapsedS -= shapedRamp_.accelTimeS;
+  if (elapsedS < shapedRamp_.cruiseTimeS) {
+    return shapedRamp_.speed;
+  }
+  elapsedS -= shapedRamp_.cruiseTimeS;
+  if (elapsedS < shapedRamp_.decelTimeS) {
+    return shapedRamp_.speed - maxDeceleration_ * elapsedS;
+  }
+  return 0;
+}
+
+float Transport::shapedSpeedAt_(float elapsedS) {
+  float speed = 0;
+  for (const auto& impulse : shapedRamp_.impulses) {
+    speed += impulse.amplitude * unshapedSpeedAt_(elapsedS - impulse.timeS);
+  }
+  return speed;
+}
+
+// At most one VMAX write per millisecond. Once the plan has run out VMAX stays at the creep speed
+// for whatever the driver lagged behind it.
+void Transport::issueShapedRamp_() {
+  if (shapedRamp_.active == false) {
+    return;
+  }
+
+  uint32_t now = hal::millis();
+  if (now == shapedRamp_.lastIssueMS && now != shapedRamp_.beginMS) {
+    return;
+  }
+  shapedRamp_.lastIssueMS = now;
+
+  float elapsedS = (now - shapedRamp_.beginMS) / 1000.0;
+  float endS = shapedRamp_.accelTimeS + shapedRamp_.cruiseTimeS + shapedRamp_.decelTimeS + shapedRamp_.impulses.back().timeS;
+  motor_->setMaxSpeed(std::max(shapedSpeedAt_(elapsedS), SHAPED_CREEP_SPEED));
+  if (elapsedS >= endS) {
+    shapedRamp_.active = false;
+  }
 }
 
-void Transport::goToStation(uint8_t stationIndex, uint16_t speed) {
+void Transport::goToStation(uint8_t stationIndex, uint16_t speed, float liquidMass) {
   if (stationIndex >= stations_.size()) {
-    Serial.println("[Transport][goToStation] -> Station index out of range");
+    LOG_W("[Transport][goToStation] -> Station index out of range");
     return;
   }
   
   uint32_t targetPos = stations_[stationIndex].stepAddress;
+  uint32_t distance = abs((int32_t)targetPos - (int32_t)round(mirror_.position));
   currentStation_ = std::make_shared<Station>(stations_[stationIndex]);
   currentStationIndex_ = stationIndex;
   setState_(Transport::MachineState::MOVING_TO_TARGET_POS);
-  motor_->setMaxSpeed(speed);  
-  motor_->setTargetPosition(currentStation_->stepAddress);
+  float load = constrain((liquidMass - sloshControl_.lightMass) / (sloshControl_.fullMass - sloshControl_.lightMass), 0.0f, 1.0f);
+  float accelScale = 1.0 - load * (1.0 - sloshControl_.fullAccelScale);
+  if (speed == 0 && motionProfiles_.empty() == false) {
+    applyMotionProfile_(distance, accelScale);
+  } else {
+    applyTrapezoid_(speed == 0 ? 500 : speed, accelScale);
+  }
+
+  shapedRamp_.active = false;
+  if (liquidMass > sloshControl_.lightMass && sloshControl_.shaper != InputShaper::Type::NONE && distance > 0) {
+    planShapedMove_(distance, liquidMass);
+  }
+  setTargetPosition_(currentStation_->stepAddress);
 }
 
 bool Transport::isAtTarget() {
@@ -162,12 +572,22 @@ bool Transport::isAtTarget() {
   return false;
 }
 
+// position_reached is raised by the ramp generator itself once XACTUAL equals XTARGET, so there is no
+// float comparison to miss.
 void Transport::awaiting_target_pos() {  
+  if (mirrorStale_) {
+    return;
+  }
 
-  if (motor_->getCurrentPosition() == currentStation_->stepAddress) {
-    Serial.println("[Transport][awaiting_target_pos] -> Target position reached: " + String(currentStationIndex_));
+  if ((mirror_.rampStatus & RAMP_STAT_POSITION_REACHED) && fabs(mirror_.position - currentStation_->stepAddress) < 1.0) {
+    LOG_I("[Transport][awaiting_target_pos] -> Target position reached: ", currentStationIndex_);
+    shapedRamp_.active = false;
     setState_(Transport::MachineState::AT_TARGET);
 
+    if (currentStationIndex_ == 0 && isHomed_) {
+      persistReference_(true);
+    }
+
     if (targetReachedCallback_ != nullptr) {
       (*targetReachedCallback_)(currentStation_, currentStationIndex_);      
     }  
@@ -191,6 +611,14 @@ bool Transport::isReady() {
   return false;
 }
 
+const char* Transport::getHomingMethod() {
+  return homingMethod_;
+}
+
+uint32_t Transport::getHomingDurationMS() {
+  return homingDurationMS_;
+}
+
 Transport::MachineState Transport::getState() {
   return machineState_;
 }
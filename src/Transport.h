@@ -1,8 +1,9 @@
-#include <TMC5160.h>
 #include "Arduino.h"
 #include <memory>
 #include <functional>
 #include <vector>
+#include "InputShaper.h"
+#include "hal/Hal.h"
 
 #pragma once
 
@@ -14,6 +15,42 @@ public:
         int32_t stepAddress;
     };
 
+    // Six-point ramp for the TMC5160 ramp generator (VSTART, A1, V1, AMAX, VMAX, DMAX, D1, VSTOP).
+    // Speeds in steps/s, accelerations in steps/s^2. Used for moves up to maxDistance steps.
+    struct MotionProfile {
+        uint32_t maxDistance;
+        float vstart;
+        float a1;
+        float v1;
+        float amax;
+        float vmax;
+        float dmax;
+        float d1;
+        float vstop;
+    };
+
+    // Last batch of driver registers, refreshed from heartbeat() at the mirror interval while the carriage
+    // moves and only DRV_STATUS, every 100ms, while it stands.
+    struct RegisterMirror {
+        float position = 0;         // XACTUAL, full steps
+        float speed = 0;            // VACTUAL, steps/s
+        uint32_t rampStatus = 0;    // RAMP_STAT
+        uint32_t driverStatus = 0;  // DRV_STATUS
+        uint32_t timeStampUS = 0;
+        uint32_t refreshCount = 0;
+    };
+
+    // Anti-slosh settings. Accelerations scale from 1.0 at lightMass down to fullAccelScale at fullMass,
+    // and loaded moves are shaped against the cup's first slosh mode.
+    struct SloshControl {
+        InputShaper::Type shaper = InputShaper::Type::ZVD;
+        float damping = 0.05;
+        float cupRadiusM = 0.04;
+        float lightMass = 50.0;
+        float fullMass = 400.0;
+        float fullAccelScale = 0.5;
+    };
+
     enum class MachineState {
         NOT_READY,          
         HOMING,                
@@ -27,6 +64,22 @@ public:
         RETRACTING,
         REFINING,
         PARKED,
+        FAST_SEEKING,
+        STOPPING,
+        VERIFYING,
+    };
+
+    enum class HomingMode {
+        STANDARD,           // Slow seek, retract and refine against the polled switch.
+        FAST,               // Fast seek against the latched switch, or a verification touch from the persisted reference.
+    };
+
+    struct HomingParameters {
+        uint16_t seekSpeed = 400;
+        float seekAcceleration = 2000;
+        uint16_t verifySpeed = 60;
+        int32_t verifyTolerance = 8;    // Steps past the expected switch position before the reference is rejected.
+        uint32_t seekTravel = 4000;
     };
 
     using StateChangeCallback = std::function<void(const MachineState&)>;
@@ -37,17 +90,32 @@ public:
     ~Transport();
     void heartbeat();
     void refMachine(DidHomeCallback didHome = nullptr);    
+    void setHomingMode(HomingMode mode);
+    void setHomingParameters(HomingParameters parameters);
     void setStateDidChangeCallback(StateChangeCallback callback);     
     void setTargetReachedCalledBack(TargetReachedCallback callback);     
     uint32_t defineStation(int32_t stepAddress);
-    void goToStation(uint8_t stationIndex, uint16_t speed = 500);
+    uint8_t getStationCount();
+    int32_t getStationAddress(uint8_t stationIndex);
+    uint32_t getTravelDistance(uint8_t fromStationIndex, uint8_t toStationIndex);
+    int8_t getCurrentStationIndex();
+    int32_t getPredictedArrivalMS();
+    void goToStation(uint8_t stationIndex, uint16_t speed = 0, float liquidMass = 0.0); //speed 0 picks a motion profile by distance.
     uint32_t getCurrentPosition();
+    float getCurrentSpeed();
+    uint32_t getDriverStatus();
+    const RegisterMirror& getRegisterMirror();
+    void setMirrorInterval(uint32_t intervalUS);
     void moveStepsRight(u_int32_t steps = 0);
     void moveStepsLeft(u_int32_t steps = 0);
-    void goPark(uint16_t speed = 500);
+    void goPark(uint16_t speed = 0, float liquidMass = 0.0);
+    void setMotionProfiles(std::vector<MotionProfile> profiles);
+    void setSloshControl(SloshControl control);
     bool isParked();
     bool isAtTarget();
     bool isReady();
+    const char* getHomingMethod();
+    uint32_t getHomingDurationMS();
     MachineState getState();
 
 private:   
@@ -58,6 +126,26 @@ private:
     std::vector<Station> stations_;
     std::shared_ptr<Station> currentStation_;
     int8_t currentStationIndex_ = -1;
+    float deceleration_ = 250;
+    float maxSpeed_ = 500;          // VMAX, AMAX and DMAX of the move in progress, before shaping.
+    float acceleration_ = 250;
+    float maxDeceleration_ = 250;
+    std::vector<MotionProfile> motionProfiles_;
+    SloshControl sloshControl_;
+
+    // Trapezoid the move would have run unshaped, convolved with the shaper impulses. heartbeat() streams
+    // the resulting speed into VMAX while XTARGET stays on the station.
+    struct ShapedRamp {
+        bool active = false;
+        uint32_t beginMS = 0;
+        uint32_t lastIssueMS = 0;
+        float speed = 0;            // Cruise speed, lower than VMAX when the move is too short to reach it.
+        float accelTimeS = 0;
+        float cruiseTimeS = 0;
+        float decelTimeS = 0;
+        std::vector<InputShaper::Impulse> impulses;
+    };
+    ShapedRamp shapedRamp_;
 
     std::shared_ptr<StateChangeCallback> stateDidChangeCallback_;
     std::shared_ptr<DidHomeCallback> didHomeCallback_;
@@ -65,16 +153,51 @@ private:
     
     MachineState machineState_ = MachineState::NOT_READY;
     HomingStage homingStage_ = HomingStage::NONE;
+    HomingMode homingMode_ = HomingMode::STANDARD;
+    HomingParameters homingParameters_;
+    uint32_t homingStartMS_ = 0;
+    uint32_t homingDurationMS_ = 0;
+    const char* homingMethod_ = "standard";
+    float latchedHomePosition_ = 0;
+    bool isHomed_ = false;
+    bool referencePersisted_ = false;
+
+    volatile bool homeSwitchArmed_ = false;
+    volatile bool homeSwitchLatched_ = false;
+    volatile uint32_t homeSwitchTimeStampUS_ = 0;
 
-    std::unique_ptr<TMC5160_SPI> motor_;   
+    std::unique_ptr<hal::StepperDriver> motor_;
+    RegisterMirror mirror_;
+    uint32_t mirrorIntervalUS_ = 2000;
+    bool mirrorStale_ = true;
+    uint32_t reportedDriverFaults_ = 0;
 
 
     void setState_(MachineState state);
+    void refreshMirror_();
+    void setTargetPosition_(int32_t position);
+    void applyMotionProfile_(uint32_t distance, float accelScale);
+    void applyTrapezoid_(uint16_t speed, float accelScale);
+    void planShapedMove_(uint32_t distance, float liquidMass);
+    void issueShapedRamp_();
+    float shapedSpeedAt_(float elapsedS);
+    float unshapedSpeedAt_(float elapsedS);
     void referencingMachine_();
+    static void homeSwitchISR_(void* arg, uint32_t timeStampUS);
+    void armHomeSwitch_();
+    bool latchHomePosition_();
+    void startFastSeek_();
+    void startVerifyTouch_(int32_t referencePosition);
+    void startStandardSeek_();
+    void finishHoming_();
+    void persistReference_(bool valid);
 
     void homing_awaiting_rough_home_sw();
     void homing_awaiting_retract();
     void homing_awaiting_home_sw_refining();
+    void homing_awaiting_fast_seek();
+    void homing_awaiting_stop();
+    void homing_awaiting_verify_touch();
     void awaiting_target_pos();    
     
 };
@@ -1,4 +1,5 @@
 #include "Valve.h"
+#include "Logger.h"
 
 Valve::Valve(uint8_t pin_servo, uint32_t closedPosition, uint32_t openPosition, uint32_t frequency) {
     pin_servo_ = pin_servo;    
@@ -9,8 +10,8 @@ Valve::Valve(uint8_t pin_servo, uint32_t closedPosition, uint32_t openPosition,
     position_ =  Position::CLOSED;
     // ESP32PWM::allocateTimer(0);
     
-    servo_.attach(pin_servo_, 500, 2500);
-    servo_.setPeriodHertz(frequency);
+    servo_ = hal::platform().createServo();
+    servo_->attach(pin_servo_, 500, 2500, frequency);
     setPosition(Position::CLOSED);
 }
 
@@ -27,7 +28,7 @@ uint32_t Valve::getClosedPosition() {
 }
 
 void Valve::writeValue(uint32_t value) {
-    servo_.write(value);
+    servo_->write(value);
 }
 
 void Valve::trimOpen(uint32_t value) {
@@ -55,14 +56,56 @@ void Valve::resetTrimPositions() {
 }
 
 
+// Intermediate servo angle between the trimmed closed and open positions, 0.0 closed and 1.0 fully open.
+void Valve::setOpening(float fraction) {
+    fraction = constrain(fraction, 0.0f, 1.0f);
+    uint32_t closed = closedPosition_ + closedPositionTrim_;
+    uint32_t open = openPosition_ + openPositionTrim_;
+    uint32_t angle = closed + round(fraction * ((float)open - (float)closed));
+    opening_ = fraction;
+    position_ = (fraction > 0.0) ? Position::OPEN : Position::CLOSED;
+
+    if (angle != currentPosition_) {
+        currentPosition_ = angle;
+        writeValue(currentPosition_);
+    }
+}
+
+float Valve::getOpening() {
+    return opening_;
+}
+
 void Valve::setPosition(Position position) {
     // position_ = position == Position::CLOSED ? 0 : 1;
     position_ = position;
+    opening_ = (position_ == Position::CLOSED) ? 0.0 : 1.0;
     currentPosition_ = (position_ == Position::CLOSED) ? (closedPosition_ + closedPositionTrim_) : (openPosition_ + openPositionTrim_);
-    servo_.write(currentPosition_);
-    Serial.print("[Valve][setPosition] Setting valve position to: ");
-    Serial.print(position_ == Position::CLOSED ? "CLOSED" : "OPEN");
-    Serial.println(" at: " + String(currentPosition_));
+    servo_->write(currentPosition_);
+    LOG_D("[Valve][setPosition] Setting valve position to: ", position_ == Position::CLOSED ? "CLOSED" : "OPEN", " at: ", currentPosition_);
     
-    positionTimeStamp_ = millis();
+    positionTimeStamp_ = hal::millis();
+}
+
+float Valve::getInFlightWeight() {
+    return inFlightWeight_;
+}
+
+void Valve::setInFlightWeight(float weight) {
+    inFlightWeight_ = constrain(weight, 0.0f, 20.0f);
+}
+
+void Valve::learnInFlightWeight(float observedWeight) {
+    setInFlightWeight(0.7 * inFlightWeight_ + 0.3 * observedWeight);
+}
+
+uint32_t Valve::getActuationLatencyMS() {
+    return actuationLatencyMS_;
+}
+
+void Valve::setActuationLatencyMS(uint32_t latencyMS) {
+    actuationLatencyMS_ = constrain(latencyMS, (uint32_t)0, (uint32_t)2000);
+}
+
+void Valve::learnActuationLatencyMS(uint32_t observedMS) {
+    setActuationLatencyMS((7 * actuationLatencyMS_ + 3 * observedMS) / 10);
 }
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "Arduino.h"
-#include <ESP32Servo.h>
 #include <memory>
+#include "hal/Hal.h"
 
 #pragma once
 
@@ -15,6 +15,8 @@ public:
     Valve(uint8_t pin_servo, uint32_t closedPosition = 50, uint32_t openPosition = 147, uint32_t frequency = 300); //140
     Position getPosition();    
     void setPosition(Position position);
+    void setOpening(float fraction);
+    float getOpening();
     void writeValue(uint32_t value);
     void trimOpen(uint32_t value);
     void trimClosed(uint32_t value);
@@ -23,9 +25,15 @@ public:
     uint32_t getOpenPositionTrim();
     uint32_t getClosedPositionTrim();
     void resetTrimPositions();
+    float getInFlightWeight();
+    void setInFlightWeight(float weight);
+    void learnInFlightWeight(float observedWeight);
+    uint32_t getActuationLatencyMS();
+    void setActuationLatencyMS(uint32_t latencyMS);
+    void learnActuationLatencyMS(uint32_t observedMS);
     
 private:
-    Servo servo_;
+    std::unique_ptr<hal::ServoOutput> servo_;
     Valve::Position position_;
     uint8_t pin_servo_;
     uint8_t timerChannel_;
@@ -34,5 +42,8 @@ private:
     uint32_t openPositionTrim_;
     uint32_t closedPositionTrim_;
     uint32_t currentPosition_;
+    float opening_ = 0.0;
     uint32_t positionTimeStamp_;
+    uint32_t actuationLatencyMS_ = 150; //Open command to first weight on the scale.
+    float inFlightWeight_ = 0.0; //Grams that still land in the cup after the close command.
 };
@@ -0,0 +1,89 @@
+#include "WeightEstimator.h"
+
+float WeightEstimator::predict(uint32_t nowUS) {
+    if (initialized_ == false) {
+        return mass_;
+    }
+    float dt = ((uint32_t)(nowUS - timeStampUS_) + latencyUS_) / 1000000.0f;
+    return mass_ + flowRate_ * dt;
+}
+
+AlphaBetaEstimator::AlphaBetaEstimator(float alpha, float beta) : alpha_(alpha), beta_(beta) {}
+
+void AlphaBetaEstimator::update(float measurement, uint32_t timeStampUS) {
+    if (initialized_ == false) {
+        mass_ = measurement;
+        flowRate_ = 0.0;
+        timeStampUS_ = timeStampUS;
+        initialized_ = true;
+        return;
+    }
+
+    float dt = (uint32_t)(timeStampUS - timeStampUS_) / 1000000.0f;
+    timeStampUS_ = timeStampUS;
+    if (dt <= 0.0f) {
+        return;
+    }
+
+    float predicted = mass_ + flowRate_ * dt;
+    float residual = measurement - predicted;
+    mass_ = predicted + alpha_ * residual;
+    flowRate_ += (beta_ / dt) * residual;
+}
+
+void AlphaBetaEstimator::reset(float mass) {
+    mass_ = mass;
+    flowRate_ = 0.0;
+    initialized_ = false;
+}
+
+KalmanEstimator::KalmanEstimator(float processNoise, float measurementNoise) : q_(processNoise), r_(measurementNoise) {
+    reset();
+}
+
+void KalmanEstimator::update(float measurement, uint32_t timeStampUS) {
+    if (initialized_ == false) {
+        mass_ = measurement;
+        flowRate_ = 0.0;
+        timeStampUS_ = timeStampUS;
+        initialized_ = true;
+        return;
+    }
+
+    float dt = (uint32_t)(timeStampUS - timeStampUS_) / 1000000.0f;
+    timeStampUS_ = timeStampUS;
+    if (dt <= 0.0f) {
+        return;
+    }
+
+    // Predict
+    mass_ += flowRate_ * dt;
+    float dt2 = dt * dt;
+    float p00 = p00_ + dt * (p10_ + p01_) + dt2 * p11_ + q_ * dt2 * dt2 / 4.0f;
+    float p01 = p01_ + dt * p11_ + q_ * dt2 * dt / 2.0f;
+    float p10 = p10_ + dt * p11_ + q_ * dt2 * dt / 2.0f;
+    float p11 = p11_ + q_ * dt2;
+
+    // Update
+    float residual = measurement - mass_;
+    float s = p00 + r_;
+    float k0 = p00 / s;
+    float k1 = p10 / s;
+    mass_ += k0 * residual;
+    flowRate_ += k1 * residual;
+
+    p00_ = (1.0f - k0) * p00;
+    p01_ = (1.0f - k0) * p01;
+    p10_ = p10 - k1 * p00;
+    p11_ = p11 - k1 * p01;
+}
+
+void KalmanEstimator::reset(float mass) {
+    mass_ = mass;
+    flowRate_ = 0.0;
+    p00_ = r_;
+    p01_ = 0.0;
+    p10_ = 0.0;
+    p11_ = 100.0;
+    initialized_ = false;
+}
@@ -0,0 +1,53 @@
+#include <stdint.h>
+
+#pragma once
+
+// Estimates mass and mass flow from timestamped load cell samples. predict() extrapolates the
+// estimate to "now", covering both the time since the last sample and the sample's own latency
+// (the HX711 integrates over its whole conversion period).
+class WeightEstimator
+{
+public:
+    virtual ~WeightEstimator() {}
+    virtual void update(float measurement, uint32_t timeStampUS) = 0;
+    virtual void reset(float mass = 0.0) = 0;
+    float getMass() { return mass_; }
+    float getFlowRate() { return flowRate_; }
+    bool hasEstimate() { return initialized_; }
+    void setLatencyUS(uint32_t latencyUS) { latencyUS_ = latencyUS; }
+    float predict(uint32_t nowUS);
+
+protected:
+    float mass_ = 0.0;
+    float flowRate_ = 0.0; //Units per second.
+    uint32_t timeStampUS_ = 0;
+    uint32_t latencyUS_ = 0;
+    bool initialized_ = false;
+};
+
+class AlphaBetaEstimator : public WeightEstimator
+{
+public:
+    AlphaBetaEstimator(float alpha = 0.5, float beta = 0.1);
+    void update(float measurement, uint32_t timeStampUS) override;
+    void reset(float mass = 0.0) override;
+
+private:
+    float alpha_;
+    float beta_;
+};
+
+// Constant flow model with white noise acceleration. processNoise is the acceleration variance
+// ((g/s^2)^2), measurementNoise the variance of a single sample (g^2).
+class KalmanEstimator : public WeightEstimator
+{
+public:
+    KalmanEstimator(float processNoise = 2000.0, float measurementNoise = 0.04);
+    void update(float measurement, uint32_t timeStampUS) override;
+    void reset(float mass = 0.0) override;
+
+private:
+    float q_;
+    float r_;
+    float p00_, p01_, p10_, p11_;
+};
@@ -0,0 +1,18 @@
+#include "Hal.h"
+
+namespace hal
+{
+
+namespace {
+    Platform* activePlatform = nullptr;
+}
+
+void setPlatform(Platform* platform) {
+    activePlatform = platform;
+}
+
+Platform& platform() {
+    return *activePlatform;
+}
+
+}
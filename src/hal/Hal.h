@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+#pragma once
+
+// Hardware abstraction layer. The machine core (transport, dispenser, dispatcher, LEDs, BLE engine,
+// stores) only talks to hardware through these interfaces, a Platform hands out the implementations.
+// hal/esp32 drives the real machine, hal/native provides fakes so the core builds and runs on a host.
+// Pin modes, levels and interrupt edges use the Arduino constants.
+namespace hal
+{
+    class Clock {
+    public:
+        virtual ~Clock() = default;
+        virtual uint32_t millis() = 0;
+        virtual uint32_t micros() = 0;
+    };
+
+    class Gpio {
+    public:
+        // Called from interrupt context with the time of the edge, on the ESP32 it must live in IRAM.
+        using InterruptHandler = void (*)(void* arg, uint32_t timeStampUS);
+
+        virtual ~Gpio() = default;
+        virtual void pinMode(uint8_t pin, uint8_t mode) = 0;
+        virtual void digitalWrite(uint8_t pin, uint8_t level) = 0;
+        virtual int digitalRead(uint8_t pin) = 0;
+        virtual void attachInterrupt(uint8_t pin, InterruptHandler handler, void* arg, int edge) = 0;
+    };
+
+    // Ramp-generator stepper driver (TMC5160 on the machine). Positions in steps, speeds in steps/s,
+    // accelerations in steps/s^2.
+    class StepperDriver {
+    public:
+        static const uint32_t RAMP_STAT_POSITION_REACHED = 1UL << 9;
+
+        virtual ~StepperDriver() = default;
+        virtual void enable() = 0;
+        virtual float getCurrentPosition() = 0;
+        virtual float getCurrentSpeed() = 0;
+        virtual void setCurrentPosition(float position) = 0;
+        virtual void setTargetPosition(float position) = 0;
+        virtual void setMaxSpeed(float speed) = 0;
+        virtual void setAcceleration(float acceleration) = 0;
+        virtual void setAccelerations(float maxAccel, float maxDecel, float startAccel, float finalDecel) = 0;
+        virtual void setRampSpeeds(float startSpeed, float stopSpeed, float transitionSpeed) = 0;
+        virtual void stop() = 0;
+        virtual uint32_t readRampStatus() = 0;
+        virtual uint32_t readDriverStatus() = 0;
+    };
+
+    // Raw conversions of the load-cell ADC (HX711), scale and offset are applied by the caller.
+    class LoadCellAdc {
+    public:
+        virtual ~LoadCellAdc() = default;
+        virtual bool isReady() = 0;
+        virtual int32_t read() = 0;
+    };
+
+    class ServoOutput {
+    public:
+        virtual ~ServoOutput() = default;
+        virtual void attach(uint8_t pin, uint16_t minPulseUS, uint16_t maxPulseUS, uint32_t frequency) = 0;
+        virtual void write(uint32_t angle) = 0;
+    };
+
+    struct Rgb {
+        uint8_t r = 0;
+        uint8_t g = 0;
+        uint8_t b = 0;
+
+        Rgb() = default;
+        Rgb(uint8_t red, uint8_t green, uint8_t blue) : r(red), g(green), b(blue) {}
+        bool operator==(const Rgb& other) const { return r == other.r && g == other.g && b == other.b; }
+        bool operator!=(const Rgb& other) const { return !(*this == other); }
+    };
+
+    // WS2812 chain. show() starts clocking a frame out and returns, isBusy() stays true until it is
+    // out and latched; a frame shown while busy is dropped.
+    class LedStrip {
+    public:
+        static const uint32_t PIXEL_US = 30;       // 24 bits at 800kHz.
+        static const uint32_t LATCH_US = 300;      // Line low before the pixels take the frame.
+
+        virtual ~LedStrip() = default;
+        virtual void setBrightness(uint8_t brightness) = 0;
+        virtual void show(const Rgb* pixels, uint16_t count) = 0;
+        virtual bool isBusy() = 0;
+    };
+
+    // GATT server with the machine's characteristics. Callbacks may run on the radio's own task.
+    class BleTransport {
+    public:
+        enum class Channel : uint8_t {
+            CONTROL,
+            STATUS,
+            DIAGNOSTICS,
+        };
+
+        using ConnectionCallback = std::function<void(bool connected)>;
+        using IntervalCallback = std::function<void(uint32_t intervalMS)>;
+        using WriteCallback = std::function<void(const std::string& data)>;
+
+        virtual ~BleTransport() = default;
+        virtual void begin(const char* deviceName, ConnectionCallback connection, IntervalCallback interval, WriteCallback write) = 0;
+        virtual void startAdvertising() = 0;
+        virtual void stopAdvertising() = 0;
+        virtual void setValue(Channel channel, const uint8_t* data, size_t length) = 0;
+        virtual void notify(Channel channel, const uint8_t* data, size_t length) = 0;
+    };
+
+    // Namespaced key/value storage that survives a power cycle (NVS on the machine). Same calls as
+    // the Arduino Preferences library, every user opens its own handle.
+    class Storage {
+    public:
+        virtual ~Storage() = default;
+        virtual bool begin(const char* name, bool readOnly) = 0;
+        virtual void end() = 0;
+        virtual bool getBool(const char* key, bool defaultValue) = 0;
+        virtual int32_t getInt(const char* key, int32_t defaultValue) = 0;
+        virtual uint32_t getUInt(const char* key, uint32_t defaultValue) = 0;
+        virtual float getFloat(const char* key, float defaultValue) = 0;
+        virtual size_t getBytesLength(const char* key) = 0;
+        virtual size_t getBytes(const char* key, void* buffer, size_t length) = 0;
+        virtual void putBool(const char* key, bool value) = 0;
+        virtual void putInt(const char* key, int32_t value) = 0;
+        virtual void putUInt(const char* key, uint32_t value) = 0;
+        virtual void putFloat(const char* key, float value) = 0;
+        virtual size_t putBytes(const char* key, const void* value, size_t length) = 0;
+        virtual bool remove(const char* key) = 0;
+    };
+
+    class Platform {
+    public:
+        virtual ~Platform() = default;
+        virtual Clock& clock() = 0;
+        virtual Gpio& gpio() = 0;
+        virtual std::unique_ptr<StepperDriver> createStepper(uint8_t csPin) = 0;
+        virtual std::unique_ptr<LoadCellAdc> createLoadCellAdc(uint8_t datPin, uint8_t sckPin) = 0;
+        virtual std::unique_ptr<ServoOutput> createServo() = 0;
+        virtual std::unique_ptr<LedStrip> createLedStrip(uint8_t dataPin, uint16_t count) = 0;
+        virtual std::unique_ptr<BleTransport> createBleTransport() = 0;
+        virtual std::unique_ptr<Storage> createStorage() = 0;
+    };
+
+    // Must be set before any core object is created.
+    void setPlatform(Platform* platform);
+    Platform& platform();
+
+    inline Clock& clock() { return platform().clock(); }
+    inline Gpio& gpio() { return platform().gpio(); }
+    inline uint32_t millis() { return platform().clock().millis(); }
+    inline uint32_t micros() { return platform().clock().micros(); }
+}
@@ -0,0 +1,95 @@
+#include "Esp32BleTransport.h"
+
+namespace hal
+{
+
+void Esp32BleTransport::begin(const char* deviceName, ConnectionCallback connection, IntervalCallback interval, WriteCallback write) {
+    connectionCallback_ = connection;
+    intervalCallback_ = interval;
+    writeCallback_ = write;
+
+    BLEDevice::init(deviceName);
+    server_ = BLEDevice::createServer();
+    server_->setCallbacks(this);
+
+    BLEService *service = server_->createService(SERVICE_UUID);
+
+    // Control
+    characteristicControl_ = service->createCharacteristic(CONTROL_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
+    controlCallbacks_.transport = this;
+    characteristicControl_->setCallbacks(&controlCallbacks_);
+    characteristicControl_->addDescriptor(new BLE2902());
+
+    // Status
+    characteristicStatus_ = service->createCharacteristic(STATUS_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
+    characteristicStatus_->addDescriptor(new BLE2902());
+
+    // Diagnostics, read only, refreshed by the loop
+    characteristicDiagnostics_ = service->createCharacteristic(DIAGNOSTICS_UUID, BLECharacteristic::PROPERTY_READ);
+
+    // Start Service
+    service->start();
+
+    // Setup Advertising
+    BLEAdvertising *advertising = BLEDevice::getAdvertising();
+    advertising->addServiceUUID(SERVICE_UUID);
+    advertising->setScanResponse(true);
+    advertising->setMinPreferred(0x06);
+    advertising->setMinPreferred(0x12);
+}
+
+void Esp32BleTransport::startAdvertising() {
+    BLEDevice::startAdvertising();
+}
+
+void Esp32BleTransport::stopAdvertising() {
+    BLEDevice::stopAdvertising();
+}
+
+BLECharacteristic* Esp32BleTransport::characteristic_(Channel channel) {
+    switch (channel) {
+    case Channel::CONTROL:
+        return characteristicControl_;
+    case Channel::STATUS:
+        return characteristicStatus_;
+    default:
+        return characteristicDiagnostics_;
+    }
+}
+
+void Esp32BleTransport::setValue(Channel channel, const uint8_t* data, size_t length) {
+    characteristic_(channel)->setValue(const_cast<uint8_t*>(data), length);
+}
+
+void Esp32BleTransport::notify(Channel channel, const uint8_t* data, size_t length) {
+    BLECharacteristic *characteristic = characteristic_(channel);
+    characteristic->setValue(const_cast<uint8_t*>(data), length);
+    characteristic->notify();
+}
+
+void Esp32BleTransport::onConnect(BLEServer *server) {
+    if (connectionCallback_) {
+        connectionCallback_(true);
+    }
+}
+
+// Interval is in 1.25ms units.
+void Esp32BleTransport::onConnect(BLEServer *server, esp_ble_gatts_cb_param_t *param) {
+    if (intervalCallback_) {
+        intervalCallback_(param->connect.conn_params.interval * 5 / 4);
+    }
+}
+
+void Esp32BleTransport::onDisconnect(BLEServer *server) {
+    if (connectionCallback_) {
+        connectionCallback_(false);
+    }
+}
+
+void Esp32BleTransport::ControlCallbacks::onWrite(BLECharacteristic *characteristic) {
+    if (transport->writeCallback_) {
+        transport->writeCallback_(characteristic->getValue());
+    }
+}
+
+}
@@ -0,0 +1,49 @@
+#include "Arduino.h"
+#include <BLEDevice.h>
+#include <BLEUtils.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+#include "../Hal.h"
+
+#pragma once
+
+#define SERVICE_UUID "94635d24-cf8d-4ff8-9191-de713f39db89"
+#define CONTROL_UUID "4ac8a682-9736-4e5d-932b-e9b31405049c"
+#define STATUS_UUID "6bcdd021-ffa5-4522-9454-a21d025d6562"
+#define DIAGNOSTICS_UUID "f1545104-0c59-4c74-8019-36d3036fdab9"
+
+namespace hal
+{
+    // The machine's GATT service on the ESP32 BLE stack: control (client writes), status
+    // (notifications) and diagnostics (read only).
+    class Esp32BleTransport : public BleTransport, public BLEServerCallbacks {
+    public:
+        void begin(const char* deviceName, ConnectionCallback connection, IntervalCallback interval, WriteCallback write) override;
+        void startAdvertising() override;
+        void stopAdvertising() override;
+        void setValue(Channel channel, const uint8_t* data, size_t length) override;
+        void notify(Channel channel, const uint8_t* data, size_t length) override;
+
+        void onConnect(BLEServer *server) override;
+        void onConnect(BLEServer *server, esp_ble_gatts_cb_param_t *param) override;
+        void onDisconnect(BLEServer *server) override;
+
+    private:
+        class ControlCallbacks : public BLECharacteristicCallbacks {
+        public:
+            Esp32BleTransport *transport;
+            void onWrite(BLECharacteristic *characteristic) override;
+        };
+
+        BLECharacteristic* characteristic_(Channel channel);
+
+        BLEServer *server_ = nullptr;
+        BLECharacteristic *characteristicControl_ = nullptr;
+        BLECharacteristic *characteristicStatus_ = nullptr;
+        BLECharacteristic *characteristicDiagnostics_ = nullptr;
+        ControlCallbacks controlCallbacks_;
+        ConnectionCallback connectionCallback_;
+        IntervalCallback intervalCallback_;
+        WriteCallback writeCallback_;
+    };
+}
@@ -0,0 +1,108 @@
+#include "Esp32Platform.h"
+#include "Esp32BleTransport.h"
+
+namespace hal
+{
+
+// attachInterruptArg() only passes one argument, each pin gets a slot with the real handler and its
+// argument. The edge is timestamped here so handlers never call into the clock from an ISR.
+void Esp32Gpio::attachInterrupt(uint8_t pin, InterruptHandler handler, void* arg, int edge) {
+    if (slotCount_ >= MAX_INTERRUPTS) {
+        return;
+    }
+    Slot& slot = slots_[slotCount_++];
+    slot.handler = handler;
+    slot.arg = arg;
+    attachInterruptArg(pin, trampoline_, &slot, edge);
+}
+
+void IRAM_ATTR Esp32Gpio::trampoline_(void* arg) {
+    Slot* slot = static_cast<Slot*>(arg);
+    slot->handler(slot->arg, ::micros());
+}
+
+Esp32Stepper::Esp32Stepper(uint8_t csPin) : motor_(csPin) {
+    TMC5160::PowerStageParameters powerStageParams; // defaults.
+    TMC5160::MotorParameters motorParams;
+    motorParams.globalScaler = 60; // Adapt to your driver and motor (check TMC5160 datasheet - "Selecting sense resistors")
+    motorParams.irun = 25;
+    motorParams.ihold = 17;
+    motor_.begin(powerStageParams, motorParams, TMC5160::NORMAL_MOTOR_DIRECTION);
+    motor_.setRampMode(TMC5160::POSITIONING_MODE);
+}
+
+void Esp32Servo::attach(uint8_t pin, uint16_t minPulseUS, uint16_t maxPulseUS, uint32_t frequency) {
+    servo_.attach(pin, minPulseUS, maxPulseUS);
+    servo_.setPeriodHertz(frequency);
+}
+
+// 40MHz RMT clock (25ns ticks). Four memory blocks keep the refill interrupts to a handful per frame.
+Esp32LedStrip::Esp32LedStrip(uint8_t dataPin, uint16_t count) : count_(count < MAX_LEDS ? count : MAX_LEDS) {
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)dataPin, CHANNEL);
+    config.clk_div = 2;
+    config.mem_block_num = 4;
+    rmt_config(&config);
+    rmt_driver_install(CHANNEL, 0, 0);
+
+    Rgb off[MAX_LEDS];
+    show(off, count_);
+}
+
+// Brightness is applied while encoding, like FastLED's scale8.
+void Esp32LedStrip::show(const Rgb* pixels, uint16_t count) {
+    if (isBusy()) {
+        return;
+    }
+
+    count = count < count_ ? count : count_;
+    for (uint16_t i = 0; i < count; i++) {
+        encode_(pixels[i].g, &items_[i * 24]);
+        encode_(pixels[i].r, &items_[i * 24 + 8]);
+        encode_(pixels[i].b, &items_[i * 24 + 16]);
+    }
+    latchedUS_ = ::micros() + count * PIXEL_US + LATCH_US;
+    rmt_write_items(CHANNEL, items_, count * 24, false);
+}
+
+// The items buffer belongs to the driver until the transmission is done.
+bool Esp32LedStrip::isBusy() {
+    return rmt_wait_tx_done(CHANNEL, 0) != ESP_OK || (int32_t)(::micros() - latchedUS_) < 0;
+}
+
+// T0H 0.4us / T0L 0.85us, T1H 0.8us / T1L 0.45us.
+void Esp32LedStrip::encode_(uint8_t value, rmt_item32_t* items) {
+    value = ((uint16_t)value * (1 + brightness_)) >> 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        bool one = value & (0x80 >> bit);
+        items[bit].level0 = 1;
+        items[bit].duration0 = one ? 32 : 16;
+        items[bit].level1 = 0;
+        items[bit].duration1 = one ? 18 : 34;
+    }
+}
+
+std::unique_ptr<StepperDriver> Esp32Platform::createStepper(uint8_t csPin) {
+    return std::unique_ptr<StepperDriver>(new Esp32Stepper(csPin));
+}
+
+std::unique_ptr<LoadCellAdc> Esp32Platform::createLoadCellAdc(uint8_t datPin, uint8_t sckPin) {
+    return std::unique_ptr<LoadCellAdc>(new Esp32LoadCellAdc(datPin, sckPin));
+}
+
+std::unique_ptr<ServoOutput> Esp32Platform::createServo() {
+    return std::unique_ptr<ServoOutput>(new Esp32Servo());
+}
+
+std::unique_ptr<LedStrip> Esp32Platform::createLedStrip(uint8_t dataPin, uint16_t count) {
+    return std::unique_ptr<LedStrip>(new Esp32LedStrip(dataPin, count));
+}
+
+std::unique_ptr<BleTransport> Esp32Platform::createBleTransport() {
+    return std::unique_ptr<BleTransport>(new Esp32BleTransport());
+}
+
+std::unique_ptr<Storage> Esp32Platform::createStorage() {
+    return std::unique_ptr<Storage>(new Esp32Storage());
+}
+
+}
@@ -0,0 +1,137 @@
+#include "Arduino.h"
+#include <TMC5160.h>
+#include <HX711.h>
+#include <ESP32Servo.h>
+#include <driver/rmt.h>
+#include <Preferences.h>
+#include "../Hal.h"
+
+#pragma once
+
+namespace hal
+{
+    class Esp32Clock : public Clock {
+    public:
+        uint32_t millis() override { return ::millis(); }
+        uint32_t micros() override { return ::micros(); }
+    };
+
+    class Esp32Gpio : public Gpio {
+    public:
+        static const uint8_t MAX_INTERRUPTS = 4;
+
+        void pinMode(uint8_t pin, uint8_t mode) override { ::pinMode(pin, mode); }
+        void digitalWrite(uint8_t pin, uint8_t level) override { ::digitalWrite(pin, level); }
+        int digitalRead(uint8_t pin) override { return ::digitalRead(pin); }
+        void attachInterrupt(uint8_t pin, InterruptHandler handler, void* arg, int edge) override;
+
+    private:
+        struct Slot {
+            InterruptHandler handler = nullptr;
+            void* arg = nullptr;
+        };
+
+        static void trampoline_(void* arg);
+
+        Slot slots_[MAX_INTERRUPTS];
+        uint8_t slotCount_ = 0;
+    };
+
+    class Esp32Stepper : public StepperDriver {
+    public:
+        explicit Esp32Stepper(uint8_t csPin);
+        void enable() override { motor_.enable(); }
+        float getCurrentPosition() override { return motor_.getCurrentPosition(); }
+        float getCurrentSpeed() override { return motor_.getCurrentSpeed(); }
+        void setCurrentPosition(float position) override { motor_.setCurrentPosition(position); }
+        void setTargetPosition(float position) override { motor_.setTargetPosition(position); }
+        void setMaxSpeed(float speed) override { motor_.setMaxSpeed(speed); }
+        void setAcceleration(float acceleration) override { motor_.setAcceleration(acceleration); }
+        void setAccelerations(float maxAccel, float maxDecel, float startAccel, float finalDecel) override { motor_.setAccelerations(maxAccel, maxDecel, startAccel, finalDecel); }
+        void setRampSpeeds(float startSpeed, float stopSpeed, float transitionSpeed) override { motor_.setRampSpeeds(startSpeed, stopSpeed, transitionSpeed); }
+        void stop() override { motor_.stop(); }
+        uint32_t readRampStatus() override { return motor_.readRegister(TMC5160_Reg::RAMP_STAT); }
+        uint32_t readDriverStatus() override { return motor_.readRegister(TMC5160_Reg::DRV_STATUS); }
+
+    private:
+        TMC5160_SPI motor_;
+    };
+
+    class Esp32LoadCellAdc : public LoadCellAdc {
+    public:
+        Esp32LoadCellAdc(uint8_t datPin, uint8_t sckPin) { scale_.begin(datPin, sckPin); }
+        bool isReady() override { return scale_.is_ready(); }
+        int32_t read() override { return scale_.read(); }
+
+    private:
+        HX711 scale_;
+    };
+
+    class Esp32Servo : public ServoOutput {
+    public:
+        void attach(uint8_t pin, uint16_t minPulseUS, uint16_t maxPulseUS, uint32_t frequency) override;
+        void write(uint32_t angle) override { servo_.write(angle); }
+
+    private:
+        Servo servo_;
+    };
+
+    // WS2812 (GRB) on the RMT peripheral. show() encodes the frame into RMT items and returns while
+    // the hardware clocks it out, refilled from its ISR; no bit-banging and interrupts stay on.
+    class Esp32LedStrip : public LedStrip {
+    public:
+        static const uint16_t MAX_LEDS = 76;
+
+        Esp32LedStrip(uint8_t dataPin, uint16_t count);
+        void setBrightness(uint8_t brightness) override { brightness_ = brightness; }
+        void show(const Rgb* pixels, uint16_t count) override;
+        bool isBusy() override;
+
+    private:
+        static const rmt_channel_t CHANNEL = RMT_CHANNEL_0;
+
+        void encode_(uint8_t value, rmt_item32_t* items);
+
+        rmt_item32_t items_[MAX_LEDS * 24];
+        uint16_t count_;
+        uint8_t brightness_ = 255;
+        uint32_t latchedUS_ = 0;    // When the last frame is out and latched.
+    };
+
+    class Esp32Storage : public Storage {
+    public:
+        bool begin(const char* name, bool readOnly) override { return preferences_.begin(name, readOnly); }
+        void end() override { preferences_.end(); }
+        bool getBool(const char* key, bool defaultValue) override { return preferences_.getBool(key, defaultValue); }
+        int32_t getInt(const char* key, int32_t defaultValue) override { return preferences_.getInt(key, defaultValue); }
+        uint32_t getUInt(const char* key, uint32_t defaultValue) override { return preferences_.getUInt(key, defaultValue); }
+        float getFloat(const char* key, float defaultValue) override { return preferences_.getFloat(key, defaultValue); }
+        size_t getBytesLength(const char* key) override { return preferences_.getBytesLength(key); }
+        size_t getBytes(const char* key, void* buffer, size_t length) override { return preferences_.getBytes(key, buffer, length); }
+        void putBool(const char* key, bool value) override { preferences_.putBool(key, value); }
+        void putInt(const char* key, int32_t value) override { preferences_.putInt(key, value); }
+        void putUInt(const char* key, uint32_t value) override { preferences_.putUInt(key, value); }
+        void putFloat(const char* key, float value) override { preferences_.putFloat(key, value); }
+        size_t putBytes(const char* key, const void* value, size_t length) override { return preferences_.putBytes(key, value, length); }
+        bool remove(const char* key) override { return preferences_.remove(key); }
+
+    private:
+        Preferences preferences_;
+    };
+
+    class Esp32Platform : public Platform {
+    public:
+        Clock& clock() override { return clock_; }
+        Gpio& gpio() override { return gpio_; }
+        std::unique_ptr<StepperDriver> createStepper(uint8_t csPin) override;
+        std::unique_ptr<LoadCellAdc> createLoadCellAdc(uint8_t datPin, uint8_t sckPin) override;
+        std::unique_ptr<ServoOutput> createServo() override;
+        std::unique_ptr<LedStrip> createLedStrip(uint8_t dataPin, uint16_t count) override;
+        std::unique_ptr<BleTransport> createBleTransport() override;
+        std::unique_ptr<Storage> createStorage() override;
+
+    private:
+        Esp32Clock clock_;
+        Esp32Gpio gpio_;
+    };
+}
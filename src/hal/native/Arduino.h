@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+#pragma once
+
+// Just enough of the Arduino core for the machine core to build on a host. Hardware access goes
+// through hal::Platform, nothing here touches a pin or a clock.
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define IRAM_ATTR
+
+#define TX 8
+#define RX 7
+
+using std::max;
+using std::min;
+using std::round;
+using std::abs;
+
+template <typename T, typename L, typename H>
+T constrain(T value, L low, H high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// Arduino String on top of std::string, numbers render like the real one (floats with two decimals).
+class String {
+public:
+    String(const char* text = "") : text_(text) {}
+    String(const std::string& text) : text_(text) {}
+    String(char value) : text_(1, value) {}
+    String(int value) : text_(std::to_string(value)) {}
+    String(unsigned int value) : text_(std::to_string(value)) {}
+    String(long value) : text_(std::to_string(value)) {}
+    String(unsigned long value) : text_(std::to_string(value)) {}
+    String(unsigned char value) : text_(std::to_string(value)) {}
+    String(double value, unsigned char decimals = 2) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.*f", decimals, value);
+        text_ = text;
+    }
+
+    const char* c_str() const { return text_.c_str(); }
+    unsigned int length() const { return text_.length(); }
+
+    String& operator+=(const String& other) { text_ += other.text_; return *this; }
+    String& operator+=(const char* other) { text_ += other; return *this; }
+    bool operator==(const String& other) const { return text_ == other.text_; }
+    bool operator!=(const String& other) const { return text_ != other.text_; }
+
+    friend String operator+(const String& left, const String& right) { return String(left.text_ + right.text_); }
+    friend String operator+(const String& left, const char* right) { return String(left.text_ + right); }
+    friend String operator+(const char* left, const String& right) { return String(left + right.text_); }
+
+private:
+    std::string text_;
+};
@@ -0,0 +1,226 @@
+#include "FakePlatform.h"
+
+namespace hal
+{
+
+void FakeGpio::attachInterrupt(uint8_t pin, InterruptHandler handler, void* arg, int edge) {
+    interrupts_[pin].handler = handler;
+    interrupts_[pin].arg = arg;
+    interrupts_[pin].edge = edge;
+}
+
+void FakeGpio::setInput(uint8_t pin, uint8_t level) {
+    uint8_t previous = levels_[pin];
+    levels_[pin] = level;
+    if (previous == level || interrupts_[pin].handler == nullptr) {
+        return;
+    }
+
+    int edge = level == HIGH ? RISING : FALLING;
+    if (interrupts_[pin].edge == edge || interrupts_[pin].edge == CHANGE) {
+        interrupts_[pin].handler(interrupts_[pin].arg, clock_.micros());
+    }
+}
+
+void FakeStepper::setAccelerations(float maxAccel, float maxDecel, float startAccel, float finalDecel) {
+    update_();
+    maxAccel_ = maxAccel;
+    maxDecel_ = maxDecel;
+    startAccel_ = startAccel;
+    finalDecel_ = finalDecel;
+}
+
+void FakeStepper::setRampSpeeds(float startSpeed, float stopSpeed, float transitionSpeed) {
+    update_();
+    startSpeed_ = startSpeed;
+    stopSpeed_ = stopSpeed;
+    transitionSpeed_ = transitionSpeed;
+}
+
+uint32_t FakeStepper::readRampStatus() {
+    update_();
+    readCount_++;
+    return (position_ == target_ && speed_ == 0) ? RAMP_STAT_POSITION_REACHED : 0;
+}
+
+void FakeStepper::update_() {
+    uint64_t now = clock_.nowUS();
+    while (lastUpdateUS_ < now) {
+        uint64_t stepUS = std::min<uint64_t>(now - lastUpdateUS_, 1000);
+        step_(stepUS / 1000000.0f);
+        lastUpdateUS_ += stepUS;
+    }
+}
+
+float FakeStepper::accelerationAt_(float speed) {
+    return transitionSpeed_ > 0 && speed < transitionSpeed_ ? startAccel_ : maxAccel_;
+}
+
+float FakeStepper::decelerationAt_(float speed) {
+    return transitionSpeed_ > 0 && speed <= transitionSpeed_ ? finalDecel_ : maxDecel_;
+}
+
+// Distance to brake from speed down to VSTOP, DMAX above V1 and D1 below it.
+float FakeStepper::stoppingDistance_(float speed) {
+    if (speed <= stopSpeed_) {
+        return 0;
+    }
+    if (transitionSpeed_ > 0 && speed > transitionSpeed_) {
+        float upper = (speed * speed - transitionSpeed_ * transitionSpeed_) / (2 * maxDecel_);
+        float lower = (transitionSpeed_ * transitionSpeed_ - stopSpeed_ * stopSpeed_) / (2 * finalDecel_);
+        return upper + std::max(lower, 0.0f);
+    }
+    return (speed * speed - stopSpeed_ * stopSpeed_) / (2 * decelerationAt_(speed));
+}
+
+// Starts at VSTART, accelerates with A1 up to V1 and AMAX up to VMAX, and brakes with DMAX then D1
+// once the stopping distance reaches the distance left. The last stretch runs at VSTOP and the
+// target is snapped to when crossed, like the driver stopping on it. Moving away from the target or
+// stop() (VMAX 0) brakes to standstill first.
+void FakeStepper::step_(float dt) {
+    if (enabled_ == false) {
+        return;
+    }
+
+    float distance = target_ - position_;
+    if (speed_ == 0 && (distance == 0 || maxSpeed_ == 0)) {
+        return;
+    }
+
+    float direction = distance >= 0 ? 1.0f : -1.0f;
+    float along = speed_ * direction;
+    if (along < 0 || maxSpeed_ == 0) {
+        float magnitude = fabs(speed_);
+        magnitude = std::max(magnitude - decelerationAt_(magnitude) * dt, 0.0f);
+        speed_ = speed_ < 0 ? -magnitude : magnitude;
+    } else {
+        if (along > maxSpeed_) {
+            along = std::max(along - decelerationAt_(along) * dt, maxSpeed_);
+        } else if (stoppingDistance_(along) >= fabs(distance)) {
+            along = std::max(along - decelerationAt_(along) * dt, stopSpeed_);
+        } else {
+            along = std::min(std::max(along, startSpeed_) + accelerationAt_(along) * dt, maxSpeed_);
+        }
+        speed_ = along * direction;
+    }
+    position_ += speed_ * dt;
+
+    float remaining = target_ - position_;
+    if (maxSpeed_ > 0 && speed_ * direction >= 0 && (remaining == 0 || (remaining > 0) != (distance > 0))) {
+        position_ = target_;
+        speed_ = 0;
+    }
+}
+
+int32_t FakeLoadCellAdc::read() {
+    nextConversionUS_ = clock_.nowUS() + samplePeriodUS_;
+    readCount_++;
+    return source_ ? source_() : raw_;
+}
+
+// Takes as long as the real chain to clock out, a frame shown meanwhile is dropped like on the RMT.
+void FakeLedStrip::show(const Rgb* pixels, uint16_t count) {
+    if (isBusy()) {
+        return;
+    }
+    for (uint16_t i = 0; i < count && i < pixels_.size(); i++) {
+        pixels_[i] = pixels[i];
+    }
+    showCount_++;
+    busyUntilUS_ = clock_.nowUS() + count * PIXEL_US + LATCH_US;
+}
+
+void FakeBleTransport::begin(const char* deviceName, ConnectionCallback connection, IntervalCallback interval, WriteCallback write) {
+    connectionCallback_ = connection;
+    intervalCallback_ = interval;
+    writeCallback_ = write;
+}
+
+void FakeBleTransport::setValue(Channel channel, const uint8_t* data, size_t length) {
+    values_[(uint8_t)channel].assign((const char*)data, length);
+}
+
+void FakeBleTransport::notify(Channel channel, const uint8_t* data, size_t length) {
+    setValue(channel, data, length);
+    notifications_.push_back(values_[(uint8_t)channel]);
+}
+
+void FakeBleTransport::connect(uint32_t intervalMS) {
+    connectionCallback_(true);
+    intervalCallback_(intervalMS);
+}
+
+void FakeBleTransport::disconnect() {
+    connectionCallback_(false);
+}
+
+void FakeBleTransport::write(const std::string& data) {
+    writeCallback_(data);
+}
+
+std::map<std::string, FakeStorage::Space>& FakeStorage::spaces_() {
+    static std::map<std::string, Space> spaces;
+    return spaces;
+}
+
+std::map<std::string, uint32_t>& FakeStorage::writes_() {
+    static std::map<std::string, uint32_t> writes;
+    return writes;
+}
+
+size_t FakeStorage::getBytesLength(const char* key) {
+    auto entry = namespace_->find(key);
+    return entry == namespace_->end() ? 0 : entry->second.size();
+}
+
+size_t FakeStorage::getBytes(const char* key, void* buffer, size_t length) {
+    auto entry = namespace_->find(key);
+    if (entry == namespace_->end() || entry->second.size() > length) {
+        return 0;
+    }
+    memcpy(buffer, entry->second.data(), entry->second.size());
+    return entry->second.size();
+}
+
+size_t FakeStorage::putBytes(const char* key, const void* value, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    (*namespace_)[key].assign(bytes, bytes + length);
+    writes_()[name_]++;
+    return length;
+}
+
+bool FakeStorage::remove(const char* key) {
+    return namespace_->erase(key) > 0;
+}
+
+std::unique_ptr<StepperDriver> FakePlatform::createStepper(uint8_t csPin) {
+    stepper = new FakeStepper(clock_);
+    return std::unique_ptr<StepperDriver>(stepper);
+}
+
+std::unique_ptr<LoadCellAdc> FakePlatform::createLoadCellAdc(uint8_t datPin, uint8_t sckPin) {
+    loadCellAdc = new FakeLoadCellAdc(clock_);
+    return std::unique_ptr<LoadCellAdc>(loadCellAdc);
+}
+
+std::unique_ptr<ServoOutput> FakePlatform::createServo() {
+    FakeServo* servo = new FakeServo();
+    servos.push_back(servo);
+    return std::unique_ptr<ServoOutput>(servo);
+}
+
+std::unique_ptr<LedStrip> FakePlatform::createLedStrip(uint8_t dataPin, uint16_t count) {
+    ledStrip = new FakeLedStrip(clock_, count);
+    return std::unique_ptr<LedStrip>(ledStrip);
+}
+
+std::unique_ptr<BleTransport> FakePlatform::createBleTransport() {
+    bleTransport = new FakeBleTransport();
+    return std::unique_ptr<BleTransport>(bleTransport);
+}
+
+std::unique_ptr<Storage> FakePlatform::createStorage() {
+    return std::unique_ptr<Storage>(new FakeStorage());
+}
+
+}
@@ -0,0 +1,244 @@
+#include "Arduino.h"
+#include "../Hal.h"
+#include <map>
+#include <vector>
+
+#pragma once
+
+// Host implementations of the HAL. Time only moves when the test or simulator advances the clock,
+// the devices read it lazily so the core sees consistent timestamps.
+namespace hal
+{
+    class FakeClock : public Clock {
+    public:
+        uint32_t millis() override { return (uint32_t)(nowUS_ / 1000); }
+        uint32_t micros() override { return (uint32_t)nowUS_; }
+        uint64_t nowUS() { return nowUS_; }
+        void advanceUS(uint64_t us) { nowUS_ += us; }
+        void advanceMS(uint64_t ms) { nowUS_ += ms * 1000; }
+
+    private:
+        uint64_t nowUS_ = 0;
+    };
+
+    class FakeGpio : public Gpio {
+    public:
+        static const uint8_t MAX_PINS = 64;
+
+        explicit FakeGpio(FakeClock& clock) : clock_(clock) {}
+        void pinMode(uint8_t pin, uint8_t mode) override { modes_[pin] = mode; }
+        void digitalWrite(uint8_t pin, uint8_t level) override { levels_[pin] = level; }
+        int digitalRead(uint8_t pin) override { return levels_[pin]; }
+        void attachInterrupt(uint8_t pin, InterruptHandler handler, void* arg, int edge) override;
+
+        // Drives an input, edges matching an attached interrupt call its handler right away.
+        void setInput(uint8_t pin, uint8_t level);
+        uint8_t getMode(uint8_t pin) { return modes_[pin]; }
+
+    private:
+        struct Interrupt {
+            InterruptHandler handler = nullptr;
+            void* arg = nullptr;
+            int edge = 0;
+        };
+
+        FakeClock& clock_;
+        uint8_t modes_[MAX_PINS] = {};
+        uint8_t levels_[MAX_PINS] = {};
+        Interrupt interrupts_[MAX_PINS];
+    };
+
+    // TMC5160 positioning-mode six-point ramp integrated in 1ms steps whenever it is queried. Keeps
+    // the physical carriage position apart from the driver's counter, which setCurrentPosition() moves.
+    class FakeStepper : public StepperDriver {
+    public:
+        explicit FakeStepper(FakeClock& clock) : clock_(clock), lastUpdateUS_(clock.nowUS()) {}
+
+        void enable() override { enabled_ = true; }
+        float getCurrentPosition() override { update_(); readCount_++; return position_ - offset_; }
+        float getCurrentSpeed() override { update_(); readCount_++; return speed_; }
+        void setCurrentPosition(float position) override { update_(); offset_ = position_ - position; }
+        void setTargetPosition(float position) override { update_(); target_ = position + offset_; }
+        void setMaxSpeed(float speed) override { update_(); maxSpeed_ = speed; }
+        void setAcceleration(float acceleration) override { setAccelerations(acceleration, acceleration, acceleration, acceleration); }
+        void setAccelerations(float maxAccel, float maxDecel, float startAccel, float finalDecel) override;
+        void setRampSpeeds(float startSpeed, float stopSpeed, float transitionSpeed) override;
+        void stop() override { update_(); maxSpeed_ = 0; }
+        uint32_t readRampStatus() override;
+        uint32_t readDriverStatus() override { readCount_++; return 0; }
+
+        float getPhysicalPosition() { update_(); return position_; }
+        float getTargetPosition() { return target_ - offset_; }
+        float getMaxSpeed() { return maxSpeed_; }
+        uint32_t getReadCount() { return readCount_; } // Register reads over SPI.
+
+    private:
+        void update_();
+        void step_(float dt);
+        float accelerationAt_(float speed);
+        float decelerationAt_(float speed);
+        float stoppingDistance_(float speed);
+
+        FakeClock& clock_;
+        uint64_t lastUpdateUS_;
+        bool enabled_ = false;
+        float position_ = 0;
+        float offset_ = 0;
+        float target_ = 0;
+        float speed_ = 0;
+        float maxSpeed_ = 0;
+        float startSpeed_ = 0;          // VSTART
+        float stopSpeed_ = 0;           // VSTOP
+        float transitionSpeed_ = 0;     // V1, 0 skips the A1/D1 segments
+        float maxAccel_ = 1000;         // AMAX
+        float maxDecel_ = 1000;         // DMAX
+        float startAccel_ = 1000;       // A1
+        float finalDecel_ = 1000;       // D1
+        uint32_t readCount_ = 0;
+    };
+
+    // A conversion is ready once per sample period, its value comes from the source.
+    class FakeLoadCellAdc : public LoadCellAdc {
+    public:
+        using Source = std::function<int32_t()>;
+
+        explicit FakeLoadCellAdc(FakeClock& clock) : clock_(clock) {}
+        bool isReady() override { return clock_.nowUS() >= nextConversionUS_; }
+        int32_t read() override;
+
+        void setSource(Source source) { source_ = source; }
+        void setRaw(int32_t raw) { raw_ = raw; }
+        void setSamplePeriodUS(uint32_t periodUS) { samplePeriodUS_ = periodUS; }
+        uint32_t getReadCount() { return readCount_; }
+
+    private:
+        FakeClock& clock_;
+        Source source_;
+        int32_t raw_ = 0;
+        uint32_t samplePeriodUS_ = 100000;
+        uint64_t nextConversionUS_ = 0;
+        uint32_t readCount_ = 0;
+    };
+
+    class FakeServo : public ServoOutput {
+    public:
+        void attach(uint8_t pin, uint16_t minPulseUS, uint16_t maxPulseUS, uint32_t frequency) override { pin_ = pin; }
+        void write(uint32_t angle) override { angle_ = angle; writeCount_++; }
+
+        uint8_t getPin() { return pin_; }
+        uint32_t getAngle() { return angle_; }
+        uint32_t getWriteCount() { return writeCount_; }
+
+    private:
+        uint8_t pin_ = 0;
+        uint32_t angle_ = 0;
+        uint32_t writeCount_ = 0;
+    };
+
+    class FakeLedStrip : public LedStrip {
+    public:
+        FakeLedStrip(FakeClock& clock, uint16_t count) : clock_(clock), pixels_(count) {}
+        void setBrightness(uint8_t brightness) override { brightness_ = brightness; }
+        void show(const Rgb* pixels, uint16_t count) override;
+        bool isBusy() override { return clock_.nowUS() < busyUntilUS_; }
+
+        const std::vector<Rgb>& getPixels() { return pixels_; }
+        uint8_t getBrightness() { return brightness_; }
+        uint32_t getShowCount() { return showCount_; }
+
+    private:
+        FakeClock& clock_;
+        std::vector<Rgb> pixels_;
+        uint8_t brightness_ = 255;
+        uint32_t showCount_ = 0;
+        uint64_t busyUntilUS_ = 0;
+    };
+
+    // Records what the engine sends and lets a test play the client.
+    class FakeBleTransport : public BleTransport {
+    public:
+        void begin(const char* deviceName, ConnectionCallback connection, IntervalCallback interval, WriteCallback write) override;
+        void startAdvertising() override { advertising_ = true; }
+        void stopAdvertising() override { advertising_ = false; }
+        void setValue(Channel channel, const uint8_t* data, size_t length) override;
+        void notify(Channel channel, const uint8_t* data, size_t length) override;
+
+        void connect(uint32_t intervalMS = 30);
+        void disconnect();
+        void write(const std::string& data);
+        bool isAdvertising() { return advertising_; }
+        const std::string& getValue(Channel channel) { return values_[(uint8_t)channel]; }
+        std::vector<std::string>& getNotifications() { return notifications_; }
+
+    private:
+        ConnectionCallback connectionCallback_;
+        IntervalCallback intervalCallback_;
+        WriteCallback writeCallback_;
+        bool advertising_ = false;
+        std::string values_[3];
+        std::vector<std::string> notifications_;
+    };
+
+    // Namespaces live for the whole process like NVS does across reboots, clear() wipes them.
+    class FakeStorage : public Storage {
+    public:
+        bool begin(const char* name, bool readOnly) override { namespace_ = &spaces_()[name]; name_ = name; return true; }
+        void end() override { namespace_ = nullptr; }
+        bool getBool(const char* key, bool defaultValue) override { return get_(key, defaultValue); }
+        int32_t getInt(const char* key, int32_t defaultValue) override { return get_(key, defaultValue); }
+        uint32_t getUInt(const char* key, uint32_t defaultValue) override { return get_(key, defaultValue); }
+        float getFloat(const char* key, float defaultValue) override { return get_(key, defaultValue); }
+        size_t getBytesLength(const char* key) override;
+        size_t getBytes(const char* key, void* buffer, size_t length) override;
+        void putBool(const char* key, bool value) override { putBytes(key, &value, sizeof(value)); }
+        void putInt(const char* key, int32_t value) override { putBytes(key, &value, sizeof(value)); }
+        void putUInt(const char* key, uint32_t value) override { putBytes(key, &value, sizeof(value)); }
+        void putFloat(const char* key, float value) override { putBytes(key, &value, sizeof(value)); }
+        size_t putBytes(const char* key, const void* value, size_t length) override;
+        bool remove(const char* key) override;
+
+        static void clear() { spaces_().clear(); writes_().clear(); }
+        static uint32_t getWriteCount(const char* name) { return writes_()[name]; }   // put*() calls since clear().
+
+    private:
+        using Space = std::map<std::string, std::vector<uint8_t>>;
+
+        static std::map<std::string, Space>& spaces_();
+        static std::map<std::string, uint32_t>& writes_();
+
+        template <typename T>
+        T get_(const char* key, T defaultValue) {
+            T value;
+            return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+        }
+
+        Space* namespace_ = nullptr;
+        std::string name_;
+    };
+
+    // Hands out fakes and keeps a pointer to the latest of each kind. The core object that created
+    // a device owns it, the pointers are only valid while that object lives.
+    class FakePlatform : public Platform {
+    public:
+        FakePlatform() : gpio_(clock_) {}
+
+        FakeClock& clock() override { return clock_; }
+        FakeGpio& gpio() override { return gpio_; }
+        std::unique_ptr<StepperDriver> createStepper(uint8_t csPin) override;
+        std::unique_ptr<LoadCellAdc> createLoadCellAdc(uint8_t datPin, uint8_t sckPin) override;
+        std::unique_ptr<ServoOutput> createServo() override;
+        std::unique_ptr<LedStrip> createLedStrip(uint8_t dataPin, uint16_t count) override;
+        std::unique_ptr<BleTransport> createBleTransport() override;
+        std::unique_ptr<Storage> createStorage() override;
+
+        FakeStepper* stepper = nullptr;
+        FakeLoadCellAdc* loadCellAdc = nullptr;
+        std::vector<FakeServo*> servos;
+        FakeLedStrip* ledStrip = nullptr;
+        FakeBleTransport* bleTransport = nullptr;
+
+    private:
+        FakeClock clock_;
+        FakeGpio gpio_;
+    };
+}
@@ -4,14 +4,18 @@
 #include <Arduino.h>
 
 #include "SPI.h"
-#include <TMC5160.h>
-#include "HX711.h"
+#include "hal/esp32/Esp32Platform.h"
 #include "Transport.h"
 #include "Valve.h"
 #include "Dispenser.h"
 #include "Dispatcher.h"
 #include "LedManager.h"
 #include "BluetoothEngine.h"
+#include "BootSequence.h"
+#include "RecipeStore.h"
+#include "MachineConfig.h"
+#include "Logger.h"
+#include "LoopProfiler.h"
 
 
 #define HOME_SW_PIN 37
@@ -32,8 +36,8 @@
 #define CH2_PIN 33
 #define CH3_PIN 27
 #define LC_SCK 12 
+#define LC_RATE LoadCell::NO_PIN //Wire the HX711 RATE pad to a free GPIO to allow switching to 80Hz
 #define SERVO4_PIN LED_BUILTIN  //13
-const float calibration_factor = 439; 
 
 // HX711 scale;
 uint8_t stationIdx = 0;
@@ -43,13 +47,23 @@ bool machineIsBooted = false;
 
 static unsigned long t_dirchange, lc_update, t_echo;
 
+hal::Esp32Platform esp32Platform;
 std::shared_ptr<Transport> transport;
 std::shared_ptr<Dispenser> dispenser;
-std::unique_ptr<Dispatcher> dispatcher;
+std::shared_ptr<Dispatcher> dispatcher;
 std::unique_ptr<LedManager> ledMan;
+std::unique_ptr<RecipeStore> recipes;
 
 BluetoothEngine *ble;
 
+BootSequence boot;
+uint8_t bootStageTransport, bootStageHoming, bootStageBle, bootStageDispenser, bootStageLeds, bootStageDispatcher;
+
+LoopProfiler profiler;
+uint8_t profileLoop, profileTransport, profileLeds, profileDispenser, profileDispatcher, profileBle, profileUi, profileSerial, profileBleRequests;
+const uint32_t DIAGNOSTICS_INTERVAL_MS = 1000;
+uint32_t lastDiagnosticsTimeStampMS = 0;
+
 
 std::string rxdData;
 bool didReceiveData = false;
@@ -59,6 +73,12 @@ Dispatcher::DispatcherState lastState = Dispatcher::DispatcherState::UNKNOWN;
 void handleBleRequests();
 void handleSerialRequests();
 bool parseBleRequestToDispatcher(const std::string& rxdData);
+void handleBleCommand(const BleProtocol::Command& command);
+bool parseIngredients(const std::string& text, std::vector<Dispatcher::Ingredient>& ingredients);
+BleProtocol::AckResult queueOrder(const Dispatcher::CompiledJob& job);
+BleProtocol::AckResult orderRecipe(uint16_t recipeId);
+void didChangeOrderStatus(uint16_t orderId, Dispatcher::OrderStatus status, uint8_t queuePosition);
+void sendJobStats(uint8_t scope);
 
 //Callbacks from dispatcher (prototypes)
 void willBeginDispensing(uint8_t step);
@@ -67,12 +87,16 @@ void didUpdateWeight(uint8_t step, float weight);
 void didFinishJob();
 void isReady();
 void updateCupState();
+void advanceBoot();
+void publishDiagnostics();
 
 void setup() {
   
+  hal::setPlatform(&esp32Platform);
   Serial.begin(115200);
+  Logger::begin();
   
-  Serial.println("[BOOT]");
+  LOG_I("[BOOT]");
   
   pinMode(CS_PIN, OUTPUT);
   pinMode(EN_PIN, OUTPUT);
@@ -99,100 +123,178 @@ void setup() {
   digitalWrite(CH3_PIN, LOW);
   
  
-  Serial.println("# LoboLabs MixTender V1.0 - Dec 2023");
-  Serial.println("[main][setup] Initializing System...");
+  LOG_I("# LoboLabs MixTender V1.0 - Dec 2023");
+  LOG_I("[main][setup] Initializing System...");
 
   SPI.begin(SCK_PIN, POCI_MISO_PIN, PICO_MOSI_PIN, CS_PIN);
 
-  transport = std::make_shared<Transport>(HOME_SW_PIN, EN_PIN, CS_PIN);
-  dispenser = std::make_shared<Dispenser>(LC_DAT, LC_SCK, calibration_factor , 121.38);
-  dispatcher = std::make_unique<Dispatcher>(dispenser, transport);
-
-  Serial.println("[INITIALIZING TRASNPORT]");
-  transport->defineStation(12);  
-  transport->defineStation(426);
-  transport->defineStation(875);
-  transport->defineStation(1309);
-  transport->defineStation(1759);
-  transport->defineStation(2192);
-  transport->defineStation(230); //Pumps
-  
-  //Register Valves
-  Serial.println("[INITIALIZING DISPENSER]");
-  dispenser->registerValve(std::make_shared<Valve>(SERVO0_PIN));
-  dispenser->registerValve(std::make_shared<Valve>(SERVO4_PIN));
-  dispenser->registerValve(std::make_shared<Valve>(SERVO2_PIN));
-  dispenser->registerValve(std::make_shared<Valve>(SERVO3_PIN));
-  dispenser->registerValve(std::make_shared<Valve>(SERVO1_PIN));
-  dispenser->registerValve(std::make_shared<Valve>(SERVO5_PIN));
-
-  //Register Pumps
-  dispenser->registerPump(std::make_shared<Pump>(CH1_PIN));
-  dispenser->registerPump(std::make_shared<Pump>(CH2_PIN));
-  dispenser->registerPump(std::make_shared<Pump>(CH3_PIN));
-
-  Serial.println("[INITIALIZING DISPATCHER]");
-  dispatcher->setWillBeginDispensingCallback(willBeginDispensing);
-  dispatcher->setDidFinishDispensingCallback(didFinishDispensing);
-  dispatcher->setDidUpdateWeight(didUpdateWeight);
-  dispatcher->setDidFinishJob(didFinishJob);
-  dispatcher->setIsReady(isReady);
-  
-
-Serial.println("[INITIALIZING LED MANAGER]");
-ledMan = std::make_unique<LedManager>(SDA);
-ledMan->setAllLeds(CRGB(10,10,10));
-
-Serial.println("[INITIALIZING BLUETOOTH ENGINE]");
-  ble = new BluetoothEngine();    
-
-  ble->setDidReceiveCallback([](std::string data) {              
-          rxdData = data;
-          didReceiveData = true;                     
+  // Stages: transport and homing run on the loop, BLE and the dispenser initialise in their own
+  // tasks meanwhile, the dispatcher follows once the dispenser is up. Ready is all of them done.
+  bootStageTransport = boot.addStage("transport");
+  bootStageHoming = boot.addStage("homing");
+  bootStageBle = boot.addStage("ble");
+  bootStageDispenser = boot.addStage("dispenser");
+  bootStageLeds = boot.addStage("leds");
+  bootStageDispatcher = boot.addStage("dispatcher");
+
+  // Deadlines are what each piece can take without starving the next load-cell sample (12.5ms at 80Hz).
+  profileLoop = profiler.addComponent("loop", 10000);
+  profileTransport = profiler.addComponent("transport", 500);
+  profileLeds = profiler.addComponent("leds", 2000);
+  profileDispenser = profiler.addComponent("dispenser", 1000);
+  profileDispatcher = profiler.addComponent("dispatcher", 1000);
+  profileBle = profiler.addComponent("ble", 2000);
+  profileUi = profiler.addComponent("ui", 2000);
+  profileSerial = profiler.addComponent("serial", 2000);
+  profileBleRequests = profiler.addComponent("bleRequests", 2000);
+
+  LOG_I("[INITIALIZING TRASNPORT]");
+  boot.run(bootStageTransport, []() {
+    transport = std::make_shared<Transport>(HOME_SW_PIN, EN_PIN, CS_PIN, MachineConfig::PARK_STEP_ADDRESS);
+    MachineConfig::configureTransport(*transport);
   });
 
-  ble->setDidConnectCallback([]() {        
-      isConnected = true;
+  boot.begin(bootStageHoming);
+  transport->refMachine([](bool success) {    
+      LOG_I("[main][refMachineCB] Machine Homed");
   });
 
-  ble->setDidDisconnectConnectCallback([]() {        
-      isConnected = false;
+  LOG_I("[INITIALIZING BLUETOOTH ENGINE]");
+  boot.runAsync(bootStageBle, []() {
+    ble = new BluetoothEngine();    
+
+    ble->setDidReceiveCallback([](std::string data) {              
+            rxdData = data;
+            didReceiveData = true;                     
+    });
+
+    ble->setDidConnectCallback([]() {        
+        isConnected = true;
+    });
+
+    ble->setDidDisconnectConnectCallback([]() {        
+        isConnected = false;
+    });
+  }, 0, 8192);
+
+  LOG_I("[INITIALIZING DISPENSER]");
+  boot.runAsync(bootStageDispenser, []() {
+    dispenser = std::make_shared<Dispenser>(LC_DAT, LC_SCK, MachineConfig::CALIBRATION_FACTOR, MachineConfig::EMPTY_WEIGHT, LC_RATE);
+
+    //Register Valves
+    dispenser->registerValve(std::make_shared<Valve>(SERVO0_PIN));
+    dispenser->registerValve(std::make_shared<Valve>(SERVO4_PIN));
+    dispenser->registerValve(std::make_shared<Valve>(SERVO2_PIN));
+    dispenser->registerValve(std::make_shared<Valve>(SERVO3_PIN));
+    dispenser->registerValve(std::make_shared<Valve>(SERVO1_PIN));
+    dispenser->registerValve(std::make_shared<Valve>(SERVO5_PIN));
+
+    //Register Pumps
+    dispenser->registerPump(std::make_shared<Pump>(CH1_PIN));
+    dispenser->registerPump(std::make_shared<Pump>(CH2_PIN));
+    dispenser->registerPump(std::make_shared<Pump>(CH3_PIN));
+    dispenser->loadCalibration();
+    dispenser->setProportionalValves(true);
+  }, 1, 6144);
+
+  LOG_I("[INITIALIZING LED MANAGER]");
+  boot.run(bootStageLeds, []() {
+    ledMan = std::make_unique<LedManager>(SDA);
+    // Frames go out between load-cell conversions so the RMT refills never land on an HX711 read.
+    ledMan->setRenderGate([](uint32_t frameUS) {
+      return boot.isDone(bootStageDispenser) == false || dispenser->isLoadCellQuietFor(frameUS);
+    });
+    ledMan->setAllLeds(hal::Rgb(10,10,10));
+    ledMan->fadeTo(hal::Rgb(0,0,0), hal::Rgb(100,0,0), 1000);
   });
 
+  LOG_I("[main][setup] Done");
+}
 
-transport->refMachine([](bool success) {    
-    machineIsBooted = true;
-    Serial.println("[main][refMachineCB] Machine Homed");
-});
-
-Serial.println("[main][setup] Done");
+// Runs from loop() until every boot stage is done, stages with dependencies are started from here.
+void advanceBoot() {
+  // Homed is not ready yet, the stage also covers the move onto park that follows it.
+  if (boot.isDone(bootStageHoming) == false && transport->isParked()) {
+    boot.end(bootStageHoming);
+  }
 
+  if (boot.isDone(bootStageDispenser) && dispatcher == nullptr) {
+    LOG_I("[INITIALIZING DISPATCHER]");
+    boot.run(bootStageDispatcher, []() {
+      dispatcher = std::make_shared<Dispatcher>(dispenser, transport);
+      dispatcher->setWillBeginDispensingCallback(willBeginDispensing);
+      dispatcher->setDidFinishDispensingCallback(didFinishDispensing);
+      dispatcher->setDidUpdateWeight(didUpdateWeight);
+      dispatcher->setDidFinishJob(didFinishJob);
+      dispatcher->setIsReady(isReady);
+      dispatcher->setOrderStatusCallback(didChangeOrderStatus);
+      dispatcher->setConcurrentPumps(true);
+      dispatcher->setEarlyDeparture(true);
+      dispatcher->setPredictiveStart(true);
+
+      recipes = std::make_unique<RecipeStore>(dispatcher);
+      recipes->warmCache();
+    });
+  }
 
-ledMan->fadeTo(CRGB(0,0,0), CRGB(100,0,0), 1000);
+  if (boot.isComplete()) {
+    machineIsBooted = true;
+    boot.report();
+  }
 }
 
 
 void loop() {  
+  profiler.tick(profileLoop);
+
+  profiler.begin(profileTransport);
   transport->heartbeat(); 
+  profiler.end(profileTransport);
+
+  profiler.begin(profileLeds);
+  ledMan->heartbeat();
+  profiler.end(profileLeds);
+
+  if (machineIsBooted == false) {
+    advanceBoot();
+    return;
+  }
+
+  profiler.begin(profileDispenser);
   dispenser->heartbeat();
+  profiler.end(profileDispenser);
+
+  profiler.begin(profileDispatcher);
   dispatcher->heartbeat();
+  profiler.end(profileDispatcher);
+
+  profiler.begin(profileBle);
   ble->heartbeat();
-  ledMan->heartbeat();
+  profiler.end(profileBle);
   
-
+  profiler.begin(profileUi);
     if (machineIsBooted == true) {   
               
         Dispatcher::DispatcherState state = dispatcher->getState();
         
           if (state == Dispatcher::DispatcherState::NO_CUP) {                             
-                ledMan->fadeTo(ledMan->getCurrentColor(), CRGB(0,0,100), 200);                   
+                ledMan->fadeTo(ledMan->getCurrentColor(), hal::Rgb(0,0,100), 200);                   
           } else if (state == Dispatcher::DispatcherState::READY) {                
-                ledMan->fadeTo(ledMan->getCurrentColor(), CRGB(0,100,0), 350);     
-                ble->notifyStatus("Ready!");
+                ledMan->fadeTo(ledMan->getCurrentColor(), hal::Rgb(0,100,0), 350);     
+                ble->notifyStatus(BleProtocol::StatusCode::READY);
           } else if (state == Dispatcher::DispatcherState::AWAITING_REMOVAL) {         
-            ledMan->trackTray(transport->getCurrentPosition(), CRGB(0,255,0), CRGB(10,10,10));        
+            ledMan->trackTray(transport->getCurrentPosition(), hal::Rgb(0,255,0), hal::Rgb(10,10,10));        
+            ledMan->setPulse(hal::Rgb(0,60,0), 1500);
           } else if (dispatcher->isServing() == true) {
-            ledMan->trackTray(transport->getCurrentPosition(), CRGB(0,255,255), CRGB(0,0,20));          
+            ledMan->trackTray(transport->getCurrentPosition(), hal::Rgb(0,255,255), hal::Rgb(0,0,20));          
+            // The tray window fills up with the step being poured.
+            if (state == Dispatcher::DispatcherState::SERVING) {
+              Dispatcher::StepStatus step = dispatcher->getStepStatus();
+              uint16_t permille = step.targetWeight > 0 ? constrain(step.dispensedWeight * 1000 / step.targetWeight, 0.0f, 1000.0f) : 0;
+              ledMan->setProgress(permille, hal::Rgb(255,120,0));
+            } else {
+              ledMan->hideProgress();
+            }
           }          
           
       if (state != lastState) { 
@@ -201,18 +303,37 @@ void loop() {
       }
       
     }
+  profiler.end(profileUi);
 
+  profiler.begin(profileSerial);
   handleSerialRequests();
+  profiler.end(profileSerial);
+
+  profiler.begin(profileBleRequests);
   handleBleRequests();      
+  profiler.end(profileBleRequests);
+
+  publishDiagnostics();
+}
+
+void publishDiagnostics() {
+  if (hal::millis() - lastDiagnosticsTimeStampMS < DIAGNOSTICS_INTERVAL_MS) {
+    return;
+  }
+  lastDiagnosticsTimeStampMS = hal::millis();
+
+  static uint8_t snapshot[LoopProfiler::MAX_COMPONENTS * (1 + LoopProfiler::MAX_NAME_LENGTH + 7 * 4) + 1];
+  size_t length = profiler.encode(snapshot, sizeof(snapshot));
+  ble->setDiagnostics(snapshot, length);
 }
 
 void updateCupState() {
   Dispatcher::DispatcherState state = dispatcher->getState();
   if (state == Dispatcher::DispatcherState::NO_CUP) {
-          Serial.println("[main][loop] No Cup Detected");
+          LOG_I("[main][loop] No Cup Detected");
           ble->notifyCupStatus(false);
         } else {
-          Serial.println("[main][loop] Cup Detected");
+          LOG_I("[main][loop] Cup Detected");
           ble->notifyCupStatus(true);
         }  
 }
@@ -224,22 +345,58 @@ if (Serial.available() > 0) {  // Check if data is available to read
     // Serial.print((int)receivedChar);
     switch (receivedChar) {       
      case '?':
-        Serial.println(transport->getCurrentPosition());
+        LOG_I(transport->getCurrentPosition());
+        break;
+      case 'N': {
+        BluetoothEngine::TxStats stats = ble->getTxStats();
+        LOG_I("[main][loop] BLE TX sent: ", stats.sent, " coalesced: ", stats.coalesced, " dropped: ", stats.dropped);
+        break;
+      }
+      case 'p':
+        profiler.report();
+        break;
+      case 'o':
+        profiler.reset();
+        LOG_I("[main][loop] Loop profiler reset");
+        break;
+      case 'F':
+        ledMan->report();
+        break;
+      case 'f':
+        ledMan->resetRenderTimes();
+        LOG_I("[main][loop] LED render times reset");
+        break;
+      case 'J':
+        dispatcher->getJobStats().report();
+        break;
+      case 'j':
+        dispatcher->getJobStats().reset();
+        LOG_I("[main][loop] Job statistics reset");
+        break;
+      case 'Q':
+        LOG_I("[main][loop] Serving order: ", dispatcher->getCurrentOrderId(), ", queued: ", dispatcher->getQueueLength());
+        break;
+      case 'R':
+        recipes->printRecipes();
+        break;
+      case 'b':
+        boot.report();
+        LOG_I("[main][loop] Homing: ", transport->getHomingMethod(), " in ", transport->getHomingDurationMS(), "ms");
         break;
       case ',':
-        dispenser->scale_->set_scale(dispenser->scale_->get_scale() - 10);
-        Serial.println(String(dispenser->scale_->get_scale()) + " = " + String(dispenser->scale_->get_units()));
+        dispenser->setScaleFactor(dispenser->getScaleFactor() - 10);
+        LOG_I(dispenser->getScaleFactor(), " = ", dispenser->getLatestWeight());
         break;
       case '.':
-        dispenser->scale_->set_scale(dispenser->scale_->get_scale() + 10);
-        Serial.println(String(dispenser->scale_->get_scale()) + " = " + String(dispenser->scale_->get_units()));
+        dispenser->setScaleFactor(dispenser->getScaleFactor() + 10);
+        LOG_I(dispenser->getScaleFactor(), " = ", dispenser->getLatestWeight());
         break;        
       case '<': 
-       Serial.println("[main][loop] Left");
+       LOG_I("[main][loop] Left");
         transport->moveStepsLeft(20);
         break;
       case  '>': 
-      Serial.println("[main][loop] Right");
+      LOG_I("[main][loop] Right");
         transport->moveStepsRight(20);
         break;
       case 'B':
@@ -255,9 +412,26 @@ if (Serial.available() > 0) {  // Check if data is available to read
         dispatcher->addStep(Dispenser::DispenseType::VALVE, 2, 2, 50.0);  //Station 2 // Valve 2 
         dispatcher->start();
       } else {
-        Serial.println("[main][loop] Dispatcher not ready.");
+        LOG_I("[main][loop] Dispatcher not ready.");
       }
         break;
+      case 'H':
+        dispenser->setSampleRate(LoadCell::Rate::SPS_80);
+        break;
+      case 'h':
+        dispenser->setSampleRate(LoadCell::Rate::SPS_10);
+        break;
+      case 'K':
+        dispenser->setEstimator(std::make_unique<KalmanEstimator>());
+        LOG_I("[main][loop] Kalman weight estimator");
+        break;
+      case 'k':
+        dispenser->setEstimator(std::make_unique<AlphaBetaEstimator>());
+        LOG_I("[main][loop] Alpha-beta weight estimator");
+        break;
+      case 'L':
+        dispatcher->printPlan();
+        break;
       case 'C':      
        dispatcher->cancel();
        break;   
@@ -313,10 +487,10 @@ if (Serial.available() > 0) {  // Check if data is available to read
         transport->goToStation(7);
         break;
       case 'S':
-        Serial.println("[main][loop] Weight: " + String(dispenser->getLatestWeight()));
+        LOG_I("[main][loop] Weight: ", dispenser->getLatestWeight());
         break;
       case 'A':
-        Serial.println("[main][loop] Absolute Weight: " + String(dispenser->getAbsoluteWeight()));
+        LOG_I("[main][loop] Absolute Weight: ", dispenser->getAbsoluteWeight());
         break;
       case '#':
         dispenser->beginDispensingPump(1, 50.0);
@@ -330,14 +504,14 @@ if (Serial.available() > 0) {  // Check if data is available to read
 }
 
 void willBeginDispensing(uint8_t step) {
-  Serial.println("[main][willBeginDispensingCallback] Step: " + String(step));
+  LOG_I("[main][willBeginDispensingCallback] Step: ", step);
   ble->notifyStateIsProcessing(step);
-  ble->notifyStatus("Still Working!");
+  ble->notifyStatus(BleProtocol::StatusCode::WORKING);
 }
 
 void didFinishDispensing(uint8_t step) {
   ble->notifyStateIsComplete(step);
-  Serial.println("[main][didFinishDispensingCallback] Step: " + String(step));  
+  LOG_I("[main][didFinishDispensingCallback] Step: ", step);  
 }
 
 void didUpdateWeight(uint8_t step, float weight) {
@@ -345,13 +519,13 @@ void didUpdateWeight(uint8_t step, float weight) {
 }
 
 void didFinishJob() {
-  Serial.println("[main][didFinishJobCallback] Job Complete");  
-  ble->notifyStatus("Get your drink!");
+  LOG_I("[main][didFinishJobCallback] Job Complete");  
+  ble->notifyStatus(BleProtocol::StatusCode::DONE);
 }
 
 void isReady() {
-  Serial.println("[main][isReadyCallback] Ready");
-  ble->notifyStatus("Ready!");
+  LOG_I("[main][isReadyCallback] Ready");
+  ble->notifyStatus(BleProtocol::StatusCode::READY);
 }
 
 
@@ -363,32 +537,173 @@ void handleBleRequests() {
     didReceiveData = false;
     rxdData = "";
 
-    Serial.println("[Main][handleBleRequests] Received: " + String(rxdData_.c_str()));
+    LOG_I("[Main][handleBleRequests] Received: ", rxdData_.c_str());
     if (parseBleRequestToDispatcher(rxdData_) == true) {
-      if (dispatcher->getState() == Dispatcher::DispatcherState::NO_CUP) {
-        ble->notifyStatus("No Cup! Please add a cup!");
-        ble->notifyCupStatus(false);
-        return;
-      }
-      ble->notifyStatus("Serving your drink!");
-      dispatcher->start();
+      LOG_I("[Main][handleBleRequests] Order queued");
+    } else if (rxdData_.rfind("O:", 0) == 0) {
+      ble->acknowledgeRequest('O', orderRecipe(atoi(rxdData_.c_str() + 2)));
+    } else if (rxdData_.rfind("R:", 0) == 0) {
+      std::vector<Dispatcher::Ingredient> ingredients;
+      size_t separator = rxdData_.find(':', 2);
+      bool saved = separator != std::string::npos && parseIngredients(rxdData_.substr(separator + 1), ingredients) && recipes->save(atoi(rxdData_.c_str() + 2), ingredients);
+      ble->acknowledgeRequest('R', saved ? BleProtocol::AckResult::OK : BleProtocol::AckResult::REJECTED);
+    } else if (rxdData_.rfind("X:", 0) == 0) {
+      bool removed = recipes->remove(atoi(rxdData_.c_str() + 2));
+      ble->acknowledgeRequest('X', removed ? BleProtocol::AckResult::OK : BleProtocol::AckResult::UNKNOWN_RECIPE);
+    } else if (rxdData_.rfind("C:", 0) == 0) {
+      LOG_I("[Main][handleBleRequests] Cancel Order Request Received");
+      dispatcher->cancelOrder(atoi(rxdData_.c_str() + 2));
     } else if (rxdData_ == "C!") {
-      Serial.println("[Main][handleBleRequests] Cancel Request Received");
+      LOG_I("[Main][handleBleRequests] Cancel Request Received");
       dispatcher->cancel();
     } else if (rxdData_ == "ehlo") {
-      Serial.println("[Main][handleBleRequests] Ping Received");
+      LOG_I("[Main][handleBleRequests] Ping Received");
       updateCupState();      
     }  else {
-      Serial.println("[Main][handleBleRequests] Unknown Request Received: " + String(rxdData_.c_str()));
+      LOG_W("[Main][handleBleRequests] Unknown Request Received: ", rxdData_.c_str());
     }              
   }
-  
+
+  BleProtocol::Command command;
+  while (ble->readCommand(command)) {
+    handleBleCommand(command);
+  }
 }
 
+// Binary protocol commands, acknowledged with their outcome once they ran.
+void handleBleCommand(const BleProtocol::Command& command) {
+  BleProtocol::AckResult result = BleProtocol::AckResult::OK;
+  switch (command.type) {
+    case BleProtocol::MessageType::ORDER: {
+      LOG_I("[Main][handleBleCommand] Order with ", command.stepCount, " steps, seq ", command.seq);
+      std::vector<Dispatcher::Ingredient> ingredients;
+      for (uint8_t i = 0; i < command.stepCount; i++) {
+        ingredients.push_back({command.steps[i].address, command.steps[i].weight});
+      }
+      Dispatcher::CompiledJob job;
+      result = dispatcher->compile(ingredients, job) ? queueOrder(job) : BleProtocol::AckResult::REJECTED;
+      break;
+    }
+    case BleProtocol::MessageType::CANCEL_ORDER:
+      if (dispatcher->cancelOrder(command.orderId) == false) {
+        result = BleProtocol::AckResult::REJECTED;
+      }
+      break;
+    case BleProtocol::MessageType::ORDER_RECIPE:
+      result = orderRecipe(command.recipeId);
+      break;
+    case BleProtocol::MessageType::SAVE_RECIPE: {
+      std::vector<Dispatcher::Ingredient> ingredients;
+      for (uint8_t i = 0; i < command.stepCount; i++) {
+        ingredients.push_back({command.steps[i].address, command.steps[i].weight});
+      }
+      if (recipes->save(command.recipeId, ingredients) == false) {
+        result = BleProtocol::AckResult::REJECTED;
+      }
+      break;
+    }
+    case BleProtocol::MessageType::DELETE_RECIPE:
+      if (recipes->remove(command.recipeId) == false) {
+        result = BleProtocol::AckResult::UNKNOWN_RECIPE;
+      }
+      break;
+    case BleProtocol::MessageType::CANCEL:
+      LOG_I("[Main][handleBleCommand] Cancel Request Received");
+      dispatcher->cancel();
+      break;
+    case BleProtocol::MessageType::HELLO:
+      updateCupState();
+      break;
+    case BleProtocol::MessageType::GET_STATS:
+      sendJobStats(command.scope);
+      break;
+    default:
+      break;
+  }
+  ble->acknowledge(command.seq, result);
+}
 
-bool parseBleRequestToDispatcher(const std::string& rxdData) {
-    std::vector<Dispatcher::Steps> steps;
+// Scope 0 is the last job's timeline, one frame per step, otherwise one frame per station or
+// device that has samples.
+void sendJobStats(uint8_t scope) {
+  JobStats& stats = dispatcher->getJobStats();
+  uint8_t frame[BleProtocol::MAX_FRAME_SIZE];
+
+  if (scope == 0) {
+    for (const auto& step : stats.getLastJob()) {
+      ble->queueReport(frame, BleProtocol::encodeStepTimeline(frame, 0, step));
+    }
+    return;
+  }
+
+  JobStats::Scope statsScope = (JobStats::Scope)scope;
+  if (statsScope != JobStats::Scope::STATION && statsScope != JobStats::Scope::DEVICE) {
+    return;
+  }
+  for (uint8_t slot = 0; slot < stats.getSlotCount(statsScope); slot++) {
+    JobStats::Summary summary;
+    if (stats.getSummary(statsScope, slot, summary)) {
+      ble->queueReport(frame, BleProtocol::encodePhaseStats(frame, 0, statsScope, slot, summary));
+    }
+  }
+}
+
+// Orders always go through the dispatcher queue, it starts them once there is a cup.
+BleProtocol::AckResult queueOrder(const Dispatcher::CompiledJob& job) {
+  if (dispatcher->enqueue(job) == 0) {
+    ble->notifyStatus(BleProtocol::StatusCode::QUEUE_FULL);
+    return BleProtocol::AckResult::QUEUE_FULL;
+  }
+
+  if (dispatcher->getState() == Dispatcher::DispatcherState::NO_CUP) {
+    ble->notifyStatus(BleProtocol::StatusCode::NO_CUP);
+    ble->notifyCupStatus(false);
+  }
+  return BleProtocol::AckResult::OK;
+}
+
+// Stored recipes are queued from their cached compiled job, nothing is parsed or planned.
+BleProtocol::AckResult orderRecipe(uint16_t recipeId) {
+  std::shared_ptr<const Dispatcher::CompiledJob> job = recipes->getJob(recipeId);
+  if (job == nullptr) {
+    ble->notifyStatus(BleProtocol::StatusCode::UNKNOWN_RECIPE);
+    return BleProtocol::AckResult::UNKNOWN_RECIPE;
+  }
+
+  LOG_I("[main][orderRecipe] Recipe ", recipeId);
+  return queueOrder(*job);
+}
+
+void didChangeOrderStatus(uint16_t orderId, Dispatcher::OrderStatus status, uint8_t queuePosition) {
+  if (status == Dispatcher::OrderStatus::SERVING) {
+    ble->notifyStatus(BleProtocol::StatusCode::SERVING);
+  }
+  ble->notifyOrderState(orderId, (BleProtocol::OrderState)status, queuePosition);
+}
+
+// "1=50,7=30" -> ingredients. Walks the string in place, so recipes have no fixed length limit.
+bool parseIngredients(const std::string& text, std::vector<Dispatcher::Ingredient>& ingredients) {
+    ingredients.clear();
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+
+        size_t equalPos = text.find('=', begin);
+        if (equalPos == std::string::npos || equalPos > end) {
+            LOG_W("Invalid step format");
+            return false;
+        }
 
+        ingredients.push_back({(uint8_t)atoi(text.c_str() + begin), (float)atof(text.c_str() + equalPos + 1)});
+        begin = end + 1;
+    }
+    return ingredients.empty() == false;
+}
+
+bool parseBleRequestToDispatcher(const std::string& rxdData) {
     // Find the position of the first ':'
     size_t pos = rxdData.find(':');
     if (pos == std::string::npos) {
@@ -402,47 +717,21 @@ bool parseBleRequestToDispatcher(const std::string& rxdData) {
         return false;
     }
 
-    // Extract the remaining part (after ':')
-    std::string stepsPart = rxdData.substr(pos + 1);
-
-    // Tokenize the stepsPart by ','
-    char stepsCopy[256];
-    strncpy(stepsCopy, stepsPart.c_str(), sizeof(stepsCopy));
-    stepsCopy[sizeof(stepsCopy) - 1] = '\0'; // Ensure null termination
-
-    char* step = strtok(stepsCopy, ",");
-    dispatcher->clearSteps();
-    Serial.println("[main][parseBTRequestToDispatcher] --------------------------------->");
-    while (step != NULL) {
-        
-        char* equalPos = strchr(step, '=');
-        if (equalPos == NULL) {
-            Serial.println("Invalid step format");
-            return false;
-        }
-
-        // Extract StepID (index) and value
-        *equalPos = '\0';
-        int addressID = atoi(step);
-        double targetWeight = atof(equalPos + 1);
-
-        uint8_t stationID = (uint8_t)addressID;
-        uint8_t pourDeviceID = stationID;
-
-        
-        Dispenser::DispenseType stationType = Dispenser::DispenseType::VALVE;
-        if (stationID >= 7) {
-            stationType = Dispenser::DispenseType::PUMP;
-            stationID = 7;
-            pourDeviceID = addressID - 6;
-        }
-
-        dispatcher->addStep(stationType, stationID, pourDeviceID, targetWeight);
+    std::vector<Dispatcher::Ingredient> ingredients;
+    if (parseIngredients(rxdData.substr(pos + 1), ingredients) == false) {
+        return false;
+    }
 
-        Serial.println("[main][parseBTRequestToDispatcher] Step Added: " + String(addressID) + " = " + String(targetWeight)); 
-        step = strtok(NULL, ",");
+    LOG_I("[main][parseBTRequestToDispatcher] --------------------------------->");
+    for (const auto& ingredient : ingredients) {
+        LOG_I("[main][parseBTRequestToDispatcher] Step: ", ingredient.address, " = ", ingredient.targetWeight); 
     }
+    LOG_I("[main][parseBTRequestToDispatcher] ---------------------------------<");
 
-    Serial.println("[main][parseBTRequestToDispatcher] ---------------------------------<");
+    Dispatcher::CompiledJob job;
+    if (dispatcher->compile(ingredients, job) == false) {
+        return false;
+    }
+    queueOrder(job);
     return true;
 }
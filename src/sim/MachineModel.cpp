@@ -0,0 +1,146 @@
+#include "MachineModel.h"
+
+MachineModel::MachineModel(hal::FakePlatform& platform, Parameters parameters) :
+    platform_(platform),
+    parameters_(parameters),
+    random_(parameters.seed),
+    noise_(0.0f, parameters.scaleNoise > 0 ? parameters.scaleNoise : 1.0f)
+{
+    platform_.loadCellAdc->setSource([this]() { return convert_(); });
+}
+
+void MachineModel::setHomeSwitchPin(uint8_t pin) {
+    homeSwitchPin_ = pin;
+}
+
+void MachineModel::setRatePin(uint8_t pin) {
+    ratePin_ = pin;
+}
+
+void MachineModel::addValve(hal::FakeServo* servo, uint8_t address) {
+    ValveModel valve;
+    valve.servo = servo;
+    valve.command = servo->getAngle();
+    valve.commandUS = platform_.clock().nowUS();
+    valve.angle = valve.command;
+    valve.source = addSource_(address, parameters_.valveFlow, parameters_.valveFallMS);
+    valves_.push_back(valve);
+}
+
+void MachineModel::addPump(uint8_t pin, uint8_t address) {
+    PumpModel pump;
+    pump.pin = pin;
+    pump.level = platform_.gpio().digitalRead(pin);
+    pump.levelUS = platform_.clock().nowUS();
+    pump.source = addSource_(address, parameters_.pumpFlow, parameters_.pumpTransitMS);
+    pumps_.push_back(pump);
+}
+
+// Addresses 1-6 are the valve stations, 7 and up share the pump station, like Dispatcher::compile().
+size_t MachineModel::addSource_(uint8_t address, float defaultFlow, uint32_t delayMS) {
+    Source source;
+    uint8_t station = std::min<uint8_t>(address, 7) - 1;
+    source.stationPosition = MachineConfig::STATION_STEP_ADDRESSES[station];
+    auto flow = parameters_.flows.find(address);
+    source.flow = flow != parameters_.flows.end() ? flow->second : defaultFlow;
+    source.delayMS = delayMS;
+    sources_.push_back(source);
+    return sources_.size() - 1;
+}
+
+// Advances the physics by dtUS, the clock has already been moved.
+void MachineModel::step(uint32_t dtUS) {
+    uint64_t now = platform_.clock().nowUS();
+    float dt = dtUS / 1000000.0f;
+
+    if (homeSwitchPin_ != LoadCell::NO_PIN) {
+        platform_.gpio().setInput(homeSwitchPin_, platform_.stepper->getPhysicalPosition() <= parameters_.homeSwitchPosition ? HIGH : LOW);
+    }
+    if (ratePin_ != LoadCell::NO_PIN) {
+        platform_.loadCellAdc->setSamplePeriodUS(platform_.gpio().digitalRead(ratePin_) == HIGH ? 12500 : 100000);
+    }
+
+    float span = (float)parameters_.valveOpenAngle - (float)parameters_.valveClosedAngle;
+    for (auto& valve : valves_) {
+        uint32_t command = valve.servo->getAngle();
+        if (command != valve.command) {
+            valve.command = command;
+            valve.commandUS = now;
+        }
+        if (now - valve.commandUS >= (uint64_t)parameters_.servoDeadTimeMS * 1000) {
+            float travel = parameters_.servoSlewDegPerS * dt;
+            valve.angle += constrain((float)valve.command - valve.angle, -travel, travel);
+        }
+
+        float opening = constrain((valve.angle - parameters_.valveClosedAngle) / span, 0.0f, 1.0f);
+        if (opening > 0) {
+            Source& source = sources_[valve.source];
+            source.inFlight.push_back({now + (uint64_t)source.delayMS * 1000, source.flow * opening * dt});
+        }
+    }
+
+    for (auto& pump : pumps_) {
+        uint8_t level = platform_.gpio().digitalRead(pump.pin);
+        if (level != pump.level) {
+            pump.level = level;
+            pump.levelUS = now;
+        }
+        if (level == HIGH && now - pump.levelUS >= (uint64_t)parameters_.pumpSpinUpMS * 1000) {
+            Source& source = sources_[pump.source];
+            source.inFlight.push_back({now + (uint64_t)source.delayMS * 1000, source.flow * dt});
+        }
+    }
+
+    for (auto& source : sources_) {
+        deliver_(source, now);
+    }
+}
+
+// Parcels that are due land in the cup when the tray is under the station, anything else is spilled.
+void MachineModel::deliver_(Source& source, uint64_t nowUS) {
+    while (source.inFlight.empty() == false && source.inFlight.front().dueUS <= nowUS) {
+        float grams = source.inFlight.front().grams;
+        source.inFlight.pop_front();
+
+        int32_t offset = (int32_t)platform_.stepper->getCurrentPosition() - source.stationPosition;
+        if (hasCup_ && abs(offset) <= parameters_.stationTolerance) {
+            cupLiquid_ += grams;
+        } else {
+            spilled_ += grams;
+        }
+    }
+}
+
+int32_t MachineModel::convert_() {
+    float grams = parameters_.trayWeight + cupWeight_ + cupLiquid_;
+    if (parameters_.scaleNoise > 0) {
+        grams += noise_(random_);
+    }
+    return (int32_t)round(grams * parameters_.calibrationFactor);
+}
+
+void MachineModel::placeCup(float weight) {
+    hasCup_ = true;
+    cupWeight_ = weight;
+    cupLiquid_ = 0.0;
+}
+
+float MachineModel::removeCup() {
+    float liquid = cupLiquid_;
+    hasCup_ = false;
+    cupWeight_ = 0.0;
+    cupLiquid_ = 0.0;
+    return liquid;
+}
+
+bool MachineModel::hasCup() {
+    return hasCup_;
+}
+
+float MachineModel::getCupLiquid() {
+    return cupLiquid_;
+}
+
+float MachineModel::getSpilled() {
+    return spilled_;
+}
@@ -0,0 +1,96 @@
+#include "Arduino.h"
+#include "LoadCell.h"
+#include "MachineConfig.h"
+#include "hal/native/FakePlatform.h"
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+#pragma once
+
+// Physics of the machine behind the fakes: the carriage closes the home switch, servos open valves
+// with a dead time and a slew rate, pumps spin up, and the HX711 converts tray + cup + liquid with
+// noise at the rate its RATE pin selects. Liquid leaving a device reaches the cup after a fixed
+// delay (the mass in flight) and only lands in it while the tray is under that station.
+class MachineModel
+{
+public:
+    struct Parameters {
+        float calibrationFactor = MachineConfig::CALIBRATION_FACTOR;
+        float trayWeight = MachineConfig::EMPTY_WEIGHT;
+        int32_t homeSwitchPosition = -200;  // Physical steps, the switch is closed at or below it.
+        int32_t stationTolerance = 30;      // Steps off a station that still catch its stream.
+        uint32_t servoDeadTimeMS = 15;
+        float servoSlewDegPerS = 400;
+        uint32_t valveClosedAngle = 50;
+        uint32_t valveOpenAngle = 147;
+        float valveFlow = 25.0;             // g/s fully open.
+        uint32_t valveFallMS = 150;         // Spout to cup.
+        float pumpFlow = 10.0;              // g/s
+        uint32_t pumpSpinUpMS = 120;
+        uint32_t pumpTransitMS = 350;       // Pump to nozzle, keeps pouring after the pump stops.
+        std::map<uint8_t, float> flows;     // g/s per client address, overrides the defaults above.
+        float scaleNoise = 0.1;             // Standard deviation per conversion, grams.
+        uint32_t seed = 1;
+    };
+
+    MachineModel(hal::FakePlatform& platform, Parameters parameters);
+    void setHomeSwitchPin(uint8_t pin);
+    void setRatePin(uint8_t pin);
+    void addValve(hal::FakeServo* servo, uint8_t address);
+    void addPump(uint8_t pin, uint8_t address);
+    void step(uint32_t dtUS);
+
+    void placeCup(float weight);
+    float removeCup();      // Returns the liquid that was in it.
+    bool hasCup();
+    float getCupLiquid();
+    float getSpilled();
+
+private:
+    struct Parcel {
+        uint64_t dueUS;
+        float grams;
+    };
+
+    struct Source {
+        int32_t stationPosition;
+        float flow;
+        uint32_t delayMS;
+        std::deque<Parcel> inFlight;
+    };
+
+    struct ValveModel {
+        hal::FakeServo* servo;
+        uint32_t command;
+        uint64_t commandUS;
+        float angle;
+        size_t source;
+    };
+
+    struct PumpModel {
+        uint8_t pin;
+        uint8_t level;
+        uint64_t levelUS;
+        size_t source;
+    };
+
+    size_t addSource_(uint8_t address, float defaultFlow, uint32_t delayMS);
+    void deliver_(Source& source, uint64_t nowUS);
+    int32_t convert_();
+
+    hal::FakePlatform& platform_;
+    Parameters parameters_;
+    std::mt19937 random_;
+    std::normal_distribution<float> noise_;
+    uint8_t homeSwitchPin_ = LoadCell::NO_PIN;
+    uint8_t ratePin_ = LoadCell::NO_PIN;
+    std::vector<Source> sources_;
+    std::vector<ValveModel> valves_;
+    std::vector<PumpModel> pumps_;
+    bool hasCup_ = false;
+    float cupWeight_ = 0.0;
+    float cupLiquid_ = 0.0;
+    float spilled_ = 0.0;
+};
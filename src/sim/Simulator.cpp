@@ -0,0 +1,231 @@
+#include "Simulator.h"
+#include "Logger.h"
+
+// Same wiring as main.cpp, only the pump and home switch pins are seen by the model.
+static const uint8_t HOME_SW_PIN = 37;
+static const uint8_t LC_DAT = 34;
+static const uint8_t LC_SCK = 12;
+static const uint8_t LC_RATE = 21;
+static const uint8_t VALVE_PINS[] = {26, 13, 14, 32, 25, 4};
+static const uint8_t PUMP_PINS[] = {15, 33, 27};
+static const uint32_t HOMING_TIMEOUT_MS = 60000;
+
+Simulator::Simulator(Options options) : options_(options), random_(options.machine.seed) {
+    hal::FakeStorage::clear();
+    hal::setPlatform(&platform_);
+
+    transport_ = std::make_shared<Transport>(HOME_SW_PIN, RX, TX, MachineConfig::PARK_STEP_ADDRESS);
+    MachineConfig::configureTransport(*transport_);
+
+    dispenser_ = std::make_shared<Dispenser>(LC_DAT, LC_SCK, MachineConfig::CALIBRATION_FACTOR, MachineConfig::EMPTY_WEIGHT, LC_RATE);
+    for (uint8_t pin : VALVE_PINS) {
+        dispenser_->registerValve(std::make_shared<Valve>(pin));
+    }
+    for (uint8_t pin : PUMP_PINS) {
+        dispenser_->registerPump(std::make_shared<Pump>(pin));
+    }
+    dispenser_->loadCalibration();
+    dispenser_->setProportionalValves(true);
+    dispenser_->setSampleRate(options_.fastScale ? LoadCell::Rate::SPS_80 : LoadCell::Rate::SPS_10);
+
+    model_ = std::make_unique<MachineModel>(platform_, options_.machine);
+    model_->setHomeSwitchPin(HOME_SW_PIN);
+    model_->setRatePin(LC_RATE);
+    for (uint8_t i = 0; i < platform_.servos.size(); i++) {
+        model_->addValve(platform_.servos[i], i + 1);
+    }
+    for (uint8_t i = 0; i < sizeof(PUMP_PINS); i++) {
+        model_->addPump(PUMP_PINS[i], i + 7);
+    }
+
+    dispatcher_ = std::make_shared<Dispatcher>(dispenser_, transport_);
+    dispatcher_->setOrderStatusCallback([this](uint16_t orderId, Dispatcher::OrderStatus status, uint8_t queuePosition) {
+        didChangeOrderStatus_(orderId, status);
+    });
+    dispatcher_->setConcurrentPumps(options_.concurrentPumps);
+    dispatcher_->setEarlyDeparture(options_.earlyDeparture);
+    dispatcher_->setPredictiveStart(options_.predictiveStart);
+
+    // Recipes the dispatcher rejects keep an empty job, their orders count as rejected.
+    for (const auto& recipe : options_.mix) {
+        Dispatcher::CompiledJob job;
+        if (dispatcher_->compile(recipe.ingredients, job) == false) {
+            LOG_W("[Simulator][Constructor] Recipe rejected by the dispatcher");
+            job.steps.clear();
+        }
+        float weight = 0.0;
+        for (const auto& ingredient : recipe.ingredients) {
+            weight += ingredient.targetWeight;
+        }
+        jobs_.push_back(job);
+        jobWeights_.push_back(weight);
+    }
+}
+
+Simulator::Report Simulator::run() {
+    if (options_.mix.empty() || boot_() == false) {
+        report_.timedOut = true;
+        return report_;
+    }
+
+    std::vector<float> shares;
+    for (const auto& recipe : options_.mix) {
+        shares.push_back(recipe.share);
+    }
+    std::discrete_distribution<int> pick(shares.begin(), shares.end());
+    std::exponential_distribution<double> gapUS(options_.ordersPerHour / 3600e6);
+
+    uint64_t arrivalUS = nowUS_();
+    for (uint32_t i = 0; i < options_.orders; i++) {
+        if (options_.ordersPerHour > 0 && i > 0) {
+            arrivalUS += (uint64_t)gapUS(random_);
+        }
+        arrivals_.push_back({arrivalUS, (uint8_t)pick(random_)});
+    }
+
+    lastProgressUS_ = nowUS_();
+    while (report_.drinks + report_.rejected < options_.orders || dispatcher_->getState() != Dispatcher::DispatcherState::NO_CUP) {
+        if (nowUS_() - lastProgressUS_ >= (uint64_t)options_.stallTimeoutS * 1000000) {
+            LOG_W("[Simulator][run] Session stalled with ", report_.drinks, " drinks served");
+            report_.timedOut = true;
+            break;
+        }
+        tick_();
+        feedQueue_();
+        operate_();
+        harvestTimeline_();
+    }
+
+    if (report_.drinks > 0) {
+        report_.sessionS = (lastCompletionUS_ - arrivals_.front().timeUS) / 1000000.0f;
+        report_.drinksPerHour = report_.drinks * 3600.0f / report_.sessionS;
+    }
+    report_.spilled = model_->getSpilled();
+    return report_;
+}
+
+// Homes the carriage, the session starts once it is parked.
+bool Simulator::boot_() {
+    bool homed = false;
+    transport_->refMachine([&homed](bool success) { homed = success; });
+
+    uint64_t deadlineUS = nowUS_() + (uint64_t)HOMING_TIMEOUT_MS * 1000;
+    while (nowUS_() < deadlineUS) {
+        tick_();
+        if (homed && transport_->isParked()) {
+            return true;
+        }
+    }
+    LOG_E("[Simulator][boot_] Homing failed");
+    return false;
+}
+
+// One pass of the firmware loop after the physics moved on by a tick.
+void Simulator::tick_() {
+    platform_.clock().advanceUS(options_.tickUS);
+    model_->step(options_.tickUS);
+    transport_->heartbeat();
+    dispenser_->heartbeat();
+    dispatcher_->heartbeat();
+}
+
+// Arrived orders wait in line until the dispatcher queue has room, like a client retrying.
+void Simulator::feedQueue_() {
+    while (nextArrival_ < arrivals_.size() && arrivals_[nextArrival_].timeUS <= nowUS_()) {
+        line_.push_back(arrivals_[nextArrival_++]);
+        lastProgressUS_ = nowUS_();
+    }
+
+    while (line_.empty() == false && dispatcher_->getQueueLength() < Dispatcher::MAX_QUEUED_ORDERS) {
+        Arrival arrival = line_.front();
+        line_.pop_front();
+
+        uint16_t orderId = jobs_[arrival.recipe].steps.empty() ? 0 : dispatcher_->enqueue(jobs_[arrival.recipe]);
+        if (orderId == 0) {
+            report_.rejected++;
+            continue;
+        }
+        OrderRecord& record = orders_[orderId];
+        record.arrivalUS = arrival.timeUS;
+        record.targetWeight = jobWeights_[arrival.recipe];
+    }
+}
+
+// The operator takes a finished drink once the tray is parked, and puts an empty cup down while
+// orders are waiting. Both take a while.
+void Simulator::operate_() {
+    Dispatcher::DispatcherState state = dispatcher_->getState();
+
+    if (model_->hasCup()) {
+        if (state != Dispatcher::DispatcherState::AWAITING_REMOVAL || transport_->isParked() == false) {
+            return;
+        }
+        if (removeAtUS_ == 0) {
+            removeAtUS_ = nowUS_() + operatorDelayUS_(options_.removeDelayMS);
+        } else if (nowUS_() >= removeAtUS_) {
+            removeAtUS_ = 0;
+            float liquid = model_->removeCup();
+            auto order = orders_.find(completedOrderId_);
+            if (order != orders_.end()) {
+                report_.overshoot.push_back(liquid - order->second.targetWeight);
+            }
+        }
+        return;
+    }
+
+    bool waiting = line_.empty() == false || dispatcher_->getQueueLength() > 0;
+    if (state != Dispatcher::DispatcherState::NO_CUP || waiting == false) {
+        return;
+    }
+    if (placeAtUS_ == 0) {
+        placeAtUS_ = nowUS_() + operatorDelayUS_(options_.placeDelayMS);
+    } else if (nowUS_() >= placeAtUS_) {
+        placeAtUS_ = 0;
+        model_->placeCup(options_.cupWeight);
+    }
+}
+
+// The dispatcher records a job's timeline when it clears the job, right before going back to NO_CUP.
+void Simulator::harvestTimeline_() {
+    Dispatcher::DispatcherState state = dispatcher_->getState();
+    if (lastState_ == Dispatcher::DispatcherState::JOB_COMPLETE && state == Dispatcher::DispatcherState::NO_CUP) {
+        for (const auto& step : dispatcher_->getJobStats().getLastJob()) {
+            if (step.completed) {
+                report_.stepOvershoot.push_back(step.actualWeight - step.targetWeight);
+            }
+        }
+    }
+    lastState_ = state;
+}
+
+void Simulator::didChangeOrderStatus_(uint16_t orderId, Dispatcher::OrderStatus status) {
+    OrderRecord& record = orders_[orderId];
+    if (status == Dispatcher::OrderStatus::SERVING) {
+        record.servingUS = nowUS_();
+    } else if (status == Dispatcher::OrderStatus::COMPLETED) {
+        report_.drinks++;
+        report_.latencyS.push_back((nowUS_() - record.arrivalUS) / 1000000.0f);
+        report_.serviceS.push_back((nowUS_() - record.servingUS) / 1000000.0f);
+        completedOrderId_ = orderId;
+        lastCompletionUS_ = nowUS_();
+        lastProgressUS_ = nowUS_();
+    }
+}
+
+// People are not metronomes: half to one and a half times the mean.
+uint64_t Simulator::operatorDelayUS_(uint32_t meanMS) {
+    std::uniform_real_distribution<float> spread(0.5, 1.5);
+    return (uint64_t)(meanMS * spread(random_) * 1000);
+}
+
+uint64_t Simulator::nowUS_() {
+    return platform_.clock().nowUS();
+}
+
+float Simulator::percentile(std::vector<float> values, float fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(size_t)round(fraction * (values.size() - 1))];
+}
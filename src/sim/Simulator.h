@@ -0,0 +1,99 @@
+#include "Arduino.h"
+#include "Dispatcher.h"
+#include "MachineModel.h"
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#pragma once
+
+// Runs service sessions of the real Transport, Dispenser and Dispatcher against MachineModel on a
+// virtual clock, as fast as the host can step it. Orders arrive from an unbounded line and are fed
+// to the dispatcher queue while it has room; a simulated operator swaps cups.
+class Simulator
+{
+public:
+    struct Recipe {
+        std::vector<Dispatcher::Ingredient> ingredients;
+        float share = 1.0;              // Relative frequency in the order mix.
+    };
+
+    struct Options {
+        std::vector<Recipe> mix;
+        uint32_t orders = 50;
+        float ordersPerHour = 0.0;      // Poisson arrivals, 0 has every order waiting at the start.
+        uint32_t removeDelayMS = 3000;  // Mean time for the operator to take a finished drink.
+        uint32_t placeDelayMS = 2000;   // Mean time to put an empty cup down once one is needed.
+        float cupWeight = 60.0;
+        bool fastScale = true;          // HX711 at 80Hz.
+        bool concurrentPumps = true;
+        bool earlyDeparture = true;
+        bool predictiveStart = true;
+        uint32_t tickUS = 1000;         // Loop period.
+        uint32_t stallTimeoutS = 600;   // Simulated time without an arrival or a finished drink before the session counts as stuck.
+        MachineModel::Parameters machine;
+    };
+
+    struct Report {
+        uint32_t drinks = 0;
+        uint32_t rejected = 0;          // Orders the dispatcher refused to queue.
+        bool timedOut = false;         // Stalled, the figures cover the drinks served until then.
+        float sessionS = 0.0;           // First arrival -> last drink completed.
+        float drinksPerHour = 0.0;
+        std::vector<float> latencyS;    // Arrival -> completed, queueing included.
+        std::vector<float> serviceS;    // Serving -> completed.
+        std::vector<float> overshoot;   // Grams in the cup at removal minus the recipe total.
+        std::vector<float> stepOvershoot; // Per step as the scale saw it (JobStats).
+        float spilled = 0.0;
+    };
+
+    explicit Simulator(Options options);
+    Report run();
+
+    static float percentile(std::vector<float> values, float fraction);
+
+private:
+    struct Arrival {
+        uint64_t timeUS;
+        uint8_t recipe;
+    };
+
+    struct OrderRecord {
+        uint64_t arrivalUS;
+        uint64_t servingUS = 0;
+        float targetWeight;
+    };
+
+    bool boot_();
+    void tick_();
+    void feedQueue_();
+    void operate_();
+    void harvestTimeline_();
+    void didChangeOrderStatus_(uint16_t orderId, Dispatcher::OrderStatus status);
+    uint64_t operatorDelayUS_(uint32_t meanMS);
+    uint64_t nowUS_();
+
+    Options options_;
+    std::mt19937 random_;
+    hal::FakePlatform platform_;
+    std::shared_ptr<Transport> transport_;
+    std::shared_ptr<Dispenser> dispenser_;
+    std::shared_ptr<Dispatcher> dispatcher_;
+    std::unique_ptr<MachineModel> model_;
+
+    std::vector<Dispatcher::CompiledJob> jobs_;     // One per recipe, compiled once like RecipeStore.
+    std::vector<float> jobWeights_;
+    std::vector<Arrival> arrivals_;
+    size_t nextArrival_ = 0;
+    std::deque<Arrival> line_;
+    std::map<uint16_t, OrderRecord> orders_;
+    uint16_t completedOrderId_ = 0;
+    uint64_t removeAtUS_ = 0;
+    uint64_t placeAtUS_ = 0;
+    uint64_t lastCompletionUS_ = 0;
+    uint64_t lastProgressUS_ = 0;
+    Dispatcher::DispatcherState lastState_ = Dispatcher::DispatcherState::UNKNOWN;
+    Report report_;
+};
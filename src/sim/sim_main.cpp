@@ -0,0 +1,132 @@
+#include <chrono>
+#include <cstring>
+#include "Simulator.h"
+
+// Host-side throughput benchmark: pio run -e sim, then .pio/build/sim/program [options]
+//
+//   --orders N            orders in the session (50)
+//   --rate N              Poisson arrivals per hour, 0 queues every order at the start (0)
+//   --recipe S:A=G,...    order mix entry with share S, address A, grams G; repeatable
+//   --flow A=G            flow of address A in g/s; repeatable
+//   --hz 10|80            HX711 rate (80)
+//   --noise G             scale noise, standard deviation in grams (0.1)
+//   --remove MS           mean time for the operator to take a drink (3000)
+//   --place MS            mean time to put an empty cup down (2000)
+//   --seed N              random seed (1)
+//   --tick US             loop period (1000)
+//   --sequential-pumps, --no-early-departure, --no-predictive-start
+
+static bool parseRecipe(const char* text, Simulator::Recipe& recipe) {
+    const char* colon = strchr(text, ':');
+    if (colon == nullptr) {
+        return false;
+    }
+    recipe.share = atof(text);
+    recipe.ingredients.clear();
+
+    const char* cursor = colon + 1;
+    while (*cursor != '\0') {
+        const char* equal = strchr(cursor, '=');
+        if (equal == nullptr) {
+            return false;
+        }
+        recipe.ingredients.push_back({(uint8_t)atoi(cursor), (float)atof(equal + 1)});
+        const char* comma = strchr(equal, ',');
+        if (comma == nullptr) {
+            break;
+        }
+        cursor = comma + 1;
+    }
+    return recipe.ingredients.empty() == false && recipe.share > 0;
+}
+
+static void printRow(const char* name, const std::vector<float>& values) {
+    printf("  %-20s %8.2f %8.2f %8.2f %8.2f\n", name,
+        Simulator::percentile(values, 0.05), Simulator::percentile(values, 0.5),
+        Simulator::percentile(values, 0.95), Simulator::percentile(values, 1.0));
+}
+
+int main(int argc, char** argv) {
+    Simulator::Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        if (strcmp(arg, "--sequential-pumps") == 0) {
+            options.concurrentPumps = false;
+            continue;
+        } else if (strcmp(arg, "--no-early-departure") == 0) {
+            options.earlyDeparture = false;
+            continue;
+        } else if (strcmp(arg, "--no-predictive-start") == 0) {
+            options.predictiveStart = false;
+            continue;
+        }
+
+        i++;
+        if (strcmp(arg, "--orders") == 0) {
+            options.orders = atoi(value);
+        } else if (strcmp(arg, "--rate") == 0) {
+            options.ordersPerHour = atof(value);
+        } else if (strcmp(arg, "--recipe") == 0) {
+            Simulator::Recipe recipe;
+            if (parseRecipe(value, recipe) == false) {
+                fprintf(stderr, "Invalid recipe: %s\n", value);
+                return 1;
+            }
+            options.mix.push_back(recipe);
+        } else if (strcmp(arg, "--flow") == 0) {
+            const char* equal = strchr(value, '=');
+            if (equal == nullptr) {
+                fprintf(stderr, "Invalid flow: %s\n", value);
+                return 1;
+            }
+            options.machine.flows[(uint8_t)atoi(value)] = atof(equal + 1);
+        } else if (strcmp(arg, "--hz") == 0) {
+            options.fastScale = atoi(value) == 80;
+        } else if (strcmp(arg, "--noise") == 0) {
+            options.machine.scaleNoise = atof(value);
+        } else if (strcmp(arg, "--remove") == 0) {
+            options.removeDelayMS = atoi(value);
+        } else if (strcmp(arg, "--place") == 0) {
+            options.placeDelayMS = atoi(value);
+        } else if (strcmp(arg, "--seed") == 0) {
+            options.machine.seed = atoi(value);
+        } else if (strcmp(arg, "--tick") == 0) {
+            options.tickUS = std::max(atoi(value), 100);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return 1;
+        }
+    }
+
+    // House mix: a highball, a four ingredient sour and a short stirred drink.
+    if (options.mix.empty()) {
+        Simulator::Recipe recipe;
+        parseRecipe("0.45:1=45,7=150", recipe);
+        options.mix.push_back(recipe);
+        parseRecipe("0.35:2=40,3=20,8=30,9=20", recipe);
+        options.mix.push_back(recipe);
+        parseRecipe("0.2:4=45,5=20,6=15", recipe);
+        options.mix.push_back(recipe);
+    }
+
+    auto began = std::chrono::steady_clock::now();
+    Simulator simulator(options);
+    Simulator::Report report = simulator.run();
+    float wallS = std::chrono::duration<float>(std::chrono::steady_clock::now() - began).count();
+
+    printf("MixTender simulation: %u orders, %s, HX711 %dHz, noise %.2fg, seed %u\n", options.orders,
+        options.ordersPerHour > 0 ? "Poisson arrivals" : "all queued at start", options.fastScale ? 80 : 10,
+        options.machine.scaleNoise, options.machine.seed);
+    printf("  Simulated %.0fs in %.2fs (%.0fx real time)%s\n", report.sessionS, wallS,
+        wallS > 0 ? report.sessionS / wallS : 0.0f, report.timedOut ? ", STALLED" : "");
+    printf("  Drinks: %u (%u rejected), %.1f drinks/hour, %.1fg spilled\n", report.drinks, report.rejected,
+        report.drinksPerHour, report.spilled);
+    printf("  %-20s %8s %8s %8s %8s\n", "", "p5", "p50", "p95", "max");
+    printRow("latency (s)", report.latencyS);
+    printRow("service (s)", report.serviceS);
+    printRow("drink overshoot (g)", report.overshoot);
+    printRow("step overshoot (g)", report.stepOvershoot);
+    return report.timedOut ? 2 : 0;
+}
@@ -0,0 +1,145 @@
+#include <unity.h>
+#include "BluetoothEngine.h"
+#include "hal/native/FakePlatform.h"
+
+namespace {
+    hal::FakePlatform* platform;
+    BluetoothEngine* engine;
+    hal::FakeBleTransport* client;
+
+    std::string hello(uint8_t seq) {
+        std::string data;
+        data += (char)BleProtocol::SYNC;
+        data += (char)BleProtocol::VERSION;
+        data += (char)BleProtocol::MessageType::HELLO;
+        data += (char)seq;
+        data += (char)0;
+        return data;
+    }
+
+    // One transmit slot.
+    void tick() {
+        platform->clock().advanceMS(30);
+        engine->heartbeat();
+    }
+}
+
+void setUp() {
+    platform = new hal::FakePlatform();
+    hal::setPlatform(platform);
+    engine = new BluetoothEngine();
+    client = platform->bleTransport;
+    client->connect(30);
+    tick();
+}
+
+void tearDown() {
+    delete engine;
+    delete platform;
+}
+
+void test_advertises_until_connected() {
+    client->disconnect();
+    client->stopAdvertising();
+    tick();
+    TEST_ASSERT_TRUE(client->isAdvertising());
+}
+
+void test_frames_are_queued_and_acked_with_their_outcome() {
+    client->write(hello(5));
+    BleProtocol::Command command;
+    TEST_ASSERT_TRUE(engine->readCommand(command));
+    TEST_ASSERT_EQUAL(BleProtocol::MessageType::HELLO, command.type);
+    TEST_ASSERT_EQUAL(BluetoothEngine::Protocol::BINARY, engine->getProtocol());
+
+    // Nothing is acknowledged before the loop ran the command.
+    tick();
+    TEST_ASSERT_EQUAL(0, client->getNotifications().size());
+
+    engine->acknowledge(command.seq, BleProtocol::AckResult::QUEUE_FULL);
+    tick();
+    TEST_ASSERT_EQUAL(1, client->getNotifications().size());
+    const std::string& ack = client->getNotifications().back();
+    TEST_ASSERT_EQUAL_HEX8((uint8_t)BleProtocol::MessageType::ACK, (uint8_t)ack[2]);
+    TEST_ASSERT_EQUAL_UINT8(5, (uint8_t)ack[5]);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)BleProtocol::AckResult::QUEUE_FULL, (uint8_t)ack[6]);
+}
+
+void test_malformed_frame_is_acked_on_receipt() {
+    std::string frame = hello(6);
+    frame[4] = 1;
+    client->write(frame);
+    BleProtocol::Command command;
+    TEST_ASSERT_FALSE(engine->readCommand(command));
+
+    tick();
+    TEST_ASSERT_EQUAL(1, client->getNotifications().size());
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)BleProtocol::AckResult::MALFORMED, (uint8_t)client->getNotifications()[0][6]);
+}
+
+void test_repeated_sequence_is_a_duplicate() {
+    client->write(hello(5));
+    client->write(hello(5));
+    BleProtocol::Command command;
+    TEST_ASSERT_TRUE(engine->readCommand(command));
+    TEST_ASSERT_FALSE(engine->readCommand(command));
+    engine->acknowledge(command.seq, BleProtocol::AckResult::OK);
+
+    tick();
+    tick();
+    TEST_ASSERT_EQUAL(2, client->getNotifications().size());
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)BleProtocol::AckResult::DUPLICATE, (uint8_t)client->getNotifications()[0][6]);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)BleProtocol::AckResult::OK, (uint8_t)client->getNotifications()[1][6]);
+}
+
+void test_ascii_requests_are_acked_in_text() {
+    engine->acknowledgeRequest('O', BleProtocol::AckResult::UNKNOWN_RECIPE);
+    engine->acknowledgeRequest('X', BleProtocol::AckResult::OK);
+    tick();
+    tick();
+    TEST_ASSERT_EQUAL(2, client->getNotifications().size());
+    TEST_ASSERT_EQUAL_STRING("AO=7;", client->getNotifications()[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("AX=0;", client->getNotifications()[1].c_str());
+}
+
+void test_status_keeps_newest_value() {
+    engine->notifyStatus(BleProtocol::StatusCode::SERVING);
+    engine->notifyStatus(BleProtocol::StatusCode::DONE);
+    tick();
+    tick();
+    TEST_ASSERT_EQUAL(1, client->getNotifications().size());
+    TEST_ASSERT_EQUAL_STRING("$0=Get your drink!", client->getNotifications()[0].c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, engine->getTxStats().coalesced);
+}
+
+void test_transmits_once_per_interval() {
+    engine->notifyStateIsProcessing(0);
+    engine->notifyStateIsComplete(0);
+    tick();
+    platform->clock().advanceMS(10);
+    engine->heartbeat();
+    TEST_ASSERT_EQUAL(1, client->getNotifications().size());
+    tick();
+    TEST_ASSERT_EQUAL(2, client->getNotifications().size());
+    TEST_ASSERT_EQUAL_STRING("S0=C;", client->getNotifications()[1].c_str());
+}
+
+void test_diagnostics_are_not_notified() {
+    uint8_t snapshot[] = {1, 2, 3};
+    engine->setDiagnostics(snapshot, sizeof(snapshot));
+    TEST_ASSERT_EQUAL(3, client->getValue(hal::BleTransport::Channel::DIAGNOSTICS).size());
+    TEST_ASSERT_EQUAL(0, client->getNotifications().size());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_advertises_until_connected);
+    RUN_TEST(test_frames_are_queued_and_acked_with_their_outcome);
+    RUN_TEST(test_malformed_frame_is_acked_on_receipt);
+    RUN_TEST(test_repeated_sequence_is_a_duplicate);
+    RUN_TEST(test_ascii_requests_are_acked_in_text);
+    RUN_TEST(test_status_keeps_newest_value);
+    RUN_TEST(test_transmits_once_per_interval);
+    RUN_TEST(test_diagnostics_are_not_notified);
+    return UNITY_END();
+}
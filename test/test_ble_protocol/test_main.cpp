@@ -0,0 +1,77 @@
+#include <unity.h>
+#include "BleProtocol.h"
+
+namespace {
+    std::string frame(BleProtocol::MessageType type, uint8_t seq, const std::string& payload) {
+        std::string data;
+        data += (char)BleProtocol::SYNC;
+        data += (char)BleProtocol::VERSION;
+        data += (char)type;
+        data += (char)seq;
+        data += (char)payload.size();
+        return data + payload;
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_ascii_is_not_a_frame() {
+    TEST_ASSERT_FALSE(BleProtocol::isFrame("D:1=20;"));
+    TEST_ASSERT_TRUE(BleProtocol::isFrame(frame(BleProtocol::MessageType::HELLO, 1, "")));
+}
+
+void test_decode_order() {
+    std::string payload = {2, 1, (char)0xC8, 0, 7, 0x32, 0};     // 20.0g at 1, 5.0g at 7
+    BleProtocol::Command command;
+    TEST_ASSERT_EQUAL(BleProtocol::AckResult::OK, BleProtocol::decode(frame(BleProtocol::MessageType::ORDER, 9, payload), command));
+    TEST_ASSERT_EQUAL(BleProtocol::MessageType::ORDER, command.type);
+    TEST_ASSERT_EQUAL_UINT8(9, command.seq);
+    TEST_ASSERT_EQUAL_UINT8(2, command.stepCount);
+    TEST_ASSERT_EQUAL_UINT8(1, command.steps[0].address);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 20.0, command.steps[0].weight);
+    TEST_ASSERT_EQUAL_UINT8(7, command.steps[1].address);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 5.0, command.steps[1].weight);
+}
+
+void test_decode_rejects_bad_frames() {
+    BleProtocol::Command command;
+    std::string order = frame(BleProtocol::MessageType::ORDER, 1, {1, 1, 10, 0});
+    TEST_ASSERT_EQUAL(BleProtocol::AckResult::MALFORMED, BleProtocol::decode(order.substr(0, order.size() - 1), command));
+    TEST_ASSERT_EQUAL(BleProtocol::AckResult::MALFORMED, BleProtocol::decode(frame(BleProtocol::MessageType::ORDER, 1, {2, 1, 10, 0}), command));
+    TEST_ASSERT_EQUAL(BleProtocol::AckResult::MALFORMED, BleProtocol::decode(frame(BleProtocol::MessageType::HELLO, 1, {0}), command));
+
+    std::string wrongVersion = frame(BleProtocol::MessageType::HELLO, 4, "");
+    wrongVersion[1] = BleProtocol::VERSION + 1;
+    TEST_ASSERT_EQUAL(BleProtocol::AckResult::BAD_VERSION, BleProtocol::decode(wrongVersion, command));
+    TEST_ASSERT_EQUAL_UINT8(4, command.seq);
+}
+
+void test_encode_weight() {
+    uint8_t out[BleProtocol::MAX_FRAME_SIZE];
+    size_t length = BleProtocol::encodeWeight(out, 3, 2, -12.34);
+    TEST_ASSERT_EQUAL(BleProtocol::HEADER_SIZE + 3, length);
+    TEST_ASSERT_EQUAL_HEX8(BleProtocol::SYNC, out[0]);
+    TEST_ASSERT_EQUAL_HEX8((uint8_t)BleProtocol::MessageType::WEIGHT, out[2]);
+    TEST_ASSERT_EQUAL_UINT8(3, out[3]);
+    TEST_ASSERT_EQUAL_UINT8(2, out[5]);
+    TEST_ASSERT_EQUAL_INT(-123, (int16_t)(out[6] | (out[7] << 8)));
+}
+
+void test_encode_ack() {
+    uint8_t out[BleProtocol::MAX_FRAME_SIZE];
+    size_t length = BleProtocol::encodeAck(out, 0, 17, BleProtocol::AckResult::DUPLICATE);
+    TEST_ASSERT_EQUAL(BleProtocol::HEADER_SIZE + 2, length);
+    TEST_ASSERT_EQUAL_UINT8(17, out[5]);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)BleProtocol::AckResult::DUPLICATE, out[6]);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_ascii_is_not_a_frame);
+    RUN_TEST(test_decode_order);
+    RUN_TEST(test_decode_rejects_bad_frames);
+    RUN_TEST(test_encode_weight);
+    RUN_TEST(test_encode_ack);
+    return UNITY_END();
+}
@@ -0,0 +1,221 @@
+#include <unity.h>
+#include "Dispatcher.h"
+#include "MachineConfig.h"
+#include "hal/native/FakePlatform.h"
+
+namespace {
+    const uint8_t HOME_SW_PIN = 37;
+    const uint8_t PUMP_PIN = 15;   // Address 7.
+    const float K_FACTOR = 400.0;
+
+    hal::FakePlatform* platform;
+    std::shared_ptr<Transport> transport;
+    std::shared_ptr<Dispenser> dispenser;
+    std::shared_ptr<Dispatcher> dispatcher;
+    float grams;            // On the scale.
+    float pumpFlow;         // g/ms while the pump runs.
+    float valveFlow;        // g/ms while a valve is open.
+    float motionBias;       // Added to the reading while the carriage moves, the tray pushing on the cell.
+    float reading;
+    bool openedWhileMoving;
+    std::vector<Dispatcher::OrderStatus> statuses;
+
+    // Steps the machine in 1ms ticks. The home switch sits at the carriage's start position, the
+    // scale gains pumpFlow every tick the pump pin is high.
+    bool runUntil(std::function<bool()> done, uint32_t timeoutMS) {
+        for (uint32_t elapsed = 0; elapsed < timeoutMS; elapsed++) {
+            platform->clock().advanceMS(1);
+            platform->gpio().setInput(HOME_SW_PIN, platform->stepper->getPhysicalPosition() <= -200 ? HIGH : LOW);
+            if (platform->gpio().digitalRead(PUMP_PIN) == HIGH) {
+                grams += pumpFlow;
+            }
+            bool moving = platform->stepper->getCurrentSpeed() != 0;
+            for (hal::FakeServo* servo : platform->servos) {
+                if (servo->getAngle() > 100) {
+                    grams += valveFlow;
+                    openedWhileMoving |= moving;
+                }
+            }
+            reading = grams + (moving ? motionBias : 0);
+            transport->heartbeat();
+            dispenser->heartbeat();
+            dispatcher->heartbeat();
+            if (done()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Dispatcher::CompiledJob job(uint8_t address, float weight) {
+        Dispatcher::CompiledJob compiled;
+        TEST_ASSERT_TRUE(dispatcher->compile({{address, weight}}, compiled));
+        return compiled;
+    }
+}
+
+void setUp() {
+    hal::FakeStorage::clear();
+    platform = new hal::FakePlatform();
+    hal::setPlatform(platform);
+    grams = 0;
+    pumpFlow = 0.02;
+    valveFlow = 0.025;
+    motionBias = 0;
+    reading = 0;
+    openedWhileMoving = false;
+    statuses.clear();
+
+    transport = std::make_shared<Transport>(HOME_SW_PIN, RX, TX, MachineConfig::PARK_STEP_ADDRESS);
+    MachineConfig::configureTransport(*transport);
+
+    dispenser = std::make_shared<Dispenser>(1, 2, K_FACTOR);
+    platform->loadCellAdc->setSource([]() { return (int32_t)(reading * K_FACTOR); });
+    for (uint8_t pin : {3, 4, 5, 6, 7, 8}) {
+        dispenser->registerValve(std::make_shared<Valve>(pin));
+    }
+    for (uint8_t pin : {PUMP_PIN, (uint8_t)33, (uint8_t)27}) {
+        dispenser->registerPump(std::make_shared<Pump>(pin));
+    }
+
+    dispatcher = std::make_shared<Dispatcher>(dispenser, transport);
+    dispatcher->setOrderStatusCallback([](uint16_t orderId, Dispatcher::OrderStatus status, uint8_t queuePosition) {
+        statuses.push_back(status);
+    });
+
+    transport->refMachine();
+    TEST_ASSERT_TRUE(runUntil([]() { return transport->isParked(); }, 60000));
+}
+
+void tearDown() {
+    dispatcher.reset();
+    dispenser.reset();
+    transport.reset();
+    delete platform;
+}
+
+void test_cup_detection() {
+    TEST_ASSERT_EQUAL(Dispatcher::DispatcherState::NO_CUP, dispatcher->getState());
+    grams = 120;
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::READY; }, 2000));
+    grams = 0;
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::NO_CUP; }, 2000));
+}
+
+// At the default 10Hz a lifted cup is a 300g step between two conversions. The presence reading must
+// not swing back over the cup threshold on its way down.
+void test_cup_removal_reads_no_phantom_cup() {
+    grams = 300;
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::READY; }, 2000));
+    runUntil([]() { return false; }, 2000);
+
+    grams = 0;
+    TEST_ASSERT_TRUE(runUntil([]() { return dispenser->getAbsoluteWeight() < 3.0; }, 2000));
+    float peak = -1000;
+    runUntil([&peak]() {
+        peak = std::max(peak, dispenser->getAbsoluteWeight());
+        return dispatcher->getState() == Dispatcher::DispatcherState::READY;
+    }, 3000);
+    TEST_ASSERT_EQUAL(Dispatcher::DispatcherState::NO_CUP, dispatcher->getState());
+    TEST_ASSERT_TRUE(peak < 3.0);
+}
+
+// With orders queued, lifting the served cup, or brushing the empty tray, must not start the next
+// one. Only a cup that stays on the scale and settles does, at the 100ms sample period of the HX711's 10Hz rate.
+void test_queued_order_waits_for_a_settled_cup() {
+    platform->loadCellAdc->setSamplePeriodUS(100000);
+    grams = 120;
+    uint16_t first = dispatcher->enqueue(job(7, 20.0));
+    uint16_t second = dispatcher->enqueue(job(7, 10.0));
+    TEST_ASSERT_TRUE(runUntil([first]() { return dispatcher->getCurrentOrderId() == first; }, 2000));
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::AWAITING_REMOVAL; }, 60000));
+
+    grams = 0;
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::NO_CUP; }, 20000));
+    TEST_ASSERT_FALSE(runUntil([]() { return dispatcher->getCurrentOrderId() != 0; }, 3000));
+
+    grams = 60;
+    runUntil([]() { return false; }, 300);
+    grams = 0;
+    TEST_ASSERT_FALSE(runUntil([]() { return dispatcher->getCurrentOrderId() != 0; }, 2000));
+    TEST_ASSERT_EQUAL(1, dispatcher->getQueueLength());
+
+    grams = 120;
+    uint32_t placedMS = platform->clock().millis();
+    TEST_ASSERT_TRUE(runUntil([second]() { return dispatcher->getCurrentOrderId() == second; }, 3000));
+    TEST_ASSERT_TRUE(platform->clock().millis() - placedMS >= Dispatcher::CUP_HOLD_MS);
+}
+
+void test_compile_rejects_unknown_address() {
+    Dispatcher::CompiledJob compiled;
+    TEST_ASSERT_FALSE(dispatcher->compile({{0, 10.0}}, compiled));
+    TEST_ASSERT_FALSE(dispatcher->compile({{10, 10.0}}, compiled));
+    TEST_ASSERT_FALSE(dispatcher->compile({}, compiled));
+}
+
+void test_orders_wait_for_a_cup() {
+    uint16_t first = dispatcher->enqueue(job(7, 20.0));
+    uint16_t second = dispatcher->enqueue(job(7, 10.0));
+    runUntil([]() { return false; }, 500);
+    TEST_ASSERT_EQUAL(2, dispatcher->getQueueLength());
+    TEST_ASSERT_EQUAL(0, dispatcher->getCurrentOrderId());
+
+    TEST_ASSERT_TRUE(dispatcher->cancelOrder(second));
+    TEST_ASSERT_FALSE(dispatcher->cancelOrder(second));
+    TEST_ASSERT_EQUAL(1, dispatcher->getQueueLength());
+    TEST_ASSERT_EQUAL(Dispatcher::OrderStatus::QUEUED, statuses.back());
+    TEST_ASSERT_TRUE(first != second);
+}
+
+void test_pump_order_is_served() {
+    grams = 120;
+    uint16_t order = dispatcher->enqueue(job(7, 20.0));
+    TEST_ASSERT_TRUE(runUntil([order]() { return dispatcher->getCurrentOrderId() == order; }, 2000));
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::AWAITING_REMOVAL; }, 60000));
+
+    TEST_ASSERT_EQUAL(Dispatcher::OrderStatus::COMPLETED, statuses.back());
+    TEST_ASSERT_FLOAT_WITHIN(3.0, 140.0, grams);
+    TEST_ASSERT_TRUE(runUntil([]() { return transport->isParked(); }, 20000));
+}
+
+// The valve opens while the tray is still braking and the cell reads the tray pushing on it; the pour
+// is zeroed on the settled reading from before the move, so the cup still gets its target.
+void test_predictive_valve_pour_weighs_right() {
+    dispatcher->setPredictiveStart(true);
+    motionBias = 8.0;
+    grams = 120;
+    runUntil([]() { return false; }, 2000);
+    TEST_ASSERT_EQUAL(Dispatcher::DispatcherState::READY, dispatcher->getState());
+
+    dispatcher->enqueue(job(2, 40.0));
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::AWAITING_REMOVAL; }, 60000));
+    TEST_ASSERT_TRUE(openedWhileMoving);
+    TEST_ASSERT_FLOAT_WITHIN(4.0, 160.0, grams);
+}
+
+// Learning during a pour only marks the calibration dirty, NVS is written once the machine is idle.
+void test_calibration_is_saved_when_idle() {
+    grams = 120;
+    dispatcher->enqueue(job(7, 20.0));
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::AWAITING_REMOVAL; }, 60000));
+    TEST_ASSERT_TRUE(dispenser->isCalibrationDirty());
+    TEST_ASSERT_EQUAL_UINT32(0, hal::FakeStorage::getWriteCount("dispenser"));
+
+    grams = 0;
+    TEST_ASSERT_TRUE(runUntil([]() { return dispatcher->getState() == Dispatcher::DispatcherState::NO_CUP; }, 20000));
+    TEST_ASSERT_TRUE(runUntil([]() { return dispenser->isCalibrationDirty() == false; }, 6 * 60 * 1000));
+    TEST_ASSERT_TRUE(hal::FakeStorage::getWriteCount("dispenser") > 0);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_cup_detection);
+    RUN_TEST(test_cup_removal_reads_no_phantom_cup);
+    RUN_TEST(test_queued_order_waits_for_a_settled_cup);
+    RUN_TEST(test_compile_rejects_unknown_address);
+    RUN_TEST(test_orders_wait_for_a_cup);
+    RUN_TEST(test_pump_order_is_served);
+    RUN_TEST(test_calibration_is_saved_when_idle);
+    RUN_TEST(test_predictive_valve_pour_weighs_right);
+    return UNITY_END();
+}
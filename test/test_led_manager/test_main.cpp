@@ -0,0 +1,185 @@
+#include <unity.h>
+#include "LedManager.h"
+#include "LedTables.h"
+#include "hal/native/FakePlatform.h"
+
+namespace {
+    hal::FakePlatform* platform;
+    LedManager* leds;
+    hal::FakeLedStrip* strip;
+
+    // One loop pass per millisecond, draw runs before the heartbeat like the UI block in main.
+    void run(uint32_t durationMS, std::function<void(uint32_t)> draw = nullptr) {
+        for (uint32_t elapsed = 0; elapsed < durationMS; elapsed++) {
+            platform->clock().advanceMS(1);
+            if (draw) {
+                draw(elapsed);
+            }
+            leds->heartbeat();
+        }
+    }
+}
+
+void setUp() {
+    platform = new hal::FakePlatform();
+    hal::setPlatform(platform);
+    leds = new LedManager(22);
+    strip = platform->ledStrip;
+}
+
+void tearDown() {
+    delete leds;
+    delete platform;
+}
+
+// Redrawing the same picture every pass sends it once.
+void test_unchanged_frame_is_not_sent_again() {
+    run(1000, [](uint32_t elapsed) { leds->trackTray(1000, hal::Rgb(0, 255, 0), hal::Rgb(10, 10, 10)); });
+
+    TEST_ASSERT_EQUAL_UINT32(1, strip->getShowCount());
+    TEST_ASSERT_TRUE(strip->getPixels()[0] == hal::Rgb(10, 10, 10));
+}
+
+// A tray moving every pass is rendered at the frame rate, not at the loop rate.
+void test_frames_are_capped_at_the_frame_rate() {
+    run(1000, [](uint32_t elapsed) { leds->trackTray((elapsed * 40) % 2340, hal::Rgb(0, 255, 0), hal::Rgb(10, 10, 10)); });
+
+    TEST_ASSERT_TRUE(strip->getShowCount() >= 28);
+    TEST_ASSERT_TRUE(strip->getShowCount() <= 31);
+    TEST_ASSERT_EQUAL_UINT32(strip->getShowCount(), leds->getFrameCount());
+}
+
+// The fade is evaluated per frame and its last frame is the target, whenever it comes.
+void test_fade_ends_on_target() {
+    leds->fadeTo(hal::Rgb(0, 0, 0), hal::Rgb(100, 0, 0), 1000);
+    run(1100);
+
+    TEST_ASSERT_FALSE(leds->isFading());
+    TEST_ASSERT_TRUE(leds->fadedComplete());
+    TEST_ASSERT_TRUE(strip->getPixels()[40] == hal::Rgb(100, 0, 0));
+    TEST_ASSERT_TRUE(strip->getShowCount() <= 33);
+}
+
+// A closed gate holds the frame back, it goes out as soon as the gate opens.
+void test_render_gate_defers_frame() {
+    bool open = false;
+    uint32_t asked = 0;
+    leds->setRenderGate([&open, &asked](uint32_t frameUS) { asked = frameUS; return open; });
+
+    leds->setAllLeds(hal::Rgb(0, 0, 50));
+    run(200);
+    TEST_ASSERT_EQUAL_UINT32(0, strip->getShowCount());
+    TEST_ASSERT_EQUAL_UINT32(75 * hal::LedStrip::PIXEL_US + hal::LedStrip::LATCH_US, asked);
+
+    open = true;
+    run(1);
+    TEST_ASSERT_EQUAL_UINT32(1, strip->getShowCount());
+    TEST_ASSERT_TRUE(strip->getPixels()[74] == hal::Rgb(0, 0, 50));
+}
+
+// Without a frame rate cap, frames still wait for the previous one to be clocked out and latched.
+void test_busy_strip_defers_frame() {
+    leds->setMaxFrameRate(255);
+    run(100, [](uint32_t elapsed) { leds->setLed(0, hal::Rgb(elapsed, 0, 0)); });
+
+    uint32_t frameMS = (75 * hal::LedStrip::PIXEL_US + hal::LedStrip::LATCH_US + 999) / 1000;
+    TEST_ASSERT_TRUE(strip->getShowCount() <= 100 / frameMS + 1);
+    TEST_ASSERT_TRUE(strip->getShowCount() >= 100 / (frameMS + 1));
+}
+
+void test_tables_are_monotonic_and_span_the_range() {
+    TEST_ASSERT_EQUAL_UINT8(0, LedTables::GAMMA[0]);
+    TEST_ASSERT_EQUAL_UINT8(255, LedTables::GAMMA[255]);
+    TEST_ASSERT_EQUAL_UINT8(0, LedTables::EASE_IN_OUT[0]);
+    TEST_ASSERT_EQUAL_UINT8(255, LedTables::EASE_IN_OUT[255]);
+    TEST_ASSERT_UINT8_WITHIN(1, 128, LedTables::EASE_IN_OUT[128]);
+    TEST_ASSERT_UINT8_WITHIN(1, 56, LedTables::GAMMA[128]);
+    for (int i = 1; i < 256; i++) {
+        TEST_ASSERT_TRUE(LedTables::GAMMA[i] >= LedTables::GAMMA[i - 1]);
+        TEST_ASSERT_TRUE(LedTables::EASE_IN_OUT[i] >= LedTables::EASE_IN_OUT[i - 1]);
+    }
+}
+
+// The window sits where map(position, 2340, 0, 0, 75) put it, the progress bar fills it from its start.
+void test_tray_window_and_progress_bar() {
+    hal::Rgb tray(0, 255, 255);
+    hal::Rgb background(0, 0, 20);
+    hal::Rgb bar(255, 0, 0);
+
+    leds->trackTray(0, tray, background);
+    run(40);
+    TEST_ASSERT_TRUE(strip->getPixels()[60] == background);
+    TEST_ASSERT_TRUE(strip->getPixels()[61] == tray);
+    TEST_ASSERT_TRUE(strip->getPixels()[74] == tray);
+
+    leds->trackTray(1170, tray, background);
+    leds->setProgress(500, bar);
+    run(40);
+    TEST_ASSERT_TRUE(strip->getPixels()[22] == background);
+    TEST_ASSERT_TRUE(strip->getPixels()[23] == bar);
+    TEST_ASSERT_TRUE(strip->getPixels()[29] == bar);
+    TEST_ASSERT_TRUE(strip->getPixels()[30] == tray);
+    TEST_ASSERT_TRUE(strip->getPixels()[36] == tray);
+    TEST_ASSERT_TRUE(strip->getPixels()[37] == background);
+
+    // A fraction of an LED shows as a partial blend on the bar's leading edge.
+    leds->setProgress(520, bar);
+    run(40);
+    hal::Rgb edge = strip->getPixels()[30];
+    TEST_ASSERT_TRUE(edge.r > 0 && edge.r < 255);
+
+    leds->hideProgress();
+    run(40);
+    TEST_ASSERT_TRUE(strip->getPixels()[23] == tray);
+}
+
+// The pulse breathes over the whole strip and leaves the layers below untouched when stopped.
+void test_pulse_breathes_and_stops() {
+    hal::Rgb background(10, 10, 10);
+    leds->setAllLeds(background);
+    leds->setPulse(hal::Rgb(0, 200, 0), 1000);
+
+    uint8_t peak = 0;
+    uint8_t trough = 255;
+    run(2000, [&peak, &trough](uint32_t elapsed) {
+        uint8_t g = strip->getPixels()[0].g;
+        peak = std::max(peak, g);
+        trough = std::min(trough, g);
+    });
+    TEST_ASSERT_TRUE(peak >= 190);
+    TEST_ASSERT_TRUE(trough <= 12);
+
+    leds->stopPulse();
+    run(40);
+    TEST_ASSERT_TRUE(strip->getPixels()[0] == background);
+    TEST_ASSERT_TRUE(strip->getPixels()[74] == background);
+}
+
+// Every composed frame is timed, a static picture is composed once.
+void test_render_times_are_recorded() {
+    leds->trackTray(1000, hal::Rgb(0, 255, 0), hal::Rgb(10, 10, 10));
+    run(500);
+    TEST_ASSERT_EQUAL_UINT32(1, leds->getRenderTimes().getCount());
+
+    leds->fadeTo(hal::Rgb(0, 0, 0), hal::Rgb(0, 0, 100), 500);
+    run(600);
+    TEST_ASSERT_TRUE(leds->getRenderTimes().getCount() > 10);
+    TEST_ASSERT_EQUAL_UINT32(leds->getRenderTimes().getCount(), leds->getFrameCount());
+
+    leds->resetRenderTimes();
+    TEST_ASSERT_EQUAL_UINT32(0, leds->getRenderTimes().getCount());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_unchanged_frame_is_not_sent_again);
+    RUN_TEST(test_frames_are_capped_at_the_frame_rate);
+    RUN_TEST(test_fade_ends_on_target);
+    RUN_TEST(test_render_gate_defers_frame);
+    RUN_TEST(test_busy_strip_defers_frame);
+    RUN_TEST(test_tables_are_monotonic_and_span_the_range);
+    RUN_TEST(test_tray_window_and_progress_bar);
+    RUN_TEST(test_pulse_breathes_and_stops);
+    RUN_TEST(test_render_times_are_recorded);
+    return UNITY_END();
+}
@@ -0,0 +1,95 @@
+#include <unity.h>
+#include "sim/Simulator.h"
+
+namespace {
+    Simulator::Options options() {
+        Simulator::Options options;
+        options.orders = 4;
+        options.mix.push_back({{{2, 40.0}, {8, 60.0}}, 1.0});
+        return options;
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Every order is served and the cups hold what was ordered, give or take the pour tolerance.
+void test_session_serves_every_order() {
+    Simulator simulator(options());
+    Simulator::Report report = simulator.run();
+
+    TEST_ASSERT_FALSE(report.timedOut);
+    TEST_ASSERT_EQUAL_UINT32(4, report.drinks);
+    TEST_ASSERT_EQUAL_UINT32(4, report.overshoot.size());
+    TEST_ASSERT_EQUAL_UINT32(8, report.stepOvershoot.size());
+    for (float overshoot : report.overshoot) {
+        TEST_ASSERT_FLOAT_WITHIN(6.0, 0.0, overshoot);
+    }
+    TEST_ASSERT_TRUE(report.drinksPerHour > 0);
+    TEST_ASSERT_TRUE(Simulator::percentile(report.latencyS, 1.0) >= Simulator::percentile(report.serviceS, 1.0));
+}
+
+// Queued orders wait on each other, later ones see the earlier service times as latency.
+void test_latency_includes_queueing() {
+    Simulator simulator(options());
+    Simulator::Report report = simulator.run();
+
+    TEST_ASSERT_EQUAL_UINT32(4, report.latencyS.size());
+    TEST_ASSERT_TRUE(report.latencyS[3] > report.latencyS[0] + 3 * Simulator::percentile(report.serviceS, 0.0));
+}
+
+// Same seed, same session.
+void test_sessions_are_reproducible() {
+    Simulator first(options());
+    Simulator::Report a = first.run();
+    Simulator second(options());
+    Simulator::Report b = second.run();
+
+    TEST_ASSERT_EQUAL_FLOAT(a.sessionS, b.sessionS);
+    TEST_ASSERT_EQUAL_FLOAT(a.overshoot[0], b.overshoot[0]);
+}
+
+// The first pour of a recipe starting at station 1 opens ahead of arrival, zeroed on the cup as it
+// settled before the move.
+void test_station_one_first_pour_with_predictive_start() {
+    Simulator::Options session = options();
+    session.mix.clear();
+    session.mix.push_back({{{1, 45.0}, {7, 150.0}}, 1.0});
+    session.orders = 6;
+    session.predictiveStart = true;
+    Simulator simulator(session);
+    Simulator::Report report = simulator.run();
+
+    TEST_ASSERT_FALSE(report.timedOut);
+    TEST_ASSERT_EQUAL_UINT32(6, report.drinks);
+    for (float overshoot : report.overshoot) {
+        TEST_ASSERT_FLOAT_WITHIN(6.0, 0.0, overshoot);
+    }
+}
+
+// At 10Hz a lifted cup rings through the estimator, the next order must still wait for a real cup.
+void test_slow_scale_session_neither_spills_nor_stalls() {
+    Simulator::Options session = options();
+    session.mix.clear();
+    session.mix.push_back({{{1, 45.0}, {7, 150.0}}, 0.45});
+    session.mix.push_back({{{2, 40.0}, {3, 20.0}, {8, 30.0}, {9, 20.0}}, 0.35});
+    session.mix.push_back({{{4, 45.0}, {5, 20.0}, {6, 15.0}}, 0.2});
+    session.orders = 30;
+    session.fastScale = false;
+    Simulator simulator(session);
+    Simulator::Report report = simulator.run();
+
+    TEST_ASSERT_FALSE(report.timedOut);
+    TEST_ASSERT_EQUAL_UINT32(30, report.drinks);
+    TEST_ASSERT_EQUAL_FLOAT(0.0, report.spilled);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_session_serves_every_order);
+    RUN_TEST(test_latency_includes_queueing);
+    RUN_TEST(test_sessions_are_reproducible);
+    RUN_TEST(test_station_one_first_pour_with_predictive_start);
+    RUN_TEST(test_slow_scale_session_neither_spills_nor_stalls);
+    return UNITY_END();
+}
@@ -0,0 +1,174 @@
+#include <unity.h>
+#include "Transport.h"
+#include "InputShaper.h"
+#include "hal/native/FakePlatform.h"
+
+namespace {
+    const uint8_t HOME_SW_PIN = 37;
+
+    hal::FakePlatform* platform;
+    Transport* transport;
+    float switchPosition;   // Physical carriage position where the home switch closes.
+
+    // Steps the machine in 1ms ticks, the home switch follows the fake carriage.
+    bool runUntil(std::function<bool()> done, uint32_t timeoutMS) {
+        for (uint32_t elapsed = 0; elapsed < timeoutMS; elapsed++) {
+            platform->clock().advanceMS(1);
+            platform->gpio().setInput(HOME_SW_PIN, platform->stepper->getPhysicalPosition() <= switchPosition ? HIGH : LOW);
+            transport->heartbeat();
+            if (done()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void boot() {
+        transport = new Transport(HOME_SW_PIN, RX, TX, 15);
+        transport->defineStation(426);
+        transport->defineStation(875);
+        transport->setHomingMode(Transport::HomingMode::FAST);
+    }
+
+    bool home() {
+        bool homed = false;
+        transport->refMachine([&homed](bool success) { homed = success; });
+        return runUntil([&homed]() { return homed && transport->isParked(); }, 60000);
+    }
+
+    // Carries a cup to the station with the cup's slosh mode riding on the carriage, returns the swing
+    // left once the carriage stands on target.
+    float carryCup(uint8_t stationIndex, float liquidMass, InputShaper::Type shaper) {
+        const float METRES_PER_STEP = 0.0002;
+        Transport::SloshControl control;
+        control.shaper = shaper;
+        transport->setSloshControl(control);
+        PendulumModel cup(InputShaper::sloshFrequencyHz(liquidMass, control.cupRadiusM), control.damping);
+
+        float lastSpeed = platform->stepper->getCurrentSpeed();
+        transport->goToStation(stationIndex, 0, liquidMass);
+        bool arrived = runUntil([&]() {
+            float speed = platform->stepper->getCurrentSpeed();
+            cup.step((speed - lastSpeed) / 0.001 * METRES_PER_STEP, 0.001);
+            lastSpeed = speed;
+            return transport->isAtTarget();
+        }, 30000);
+        TEST_ASSERT_TRUE(arrived);
+        return cup.getAmplitude();
+    }
+}
+
+void setUp() {
+    hal::FakeStorage::clear();
+    platform = new hal::FakePlatform();
+    hal::setPlatform(platform);
+    switchPosition = -1500;
+    boot();
+}
+
+void tearDown() {
+    delete transport;
+    delete platform;
+}
+
+void test_fast_seek_latches_switch_edge() {
+    TEST_ASSERT_TRUE(home());
+    TEST_ASSERT_EQUAL_STRING("fast seek", transport->getHomingMethod());
+
+    // Zero must sit on the switch edge, not where the carriage stopped after overrunning it.
+    hal::FakeStepper* stepper = platform->stepper;
+    float switchCounter = switchPosition - (stepper->getPhysicalPosition() - stepper->getCurrentPosition());
+    TEST_ASSERT_FLOAT_WITHIN(2.0, 0.0, switchCounter);
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 15.0, transport->getCurrentPosition());
+}
+
+void test_persisted_reference_only_touches_switch() {
+    TEST_ASSERT_TRUE(home());
+    delete transport;
+
+    // Power cycle while parked, the new driver counts from wherever the carriage sits.
+    switchPosition = -15;
+    boot();
+    TEST_ASSERT_TRUE(home());
+    TEST_ASSERT_EQUAL_STRING("verification touch", transport->getHomingMethod());
+    TEST_ASSERT_LESS_THAN(2000, transport->getHomingDurationMS());
+}
+
+void test_go_to_station() {
+    TEST_ASSERT_TRUE(home());
+    transport->goToStation(2);
+    TEST_ASSERT_EQUAL(Transport::MachineState::MOVING_TO_TARGET_POS, transport->getState());
+
+    // Arrival is only predicted once the carriage brakes, the first estimate comes a little early
+    // (10% braking margin) while it still cruises.
+    TEST_ASSERT_TRUE(runUntil([]() { return transport->getPredictedArrivalMS() > 0; }, 20000));
+    uint32_t predictedMS = platform->clock().millis() + transport->getPredictedArrivalMS();
+    TEST_ASSERT_TRUE(runUntil([]() { return transport->isAtTarget(); }, 20000));
+    TEST_ASSERT_FLOAT_WITHIN(200, predictedMS, platform->clock().millis());
+    TEST_ASSERT_EQUAL(2, transport->getCurrentStationIndex());
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 875.0, transport->getCurrentPosition());
+}
+
+void test_park_reference_is_written_only_when_it_changes() {
+    TEST_ASSERT_TRUE(home());
+    uint32_t writes = hal::FakeStorage::getWriteCount("transport");
+    TEST_ASSERT_EQUAL(2, writes);
+
+    // The target write itself leaves NVS alone, the loop clears ref_ok once the carriage moves.
+    transport->goToStation(1);
+    TEST_ASSERT_EQUAL(writes, hal::FakeStorage::getWriteCount("transport"));
+    TEST_ASSERT_TRUE(runUntil([]() { return transport->isAtTarget(); }, 20000));
+    TEST_ASSERT_EQUAL(writes + 1, hal::FakeStorage::getWriteCount("transport"));
+
+    // Back on the same park step only ref_ok is rewritten.
+    transport->goPark();
+    TEST_ASSERT_TRUE(runUntil([]() { return transport->isParked(); }, 20000));
+    TEST_ASSERT_EQUAL(writes + 2, hal::FakeStorage::getWriteCount("transport"));
+}
+
+void test_idle_mirror_polls_driver_status_only() {
+    TEST_ASSERT_TRUE(home());
+
+    // Parked: one DRV_STATUS read per 100ms instead of four registers every 2ms.
+    uint32_t reads = platform->stepper->getReadCount();
+    runUntil([]() { return false; }, 1000);
+    TEST_ASSERT_LESS_THAN(12, platform->stepper->getReadCount() - reads);
+
+    // Moving: the full burst at the mirror interval.
+    transport->goToStation(1);
+    reads = platform->stepper->getReadCount();
+    runUntil([]() { return false; }, 100);
+    TEST_ASSERT_GREATER_THAN(4 * 45, platform->stepper->getReadCount() - reads);
+    TEST_ASSERT_TRUE(runUntil([]() { return transport->isAtTarget(); }, 20000));
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 426.0, transport->getCurrentPosition());
+}
+
+void test_shaped_move_leaves_less_slosh() {
+    transport->setMotionProfiles({
+        {600,  10, 400, 250, 300, 600,  300, 450, 20},
+        {1400, 10, 450, 300, 350, 1000, 350, 500, 20},
+    });
+    TEST_ASSERT_TRUE(home());
+
+    // Same profile and load scaling both ways, only the shaper differs.
+    float unshaped = carryCup(2, 300, InputShaper::Type::NONE);
+    float unshapedBack = carryCup(0, 300, InputShaper::Type::NONE);
+    float shaped = carryCup(2, 300, InputShaper::Type::ZVD);
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 875.0, transport->getCurrentPosition());
+    float shapedBack = carryCup(0, 300, InputShaper::Type::ZV);
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 15.0, transport->getCurrentPosition());
+
+    TEST_ASSERT_LESS_THAN_FLOAT(unshaped * 0.2, shaped);
+    TEST_ASSERT_LESS_THAN_FLOAT(unshapedBack * 0.2, shapedBack);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fast_seek_latches_switch_edge);
+    RUN_TEST(test_persisted_reference_only_touches_switch);
+    RUN_TEST(test_go_to_station);
+    RUN_TEST(test_park_reference_is_written_only_when_it_changes);
+    RUN_TEST(test_idle_mirror_polls_driver_status_only);
+    RUN_TEST(test_shaped_move_leaves_less_slosh);
+    return UNITY_END();
+}